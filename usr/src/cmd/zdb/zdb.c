@@ -461,6 +461,47 @@ dump_spacemap(objset_t *os, space_map_obj_t *smo, space_map_t *sm)
 	}
 }
 
+/*
+ * Count the segments in the in-core form of a metaslab's space map, and
+ * get the fragmentation and size histogram of its free space, by loading
+ * a private copy so as not to disturb the metaslab itself.
+ */
+static uint64_t
+measure_metaslab(metaslab_t *msp, uint64_t *frag, uint64_t *hist)
+{
+	space_map_obj_t *smo = &msp->ms_smo;
+	space_map_t *msm = &msp->ms_map;
+	spa_t *spa = msp->ms_group->mg_vd->vdev_spa;
+	space_map_t sm;
+	uint64_t segs = 0;
+
+	*frag = 0;
+	bzero(hist, SPACE_MAP_HISTOGRAM_SIZE * sizeof (uint64_t));
+
+	if (smo->smo_object == 0) {
+		/* never allocated from, so one free segment */
+		hist[highbit(msm->sm_size) - 1] = 1;
+		return (1);
+	}
+
+	space_map_create(&sm, msm->sm_start, msm->sm_size, msm->sm_shift,
+	    &msp->ms_lock);
+
+	mutex_enter(&msp->ms_lock);
+	if (space_map_load(&sm, NULL, SM_FREE, smo,
+	    spa->spa_meta_objset) == 0) {
+		segs = avl_numnodes(&sm.sm_root);
+		*frag = space_map_fragmentation(&sm);
+		bcopy(sm.sm_hist, hist, sizeof (sm.sm_hist));
+		space_map_unload(&sm);
+	}
+	mutex_exit(&msp->ms_lock);
+
+	space_map_destroy(&sm);
+
+	return (segs);
+}
+
 static void
 dump_metaslab(metaslab_t *msp)
 {
@@ -468,14 +509,20 @@ dump_metaslab(metaslab_t *msp)
 	space_map_obj_t *smo = &msp->ms_smo;
 	vdev_t *vd = msp->ms_group->mg_vd;
 	spa_t *spa = vd->vdev_spa;
+	uint64_t entries = smo->smo_objsize / sizeof (uint64_t);
+	uint64_t hist[SPACE_MAP_HISTOGRAM_SIZE];
+	uint64_t frag;
+	uint64_t segs = measure_metaslab(msp, &frag, hist);
+	int i;
 
 	nicenum(msp->ms_map.sm_size - smo->smo_alloc, freebuf);
 
 	if (dump_opt['d'] <= 5) {
-		(void) printf("\t%10llx   %10llu   %5s\n",
-		    (u_longlong_t)msp->ms_map.sm_start,
+		(void) printf("\t%10llx   %10llu   %5s   %10llu   %10llu   "
+		    "%3llu%%\n", (u_longlong_t)msp->ms_map.sm_start,
 		    (u_longlong_t)smo->smo_object,
-		    freebuf);
+		    freebuf, (u_longlong_t)entries, (u_longlong_t)segs,
+		    (u_longlong_t)frag);
 		return;
 	}
 
@@ -483,6 +530,19 @@ dump_metaslab(metaslab_t *msp)
 	    "\tvdev %llu   offset %08llx   spacemap %4llu   free %5s\n",
 	    (u_longlong_t)vd->vdev_id, (u_longlong_t)msp->ms_map.sm_start,
 	    (u_longlong_t)smo->smo_object, freebuf);
+	(void) printf("\tentries on disk %llu   segments in core %llu   "
+	    "fragmentation %llu%%\n", (u_longlong_t)entries,
+	    (u_longlong_t)segs, (u_longlong_t)frag);
+	(void) printf("\tfree segment sizes:\n");
+	for (i = 0; i < SPACE_MAP_HISTOGRAM_SIZE; i++) {
+		char sizebuf[6];
+
+		if (hist[i] == 0)
+			continue;
+		nicenum(1ULL << i, sizebuf);
+		(void) printf("\t\t%5s: %llu\n", sizebuf,
+		    (u_longlong_t)hist[i]);
+	}
 
 	ASSERT(msp->ms_map.sm_size == (1ULL << vd->vdev_ms_shift));
 
@@ -507,10 +567,12 @@ dump_metaslabs(spa_t *spa)
 		spa_config_exit(spa, FTAG);
 
 		if (dump_opt['d'] <= 5) {
-			(void) printf("\t%10s   %10s   %5s\n",
-			    "offset", "spacemap", "free");
-			(void) printf("\t%10s   %10s   %5s\n",
-			    "------", "--------", "----");
+			(void) printf("\t%10s   %10s   %5s   %10s   %10s   "
+			    "%4s\n", "offset", "spacemap", "free", "entries",
+			    "segments", "frag");
+			(void) printf("\t%10s   %10s   %5s   %10s   %10s   "
+			    "%4s\n", "------", "--------", "----", "-------",
+			    "--------", "----");
 		}
 		for (m = 0; m < vd->vdev_ms_count; m++)
 			dump_metaslab(vd->vdev_ms[m]);
@@ -1503,6 +1565,46 @@ zdb_blkptr_cb(traverse_blk_cache_t *bc, spa_t *spa, void *arg)
 	return (0);
 }
 
+/*
+ * Destroyed datasets on the pool's free queue keep the blocks the queue
+ * hasn't freed yet, but the pool traversal skips them.  Count those
+ * blocks by traversing from where each entry's freeing will resume.
+ */
+static void
+zdb_count_free_queue(spa_t *spa, zdb_cb_t *zcb, int advance, int flags)
+{
+	dsl_pool_t *dp = spa_get_dsl(spa);
+	objset_t *mos = dp->dp_meta_objset;
+	traverse_handle_t *th;
+	zap_cursor_t zc;
+	zap_attribute_t za;
+	dsl_free_entry_t fe;
+
+	if (dp->dp_free_queue_obj == 0)
+		return;
+
+	/* freeing resumes in post-order, so count in post-order too */
+	advance = (advance & ~ADVANCE_PRE) | ADVANCE_DESTROYED;
+	th = traverse_init(spa, zdb_blkptr_cb, zcb, advance, flags);
+	th->th_noread = zdb_noread;
+
+	for (zap_cursor_init(&zc, mos, dp->dp_free_queue_obj);
+	    zap_cursor_retrieve(&zc, &za) == 0;
+	    zap_cursor_advance(&zc)) {
+		VERIFY(0 == zap_lookup(mos, dp->dp_free_queue_obj, za.za_name,
+		    sizeof (uint64_t), DSL_FREE_ENTRY_INTS, &fe));
+		traverse_resume_objset(th, fe.fe_mintxg,
+		    spa_first_txg(spa) + TXG_CONCURRENT_STATES,
+		    &fe.fe_bookmark);
+	}
+	zap_cursor_fini(&zc);
+
+	while (traverse_more(th) == EAGAIN)
+		continue;
+
+	traverse_fini(th);
+}
+
 static int
 dump_block_stats(spa_t *spa)
 {
@@ -1578,6 +1680,8 @@ dump_block_stats(spa_t *spa)
 
 	traverse_fini(th);
 
+	zdb_count_free_queue(spa, &zcb, advance, flags);
+
 	if (zcb.zcb_haderrors) {
 		(void) printf("\nError counts:\n\n");
 		(void) printf("\t%5s  %s\n", "errno", "count");
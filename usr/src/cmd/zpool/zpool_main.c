@@ -91,6 +91,7 @@ static int zpool_do_export(int, char **);
 static int zpool_do_upgrade(int, char **);
 
 static int zpool_do_history(int, char **);
+static int zpool_do_txgs(int, char **);
 
 static int zpool_do_get(int, char **);
 static int zpool_do_set(int, char **);
@@ -129,6 +130,7 @@ typedef enum {
 	HELP_REMOVE,
 	HELP_SCRUB,
 	HELP_STATUS,
+	HELP_TXGS,
 	HELP_UPGRADE,
 	HELP_GET,
 	HELP_SET
@@ -176,6 +178,7 @@ static zpool_command_t command_table[] = {
 	{ "upgrade",	zpool_do_upgrade,	HELP_UPGRADE		},
 	{ NULL },
 	{ "history",	zpool_do_history,	HELP_HISTORY		},
+	{ "txgs",	zpool_do_txgs,		HELP_TXGS		},
 	{ "get",	zpool_do_get,		HELP_GET		},
 	{ "set",	zpool_do_set,		HELP_SET		},
 };
@@ -230,6 +233,8 @@ get_usage(zpool_help_t idx) {
 		return (gettext("\tscrub [-s] <pool> ...\n"));
 	case HELP_STATUS:
 		return (gettext("\tstatus [-vx] [pool] ...\n"));
+	case HELP_TXGS:
+		return (gettext("\ttxgs [pool] ...\n"));
 	case HELP_UPGRADE:
 		return (gettext("\tupgrade\n"
 		    "\tupgrade -v\n"
@@ -254,6 +259,7 @@ typedef enum {
 	ZPOOL_FIELD_USED,
 	ZPOOL_FIELD_AVAILABLE,
 	ZPOOL_FIELD_CAPACITY,
+	ZPOOL_FIELD_FRAGMENTATION,
 	ZPOOL_FIELD_HEALTH,
 	ZPOOL_FIELD_ROOT
 } zpool_field_t;
@@ -275,6 +281,7 @@ static column_def_t column_table[] = {
 	{ "USED",	6,	right_justify	},
 	{ "AVAIL",	6,	right_justify	},
 	{ "CAP",	5,	right_justify	},
+	{ "FRAG",	5,	right_justify	},
 	{ "HEALTH",	9,	left_justify	},
 	{ "ALTROOT",	15,	left_justify	}
 };
@@ -285,6 +292,7 @@ static char *column_subopts[] = {
 	"used",
 	"available",
 	"capacity",
+	"fragmentation",
 	"health",
 	"root",
 	NULL
@@ -1625,16 +1633,28 @@ print_iostat_separator(iostat_cbdata_t *cb)
 
 	for (i = 0; i < cb->cb_namewidth; i++)
 		(void) printf("-");
+	if (cb->cb_verbose)
+		(void) printf("  -----");
 	(void) printf("  -----  -----  -----  -----  -----  -----\n");
 }
 
+/*
+ * Verbose output adds a fragmentation column to the capacity group.
+ */
 static void
 print_iostat_header(iostat_cbdata_t *cb)
 {
-	(void) printf("%*s     capacity     operations    bandwidth\n",
-	    cb->cb_namewidth, "");
-	(void) printf("%-*s   used  avail   read  write   read  write\n",
-	    cb->cb_namewidth, "pool");
+	if (cb->cb_verbose) {
+		(void) printf("%*s        capacity         operations    "
+		    "bandwidth\n", cb->cb_namewidth, "");
+		(void) printf("%-*s   used  avail   frag   read  write   "
+		    "read  write\n", cb->cb_namewidth, "pool");
+	} else {
+		(void) printf("%*s     capacity     operations    "
+		    "bandwidth\n", cb->cb_namewidth, "");
+		(void) printf("%-*s   used  avail   read  write   "
+		    "read  write\n", cb->cb_namewidth, "pool");
+	}
 	print_iostat_separator(cb);
 }
 
@@ -1660,7 +1680,7 @@ print_vdev_stats(zpool_handle_t *zhp, const char *name, nvlist_t *oldnv,
     nvlist_t *newnv, iostat_cbdata_t *cb, int depth)
 {
 	nvlist_t **oldchild, **newchild;
-	uint_t c, children;
+	uint_t c, children, vsc;
 	vdev_stat_t *oldvs, *newvs;
 	vdev_stat_t zerovs = { 0 };
 	uint64_t tdelta;
@@ -1675,7 +1695,7 @@ print_vdev_stats(zpool_handle_t *zhp, const char *name, nvlist_t *oldnv,
 	}
 
 	verify(nvlist_lookup_uint64_array(newnv, ZPOOL_CONFIG_STATS,
-	    (uint64_t **)&newvs, &c) == 0);
+	    (uint64_t **)&newvs, &vsc) == 0);
 
 	if (strlen(name) + depth > cb->cb_namewidth)
 		(void) printf("%*s%s", depth, "", name);
@@ -1698,6 +1718,22 @@ print_vdev_stats(zpool_handle_t *zhp, const char *name, nvlist_t *oldnv,
 		print_one_stat(newvs->vs_space - newvs->vs_alloc);
 	}
 
+	if (cb->cb_verbose) {
+		/*
+		 * Older kernels don't report fragmentation.
+		 */
+		if (vsc * sizeof (uint64_t) < sizeof (vdev_stat_t) ||
+		    newvs->vs_fragmentation == ZFS_FRAG_INVALID) {
+			(void) printf("      -");
+		} else {
+			char buf[8];
+
+			(void) snprintf(buf, sizeof (buf), "%llu%%",
+			    (u_longlong_t)newvs->vs_fragmentation);
+			(void) printf("  %5s", buf);
+		}
+	}
+
 	print_one_stat((uint64_t)(scale * (newvs->vs_ops[ZIO_TYPE_READ] -
 	    oldvs->vs_ops[ZIO_TYPE_READ])));
 
@@ -2096,6 +2132,30 @@ list_callback(zpool_handle_t *zhp, void *data)
 			}
 			break;
 
+		case ZPOOL_FIELD_FRAGMENTATION:
+			if (config == NULL) {
+				(void) strlcpy(buf, "-", sizeof (buf));
+			} else {
+				nvlist_t *nvroot;
+				vdev_stat_t *vs;
+				uint_t vsc;
+
+				verify(nvlist_lookup_nvlist(config,
+				    ZPOOL_CONFIG_VDEV_TREE, &nvroot) == 0);
+				verify(nvlist_lookup_uint64_array(nvroot,
+				    ZPOOL_CONFIG_STATS, (uint64_t **)&vs,
+				    &vsc) == 0);
+				if (vsc * sizeof (uint64_t) <
+				    sizeof (vdev_stat_t) ||
+				    vs->vs_fragmentation == ZFS_FRAG_INVALID)
+					(void) strlcpy(buf, "-", sizeof (buf));
+				else
+					(void) snprintf(buf, sizeof (buf),
+					    "%llu%%",
+					    (u_longlong_t)vs->vs_fragmentation);
+			}
+			break;
+
 		case ZPOOL_FIELD_HEALTH:
 			if (config == NULL) {
 				(void) strlcpy(buf, "FAULTED", sizeof (buf));
@@ -2146,7 +2206,7 @@ list_callback(zpool_handle_t *zhp, void *data)
  *	-H	Scripted mode.  Don't display headers, and separate fields by
  *		a single tab.
  *	-o	List of fields to display.  Defaults to all fields, or
- *		"name,size,used,available,capacity,health,root"
+ *		"name,size,used,available,capacity,fragmentation,health,root"
  *
  * List all pools in the system, whether or not they're healthy.  Output space
  * statistics for each one, as well as health status summary.
@@ -2158,7 +2218,7 @@ zpool_do_list(int argc, char **argv)
 	int ret;
 	list_cbdata_t cb = { 0 };
 	static char default_fields[] =
-	    "name,size,used,available,capacity,health,root";
+	    "name,size,used,available,capacity,fragmentation,health,root";
 	char *fields = default_fields;
 	char *value;
 
@@ -2713,6 +2773,20 @@ print_scrub_status(nvlist_t *nvroot)
 	(void) printf(gettext("%s in progress, %.2f%% done, %lluh%um to go\n"),
 	    scrub_type, 100 * fraction_done,
 	    (u_longlong_t)(minutes_left / 60), (uint_t)(minutes_left % 60));
+
+	/*
+	 * Older kernels don't report the scrub throttle state.
+	 */
+	if (vsc * sizeof (uint64_t) < sizeof (vdev_stat_t) ||
+	    vs->vs_scrub_limit == 0)
+		return;
+
+	(void) printf(gettext("\t%llu I/Os in flight max"),
+	    (u_longlong_t)vs->vs_scrub_limit);
+	if (vs->vs_scrub_delay != 0)
+		(void) printf(gettext(", %llums delay per I/O"),
+		    (u_longlong_t)vs->vs_scrub_delay);
+	(void) printf("\n");
 }
 
 typedef struct spare_cbdata {
@@ -3415,6 +3489,9 @@ zpool_do_upgrade(int argc, char **argv)
 		(void) printf(gettext(" 6   pool properties\n"));
 		(void) printf(gettext(" 7   Separate intent log devices\n"));
 		(void) printf(gettext(" 8   Delegated administration\n"));
+		(void) printf(gettext(" 9   Blocks larger than 128K\n"));
+		(void) printf(gettext(" 10  Special allocation class\n"));
+		(void) printf(gettext(" 11  Background dataset destroy\n"));
 		(void) printf(gettext("For more information on a particular "
 		    "version, including supported releases, see:\n\n"));
 		(void) printf("http://www.opensolaris.org/os/community/zfs/"
@@ -3645,6 +3722,120 @@ zpool_do_history(int argc, char **argv)
 	return (ret);
 }
 
+/*
+ * Print out the recent txg statistics for a specific pool.
+ */
+static int
+txgs_one(zpool_handle_t *zhp, void *data)
+{
+	static const char statechar[] = "OQWSC";
+	nvlist_t *nvtxgs;
+	nvlist_t **records;
+	uint_t numrecords;
+	uint64_t txg, state, open, quiesce, wait, sync;
+	uint64_t dirty, written, passes, deferred, zilc;
+	char dirtybuf[6], writtenbuf[6];
+	boolean_t *first = data;
+	int ret, i;
+
+	if (!*first)
+		(void) printf("\n");
+	*first = B_FALSE;
+
+	(void) printf(gettext("Txgs for '%s':\n"), zpool_get_name(zhp));
+
+	if ((ret = zpool_get_txg_history(zhp, &nvtxgs)) != 0)
+		return (ret);
+
+	if (nvlist_lookup_nvlist_array(nvtxgs, ZPOOL_TXG_RECORD,
+	    &records, &numrecords) != 0) {
+		(void) printf(gettext("no txg history kept\n"));
+		nvlist_free(nvtxgs);
+		return (0);
+	}
+
+	(void) printf("%12s %1s %8s %8s %8s %8s %5s %5s %6s %5s %5s\n",
+	    "TXG", "S", "OPEN", "QUIESCE", "WAIT", "SYNC", "DIRTY",
+	    "WRITE", "PASSES", "DEFER", "ZILC");
+	for (i = 0; i < numrecords; i++) {
+		verify(nvlist_lookup_uint64(records[i], ZPOOL_TXG_TXG,
+		    &txg) == 0);
+		verify(nvlist_lookup_uint64(records[i], ZPOOL_TXG_STATE,
+		    &state) == 0);
+		verify(nvlist_lookup_uint64(records[i], ZPOOL_TXG_OPEN_TIME,
+		    &open) == 0);
+		verify(nvlist_lookup_uint64(records[i],
+		    ZPOOL_TXG_QUIESCE_TIME, &quiesce) == 0);
+		verify(nvlist_lookup_uint64(records[i], ZPOOL_TXG_WAIT_TIME,
+		    &wait) == 0);
+		verify(nvlist_lookup_uint64(records[i], ZPOOL_TXG_SYNC_TIME,
+		    &sync) == 0);
+		verify(nvlist_lookup_uint64(records[i], ZPOOL_TXG_DIRTY,
+		    &dirty) == 0);
+		verify(nvlist_lookup_uint64(records[i], ZPOOL_TXG_WRITTEN,
+		    &written) == 0);
+		verify(nvlist_lookup_uint64(records[i], ZPOOL_TXG_PASSES,
+		    &passes) == 0);
+		verify(nvlist_lookup_uint64(records[i], ZPOOL_TXG_DEFERRED,
+		    &deferred) == 0);
+		verify(nvlist_lookup_uint64(records[i],
+		    ZPOOL_TXG_ZIL_COMMITS, &zilc) == 0);
+
+		zfs_nicenum(dirty, dirtybuf, sizeof (dirtybuf));
+		zfs_nicenum(written, writtenbuf, sizeof (writtenbuf));
+
+		/* times are reported in milliseconds */
+		(void) printf("%12llu %c %8llu %8llu %8llu %8llu %5s %5s "
+		    "%6llu %5llu %5llu\n", (u_longlong_t)txg,
+		    state < sizeof (statechar) - 1 ? statechar[state] : '?',
+		    (u_longlong_t)(open / 1000000),
+		    (u_longlong_t)(quiesce / 1000000),
+		    (u_longlong_t)(wait / 1000000),
+		    (u_longlong_t)(sync / 1000000), dirtybuf, writtenbuf,
+		    (u_longlong_t)passes, (u_longlong_t)deferred,
+		    (u_longlong_t)zilc);
+	}
+	nvlist_free(nvtxgs);
+
+	return (0);
+}
+
+/*
+ * zpool txgs [pool] ...
+ *
+ * Displays how long each of a pool's recent txgs spent open, quiescing,
+ * waiting to sync and syncing, with the data it dirtied and wrote.  The
+ * state column is O(pen), Q(uiescing), W(aiting), S(yncing) or C(ommitted).
+ */
+int
+zpool_do_txgs(int argc, char **argv)
+{
+	boolean_t first = B_TRUE;
+	int ret;
+	int c;
+
+	/* check options */
+	while ((c = getopt(argc, argv, "")) != -1) {
+		switch (c) {
+		case '?':
+			(void) fprintf(stderr, gettext("invalid option '%c'\n"),
+			    optopt);
+			usage(B_FALSE);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	ret = for_each_pool(argc, argv, B_FALSE, NULL, txgs_one, &first);
+
+	if (argc == 0 && first == B_TRUE) {
+		(void) printf(gettext("no pools available\n"));
+		return (0);
+	}
+
+	return (ret);
+}
+
 static int
 get_callback(zpool_handle_t *zhp, void *data)
 {
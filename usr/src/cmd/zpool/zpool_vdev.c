@@ -587,15 +587,18 @@ get_replication(nvlist_t *nvroot, boolean_t fatal)
 	lastrep.zprl_type = NULL;
 	for (t = 0; t < toplevels; t++) {
 		uint64_t is_log = B_FALSE;
+		uint64_t is_special = B_FALSE;
 
 		nv = top[t];
 
 		/*
-		 * For separate logs we ignore the top level vdev replication
-		 * constraints.
+		 * For separate logs and special vdevs we ignore the top level
+		 * vdev replication constraints.
 		 */
 		(void) nvlist_lookup_uint64(nv, ZPOOL_CONFIG_IS_LOG, &is_log);
-		if (is_log)
+		(void) nvlist_lookup_uint64(nv, ZPOOL_CONFIG_IS_SPECIAL,
+		    &is_special);
+		if (is_log || is_special)
 			continue;
 
 		verify(nvlist_lookup_string(nv, ZPOOL_CONFIG_TYPE,
@@ -1148,6 +1151,12 @@ is_grouping(const char *type, int *mindev)
 		return (VDEV_TYPE_LOG);
 	}
 
+	if (strcmp(type, "special") == 0) {
+		if (mindev != NULL)
+			*mindev = 1;
+		return (VDEV_TYPE_SPECIAL);
+	}
+
 	return (NULL);
 }
 
@@ -1161,10 +1170,10 @@ nvlist_t *
 construct_spec(int argc, char **argv)
 {
 	nvlist_t *nvroot, *nv, **top, **spares;
-	int t, toplevels, mindev, nspares, nlogs;
+	int t, toplevels, mindev, nspares, nlogs, nspecial;
 	const char *type;
-	uint64_t is_log;
-	boolean_t seen_logs;
+	uint64_t is_log, is_special;
+	boolean_t seen_logs, seen_special;
 
 	top = NULL;
 	toplevels = 0;
@@ -1173,6 +1182,9 @@ construct_spec(int argc, char **argv)
 	nlogs = 0;
 	is_log = B_FALSE;
 	seen_logs = B_FALSE;
+	nspecial = 0;
+	is_special = B_FALSE;
+	seen_special = B_FALSE;
 
 	while (argc > 0) {
 		nv = NULL;
@@ -1194,6 +1206,7 @@ construct_spec(int argc, char **argv)
 					return (NULL);
 				}
 				is_log = B_FALSE;
+				is_special = B_FALSE;
 			}
 
 			if (strcmp(type, VDEV_TYPE_LOG) == 0) {
@@ -1206,6 +1219,7 @@ construct_spec(int argc, char **argv)
 				}
 				seen_logs = B_TRUE;
 				is_log = B_TRUE;
+				is_special = B_FALSE;
 				argc--;
 				argv++;
 				/*
@@ -1215,6 +1229,26 @@ construct_spec(int argc, char **argv)
 				continue;
 			}
 
+			if (strcmp(type, VDEV_TYPE_SPECIAL) == 0) {
+				if (seen_special) {
+					(void) fprintf(stderr,
+					    gettext("invalid vdev "
+					    "specification: 'special' can be "
+					    "specified only once\n"));
+					return (NULL);
+				}
+				seen_special = B_TRUE;
+				is_special = B_TRUE;
+				is_log = B_FALSE;
+				argc--;
+				argv++;
+				/*
+				 * Like log, special is not a real grouping
+				 * device.
+				 */
+				continue;
+			}
+
 			if (is_log) {
 				if (strcmp(type, VDEV_TYPE_MIRROR) != 0) {
 					(void) fprintf(stderr,
@@ -1226,6 +1260,17 @@ construct_spec(int argc, char **argv)
 				nlogs++;
 			}
 
+			if (is_special) {
+				if (strcmp(type, VDEV_TYPE_MIRROR) != 0) {
+					(void) fprintf(stderr,
+					    gettext("invalid vdev "
+					    "specification: unsupported "
+					    "'special' device: %s\n"), type);
+					return (NULL);
+				}
+				nspecial++;
+			}
+
 			for (c = 1; c < argc; c++) {
 				if (is_grouping(argv[c], NULL) != NULL)
 					break;
@@ -1261,6 +1306,10 @@ construct_spec(int argc, char **argv)
 				    type) == 0);
 				verify(nvlist_add_uint64(nv,
 				    ZPOOL_CONFIG_IS_LOG, is_log) == 0);
+				if (is_special)
+					verify(nvlist_add_uint64(nv,
+					    ZPOOL_CONFIG_IS_SPECIAL,
+					    B_TRUE) == 0);
 				if (strcmp(type, VDEV_TYPE_RAIDZ) == 0) {
 					verify(nvlist_add_uint64(nv,
 					    ZPOOL_CONFIG_NPARITY,
@@ -1283,6 +1332,11 @@ construct_spec(int argc, char **argv)
 				return (NULL);
 			if (is_log)
 				nlogs++;
+			if (is_special) {
+				verify(nvlist_add_uint64(nv,
+				    ZPOOL_CONFIG_IS_SPECIAL, B_TRUE) == 0);
+				nspecial++;
+			}
 			argc--;
 			argv++;
 		}
@@ -1307,6 +1361,12 @@ construct_spec(int argc, char **argv)
 		return (NULL);
 	}
 
+	if (seen_special && nspecial == 0) {
+		(void) fprintf(stderr, gettext("invalid vdev specification: "
+		    "special requires at least 1 device\n"));
+		return (NULL);
+	}
+
 	/*
 	 * Finally, create nvroot and add all top-level vdevs to it.
 	 */
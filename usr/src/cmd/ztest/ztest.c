@@ -79,6 +79,7 @@
 #include <sys/dmu.h>
 #include <sys/txg.h>
 #include <sys/zap.h>
+#include <sys/arc.h>
 #include <sys/dmu_traverse.h>
 #include <sys/dmu_objset.h>
 #include <sys/poll.h>
@@ -91,6 +92,7 @@
 #include <sys/zio_checksum.h>
 #include <sys/zio_compress.h>
 #include <sys/zil.h>
+#include <sys/zil_impl.h>
 #include <sys/vdev_impl.h>
 #include <sys/spa_impl.h>
 #include <sys/dsl_prop.h>
@@ -125,6 +127,7 @@ static int zopt_init = 1;
 static char *zopt_dir = "/tmp";
 static uint64_t zopt_time = 300;	/* 5 minutes */
 static int zopt_maxfaults;
+static struct ztest_bench *zopt_bench;
 
 typedef struct ztest_args {
 	char		*za_pool;
@@ -163,6 +166,8 @@ ztest_func_t ztest_vdev_LUN_growth;
 ztest_func_t ztest_vdev_add_remove;
 ztest_func_t ztest_scrub;
 ztest_func_t ztest_spa_rename;
+ztest_func_t ztest_zil_commit_foid;
+ztest_func_t ztest_dmu_partial_free;
 
 typedef struct ztest_info {
 	ztest_func_t	*zi_func;	/* test function */
@@ -187,6 +192,8 @@ ztest_info_t ztest_info[] = {
 	{ ztest_traverse,			&zopt_often	},
 	{ ztest_dsl_prop_get_set,		&zopt_sometimes	},
 	{ ztest_dmu_objset_create_destroy,	&zopt_sometimes	},
+	{ ztest_zil_commit_foid,		&zopt_sometimes	},
+	{ ztest_dmu_partial_free,		&zopt_sometimes	},
 	{ ztest_dmu_snapshot_create_destroy,	&zopt_rarely	},
 	{ ztest_spa_create_destroy,		&zopt_sometimes	},
 	{ ztest_fault_inject,			&zopt_sometimes	},
@@ -233,9 +240,14 @@ static ztest_shared_t *ztest_shared;
 
 static int ztest_random_fd;
 static int ztest_dump_core = 1;
+static int ztest_replay_workers = 4;	/* zil_replay_parallel() workers */
 
 extern uint64_t zio_gang_bang;
 extern uint16_t zio_zil_fail_shift;
+extern int vdev_file_queue_depth;
+extern int zfs_txg_pipeline_depth;
+extern int zfs_partial_write_disable;
+extern int zil_itx_lists_disable;
 
 #define	ZTEST_DIROBJ		1
 #define	ZTEST_MICROZAP_OBJ	2
@@ -244,6 +256,68 @@ extern uint16_t zio_zil_fail_shift;
 #define	ZTEST_DIROBJ_BLOCKSIZE	(1 << 10)
 #define	ZTEST_DIRSIZE		256
 
+/*
+ * Benchmarks, run with -B in place of the usual test passes.  Each runs
+ * zopt_threads writers for zopt_passtime seconds with its tunable set
+ * first to one value and then the other, and reports the latency of the
+ * writes -- dmu_tx_assign() through dmu_tx_commit() -- as percentiles,
+ * along with how much the related kstats moved.  The replay benchmark
+ * also times how long the log of those writes takes to replay, and its
+ * kstats cover just the replay.
+ */
+typedef struct ztest_bench {
+	char		*zb_name;
+	char		*zb_desc;
+	char		*zb_tunable_name;
+	int		*zb_tunable;
+	int		zb_setting[2];	/* values to compare */
+	int		zb_blockshift;	/* object block size */
+	int		zb_writeshift;	/* size of each write */
+	boolean_t	zb_random;	/* random, not sequential, offsets */
+	boolean_t	zb_cold;	/* fill objects, start uncached */
+	boolean_t	zb_fsync;	/* log writes, even threads commit */
+	boolean_t	zb_replay;	/* log writes, time their replay */
+	char		*zb_kstat;	/* "zfs" kstat to report */
+	char		*zb_stats[4];	/* its statistics, NULL-terminated */
+} ztest_bench_t;
+
+static ztest_bench_t ztest_bench[] = {
+	{ "txg", "sustained 128K sequential writes",
+	    "zfs_txg_pipeline_depth", &zfs_txg_pipeline_depth, { 1, 2 },
+	    SPA_OLD_MAXBLOCKSHIFT, SPA_OLD_MAXBLOCKSHIFT, B_FALSE, B_FALSE,
+	    B_FALSE, B_FALSE,
+	    "dsl_pool", { "dirty_kicks", "dirty_max_waits", "delays", NULL } },
+	{ "partial", "random 4K writes to uncached 128K blocks",
+	    "zfs_partial_write_disable", &zfs_partial_write_disable, { 1, 0 },
+	    SPA_OLD_MAXBLOCKSHIFT, 12, B_TRUE, B_TRUE, B_FALSE, B_FALSE,
+	    "dbufstats", { "partial_writes", "partial_waits", NULL } },
+	{ "fsync", "4K writes to one file per thread, half of them fsynced",
+	    "zil_itx_lists_disable", &zil_itx_lists_disable, { 1, 0 },
+	    SPA_OLD_MAXBLOCKSHIFT, 12, B_FALSE, B_FALSE, B_TRUE, B_FALSE,
+	    "zil", { "commits", "lwbs", NULL } },
+	{ "replay", "one pass of 128K writes over a file per thread, replayed",
+	    "ztest_replay_workers", &ztest_replay_workers, { 1, 4 },
+	    SPA_OLD_MAXBLOCKSHIFT, SPA_OLD_MAXBLOCKSHIFT, B_FALSE, B_FALSE,
+	    B_FALSE, B_TRUE,
+	    "zil", { "replay_records", "replay_reads", "replay_errors", NULL } },
+	{ NULL }
+};
+
+typedef struct ztest_bench_arg {
+	ztest_bench_t	*ba_bench;
+	objset_t	*ba_os;
+	zilog_t		*ba_zilog;	/* for zb_fsync and zb_replay */
+	boolean_t	ba_commit;	/* commit after each write */
+	uint64_t	ba_object;
+	uint64_t	ba_objsize;
+	hrtime_t	ba_stop;
+	hrtime_t	*ba_lat;	/* latency of each write */
+	uint64_t	ba_count;
+	uint64_t	ba_size;	/* entries allocated in ba_lat */
+	uint64_t	ba_enospc;
+	thread_t	ba_thread;
+} ztest_bench_arg_t;
+
 static void usage(boolean_t) __NORETURN;
 
 /*
@@ -376,6 +450,9 @@ usage(boolean_t requested)
 	    "\t[-T time] total run time (default: %llu sec)\n"
 	    "\t[-P passtime] time per pass (default: %llu sec)\n"
 	    "\t[-z zil failure rate (default: fail every 2^%llu allocs)]\n"
+	    "\t[-q file vdev queue depth (default: %d)]\n"
+	    "\t[-B benchmark] (txg, partial, fsync, replay) run a benchmark "
+	    "instead of the tests\n"
 	    "\t[-h] (print help)\n"
 	    "",
 	    cmdname,
@@ -394,7 +471,8 @@ usage(boolean_t requested)
 	    zopt_dir,				/* -f */
 	    (u_longlong_t)zopt_time,		/* -T */
 	    (u_longlong_t)zopt_passtime,	/* -P */
-	    (u_longlong_t)zio_zil_fail_shift);	/* -z */
+	    (u_longlong_t)zio_zil_fail_shift,	/* -z */
+	    vdev_file_queue_depth);		/* -q */
 	exit(requested ? 0 : 1);
 }
 
@@ -432,7 +510,7 @@ process_options(int argc, char **argv)
 	zio_zil_fail_shift = 5;
 
 	while ((opt = getopt(argc, argv,
-	    "v:s:a:m:r:R:d:t:g:i:k:p:f:VET:P:z:h")) != EOF) {
+	    "v:s:a:m:r:R:d:t:g:i:k:p:f:VET:P:z:q:B:h")) != EOF) {
 		value = 0;
 		switch (opt) {
 		case 'v':
@@ -449,6 +527,7 @@ process_options(int argc, char **argv)
 		case 'T':
 		case 'P':
 		case 'z':
+		case 'q':
 			value = nicenumtoull(optarg);
 		}
 		switch (opt) {
@@ -506,6 +585,17 @@ process_options(int argc, char **argv)
 		case 'z':
 			zio_zil_fail_shift = MIN(value, 16);
 			break;
+		case 'q':
+			vdev_file_queue_depth = MAX(1, value);
+			break;
+		case 'B':
+			for (zopt_bench = ztest_bench;
+			    zopt_bench->zb_name != NULL; zopt_bench++)
+				if (strcmp(zopt_bench->zb_name, optarg) == 0)
+					break;
+			if (zopt_bench->zb_name == NULL)
+				usage(B_FALSE);
+			break;
 		case 'h':
 			usage(B_TRUE);
 			break;
@@ -751,6 +841,36 @@ ztest_replay_remove(ztest_replay_t *zr, lr_remove_t *lr, boolean_t byteswap)
 	return (error);
 }
 
+static int
+ztest_replay_write(ztest_replay_t *zr, lr_write_t *lr, boolean_t byteswap)
+{
+	objset_t *os = zr->zr_os;
+	dmu_tx_t *tx;
+	int error;
+
+	if (byteswap)
+		byteswap_uint64_array(lr, sizeof (*lr));
+
+	/*
+	 * If the object was removed later on, there's nothing to write.
+	 */
+	if (dmu_object_info(os, lr->lr_foid, NULL) == ENOENT)
+		return (0);
+
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_write(tx, lr->lr_foid, lr->lr_offset, lr->lr_length);
+	error = dmu_tx_assign(tx, zr->zr_assign);
+	if (error) {
+		dmu_tx_abort(tx);
+		return (error);
+	}
+
+	dmu_write(os, lr->lr_foid, lr->lr_offset, lr->lr_length, lr + 1, tx);
+	dmu_tx_commit(tx);
+
+	return (0);
+}
+
 zil_replay_func_t *ztest_replay_vector[TX_MAX_TYPE] = {
 	NULL,			/* 0 no such transaction type */
 	ztest_replay_create,	/* TX_CREATE */
@@ -761,12 +881,40 @@ zil_replay_func_t *ztest_replay_vector[TX_MAX_TYPE] = {
 	NULL,			/* TX_RMDIR */
 	NULL,			/* TX_LINK */
 	NULL,			/* TX_RENAME */
-	NULL,			/* TX_WRITE */
+	ztest_replay_write,	/* TX_WRITE */
 	NULL,			/* TX_TRUNCATE */
 	NULL,			/* TX_SETATTR */
 	NULL,			/* TX_ACL */
 };
 
+/*
+ * Replay os's intent log with the given number of workers, each with a
+ * ztest_replay_t, and so a txg assignment, of its own.
+ */
+static void
+ztest_replay(objset_t *os, int nworkers)
+{
+	ztest_replay_t *zr;
+	uint64_t **txgps;
+	void **args;
+	int w;
+
+	zr = umem_zalloc(nworkers * sizeof (ztest_replay_t), UMEM_NOFAIL);
+	args = umem_alloc(nworkers * sizeof (void *), UMEM_NOFAIL);
+	txgps = umem_alloc(nworkers * sizeof (uint64_t *), UMEM_NOFAIL);
+	for (w = 0; w < nworkers; w++) {
+		zr[w].zr_os = os;
+		args[w] = &zr[w];
+		txgps[w] = &zr[w].zr_assign;
+	}
+
+	zil_replay_parallel(os, nworkers, args, txgps, ztest_replay_vector);
+
+	umem_free(txgps, nworkers * sizeof (uint64_t *));
+	umem_free(args, nworkers * sizeof (void *));
+	umem_free(zr, nworkers * sizeof (ztest_replay_t));
+}
+
 /*
  * Verify that we can't destroy an active pool, create an existing pool,
  * or create a pool with a bad vdev spec.
@@ -1168,6 +1316,83 @@ ztest_log_create(zilog_t *zilog, dmu_tx_t *tx, uint64_t object, int mode)
 	return (zil_itx_assign(zilog, itx, tx));
 }
 
+/*
+ * Log a write of the given data, or if data is NULL, an indirect write
+ * whose block ztest_get_data() syncs out at commit time.
+ */
+static uint64_t
+ztest_log_write(zilog_t *zilog, dmu_tx_t *tx, uint64_t object,
+    uint64_t offset, uint64_t length, void *data, boolean_t sync)
+{
+	itx_t *itx;
+	lr_write_t *lr;
+
+	itx = zil_itx_create(TX_WRITE,
+	    sizeof (*lr) + (data != NULL ? length : 0));
+	itx->itx_wr_state = (data != NULL ? WR_COPIED : WR_INDIRECT);
+	itx->itx_private = zilog->zl_os;
+	itx->itx_sync = sync;
+	lr = (lr_write_t *)&itx->itx_lr;
+	lr->lr_foid = object;
+	lr->lr_offset = offset;
+	lr->lr_length = length;
+	lr->lr_blkoff = 0;
+	BP_ZERO(&lr->lr_blkptr);
+	if (data != NULL)
+		bcopy(data, (char *)(lr + 1), length);
+
+	return (zil_itx_assign(zilog, itx, tx));
+}
+
+static void
+ztest_get_done(dmu_buf_t *db, void *arg)
+{
+	zgd_t *zgd = arg;
+
+	dmu_buf_rele(db, zgd);
+	zil_add_vdev(zgd->zgd_zilog, DVA_GET_VDEV(BP_IDENTITY(zgd->zgd_bp)));
+	umem_free(zgd, sizeof (zgd_t));
+}
+
+/*
+ * Get the data for a TX_WRITE record, as zfs_get_data() does.  Nothing
+ * writes the objects of an indirect record while their log is being
+ * committed, so there is no range lock to take.
+ */
+static int
+ztest_get_data(void *arg, lr_write_t *lr, char *buf, zio_t *zio)
+{
+	objset_t *os = arg;
+	dmu_buf_t *db;
+	zgd_t *zgd;
+	int error;
+
+	if (buf != NULL)	/* immediate write */
+		return (dmu_read(os, lr->lr_foid, lr->lr_offset,
+		    lr->lr_length, buf));
+
+	zgd = umem_alloc(sizeof (zgd_t), UMEM_NOFAIL);
+	zgd->zgd_zilog = dmu_objset_zil(os);
+	zgd->zgd_bp = &lr->lr_blkptr;
+	zgd->zgd_rl = NULL;
+	VERIFY(dmu_buf_hold(os, lr->lr_foid, lr->lr_offset, zgd, &db) == 0);
+	lr->lr_blkoff = lr->lr_offset - db->db_offset;
+	error = dmu_sync(zio, db, &lr->lr_blkptr, lr->lr_common.lrc_txg,
+	    ztest_get_done, zgd);
+	if (error == 0)
+		zil_add_vdev(zgd->zgd_zilog,
+		    DVA_GET_VDEV(BP_IDENTITY(&lr->lr_blkptr)));
+	/*
+	 * On EINPROGRESS, ztest_get_done() cleans up once dmu_sync()'s
+	 * write is done.
+	 */
+	if (error == EINPROGRESS)
+		return (0);
+	dmu_buf_rele(db, zgd);
+	umem_free(zgd, sizeof (zgd_t));
+	return (error);
+}
+
 void
 ztest_dmu_objset_create_destroy(ztest_args_t *za)
 {
@@ -1178,7 +1403,6 @@ ztest_dmu_objset_create_destroy(ztest_args_t *za)
 	zilog_t *zilog;
 	uint64_t seq;
 	uint64_t objects;
-	ztest_replay_t zr;
 
 	(void) rw_rdlock(&ztest_shared->zs_name_lock);
 	(void) snprintf(name, 100, "%s/%s_temp_%llu", za->za_pool, za->za_pool,
@@ -1190,13 +1414,13 @@ ztest_dmu_objset_create_destroy(ztest_args_t *za)
 
 	/*
 	 * If this dataset exists from a previous run, process its replay log
-	 * half of the time.  If we don't replay it, then dmu_objset_destroy()
+	 * half of the time, with anywhere from one to ztest_replay_workers
+	 * workers.  If we don't replay it, then dmu_objset_destroy()
 	 * (invoked from ztest_destroy_cb() below) should just throw it away.
 	 */
 	if (ztest_random(2) == 0 &&
 	    dmu_objset_open(name, DMU_OST_OTHER, DS_MODE_PRIMARY, &os) == 0) {
-		zr.zr_os = os;
-		zil_replay(os, &zr, &zr.zr_assign, ztest_replay_vector);
+		ztest_replay(os, 1 + ztest_random(ztest_replay_workers));
 		dmu_objset_close(os);
 	}
 
@@ -1259,6 +1483,8 @@ ztest_dmu_objset_create_destroy(ztest_args_t *za)
 			seq = ztest_log_create(zilog, tx, object,
 			    DMU_OT_UINT64_OTHER);
 			dmu_write(os, object, 0, sizeof (name), name, tx);
+			seq = ztest_log_write(zilog, tx, object, 0,
+			    sizeof (name), name, B_FALSE);
 			dmu_tx_commit(tx);
 		}
 		if (ztest_random(5) == 0) {
@@ -1306,6 +1532,208 @@ ztest_dmu_objset_create_destroy(ztest_args_t *za)
 	(void) rw_unlock(&ztest_shared->zs_name_lock);
 }
 
+/*
+ * Verify that committing one object's intent log records leaves other
+ * objects' records alone, even synchronous ones: a commit for foid
+ * pushes only foid's records and those not tied to any one object.
+ */
+void
+ztest_zil_commit_foid(ztest_args_t *za)
+{
+	objset_t *os;
+	zilog_t *zilog;
+	dmu_tx_t *tx;
+	itx_t *itx;
+	char name[100];
+	uint64_t data = 0;
+	uint64_t seq, other_seq, txg;
+	int error;
+
+	if (zil_itx_lists_disable)
+		return;
+
+	(void) rw_rdlock(&ztest_shared->zs_name_lock);
+	(void) snprintf(name, 100, "%s/%s_zil_%llu", za->za_pool, za->za_pool,
+	    (u_longlong_t)za->za_instance);
+
+	(void) dmu_objset_find(name, ztest_destroy_cb, NULL,
+	    DS_FIND_CHILDREN | DS_FIND_SNAPSHOTS);
+
+	error = dmu_objset_create(name, DMU_OST_OTHER, NULL, ztest_create_cb,
+	    NULL);
+	if (error) {
+		if (error == ENOSPC) {
+			ztest_record_enospc("dmu_objset_create");
+			(void) rw_unlock(&ztest_shared->zs_name_lock);
+			return;
+		}
+		fatal(0, "dmu_objset_create(%s) = %d", name, error);
+	}
+
+	error = dmu_objset_open(name, DMU_OST_OTHER, DS_MODE_STANDARD, &os);
+	if (error)
+		fatal(0, "dmu_objset_open(%s) = %d", name, error);
+
+	zilog = zil_open(os, NULL);
+
+	/*
+	 * Log a synchronous write to one object, then a write to another,
+	 * and commit only the second.
+	 */
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_bonus(tx, ZTEST_DIROBJ);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		dmu_tx_abort(tx);
+		ztest_record_enospc("zil commit foid");
+		zil_close(zilog);
+		dmu_objset_close(os);
+		(void) dmu_objset_destroy(name);
+		(void) rw_unlock(&ztest_shared->zs_name_lock);
+		return;
+	}
+	txg = dmu_tx_get_txg(tx);
+	other_seq = ztest_log_write(zilog, tx, ZTEST_MICROZAP_OBJ, 0,
+	    sizeof (data), &data, B_TRUE);
+	seq = ztest_log_write(zilog, tx, ZTEST_FATZAP_OBJ, 0,
+	    sizeof (data), &data, B_FALSE);
+	dmu_tx_commit(tx);
+
+	zil_commit(zilog, seq, ZTEST_FATZAP_OBJ);
+
+	/*
+	 * The other object's record must still be waiting to be pushed,
+	 * unless its txg has synced and zil_itx_clean() took it away.
+	 */
+	mutex_enter(&zilog->zl_lock);
+	for (itx = list_head(&zilog->zl_itx_list); itx != NULL;
+	    itx = list_next(&zilog->zl_itx_list, itx))
+		if (itx->itx_lr.lrc_seq == other_seq)
+			break;
+	mutex_exit(&zilog->zl_lock);
+	if (itx == NULL && spa_last_synced_txg(dmu_objset_spa(os)) < txg)
+		fatal(0, "commit of object %llu pushed object %llu's record",
+		    (u_longlong_t)ZTEST_FATZAP_OBJ,
+		    (u_longlong_t)ZTEST_MICROZAP_OBJ);
+
+	zil_close(zilog);
+	dmu_objset_close(os);
+
+	error = dmu_objset_destroy(name);
+	if (error)
+		fatal(0, "dmu_objset_destroy(%s) = %d", name, error);
+
+	(void) rw_unlock(&ztest_shared->zs_name_lock);
+}
+
+/*
+ * Verify that an object can be freed in the same txg as a partial write
+ * to one of its blocks, while the read of the old block may still be in
+ * flight when the txg syncs.
+ */
+void
+ztest_dmu_partial_free(ztest_args_t *za)
+{
+	objset_t *os;
+	dmu_tx_t *tx;
+	char name[100];
+	uint64_t blocksize = SPA_OLD_MAXBLOCKSIZE;
+	uint64_t size = 1ULL << 12;
+	uint64_t object;
+	void *buf;
+	int error;
+
+	if (zfs_partial_write_disable)
+		return;
+
+	(void) rw_rdlock(&ztest_shared->zs_name_lock);
+	(void) snprintf(name, 100, "%s/%s_partial_%llu", za->za_pool,
+	    za->za_pool, (u_longlong_t)za->za_instance);
+
+	(void) dmu_objset_find(name, ztest_destroy_cb, NULL,
+	    DS_FIND_CHILDREN | DS_FIND_SNAPSHOTS);
+
+	error = dmu_objset_create(name, DMU_OST_OTHER, NULL, ztest_create_cb,
+	    NULL);
+	if (error) {
+		if (error == ENOSPC) {
+			ztest_record_enospc("dmu_objset_create");
+			(void) rw_unlock(&ztest_shared->zs_name_lock);
+			return;
+		}
+		fatal(0, "dmu_objset_create(%s) = %d", name, error);
+	}
+
+	error = dmu_objset_open(name, DMU_OST_OTHER, DS_MODE_STANDARD, &os);
+	if (error)
+		fatal(0, "dmu_objset_open(%s) = %d", name, error);
+
+	buf = umem_alloc(blocksize, UMEM_NOFAIL);
+	(void) memset(buf, 0xa5, blocksize);
+
+	/*
+	 * Write a whole block of a new object and get it onto disk.
+	 */
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0, blocksize);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		dmu_tx_abort(tx);
+		ztest_record_enospc("partial free");
+		goto out;
+	}
+	object = dmu_object_alloc(os, DMU_OT_UINT64_OTHER, blocksize,
+	    DMU_OT_NONE, 0, tx);
+	dmu_write(os, object, 0, blocksize, buf, tx);
+	dmu_tx_commit(tx);
+	txg_wait_synced(dmu_objset_pool(os), 0);
+
+	/*
+	 * Drop the block from the dbuf cache and the ARC, so that the
+	 * partial write below has to read it from disk.
+	 */
+	dmu_objset_close(os);
+	arc_flush();
+	error = dmu_objset_open(name, DMU_OST_OTHER, DS_MODE_STANDARD, &os);
+	if (error)
+		fatal(0, "dmu_objset_open(%s) = %d", name, error);
+
+	/*
+	 * Overwrite part of the block, and free the object in the same tx.
+	 */
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_write(tx, object, size, size);
+	dmu_tx_hold_free(tx, object, 0, DMU_OBJECT_END);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		dmu_tx_abort(tx);
+		ztest_record_enospc("partial free");
+		goto out;
+	}
+	dmu_write(os, object, size, size, buf, tx);
+	error = dmu_object_free(os, object, tx);
+	if (error)
+		fatal(0, "dmu_object_free(%llu) = %d",
+		    (u_longlong_t)object, error);
+	dmu_tx_commit(tx);
+	txg_wait_synced(dmu_objset_pool(os), 0);
+
+	error = dmu_object_info(os, object, NULL);
+	if (error != ENOENT)
+		fatal(0, "dmu_object_info(%llu) of freed object = %d",
+		    (u_longlong_t)object, error);
+
+out:
+	umem_free(buf, blocksize);
+	dmu_objset_close(os);
+
+	error = dmu_objset_destroy(name);
+	if (error)
+		fatal(0, "dmu_objset_destroy(%s) = %d", name, error);
+
+	(void) rw_unlock(&ztest_shared->zs_name_lock);
+}
+
 /*
  * Verify that dmu_snapshot_{create,destroy,open,close} work as expected.
  */
@@ -1973,7 +2401,7 @@ ztest_dmu_write_parallel(ztest_args_t *za)
 	uint64_t off, txg_how, txg;
 	mutex_t *lp;
 	char osname[MAXNAMELEN];
-	char iobuf[SPA_MAXBLOCKSIZE];
+	char iobuf[SPA_OLD_MAXBLOCKSIZE];
 	ztest_block_tag_t rbt, wbt;
 
 	dmu_objset_name(os, osname);
@@ -3076,6 +3504,7 @@ ztest_run(char *pool)
 	ztest_args_t *za;
 	spa_t *spa;
 	char name[100];
+	hrtime_t replaytime;
 
 	(void) _mutex_init(&zs->zs_vdev_lock, USYNC_THREAD, NULL);
 	(void) rwlock_init(&zs->zs_name_lock, USYNC_THREAD, NULL);
@@ -3174,7 +3603,6 @@ ztest_run(char *pool)
 	for (t = 0; t < zopt_threads; t++) {
 		d = t % zopt_datasets;
 		if (t < zopt_datasets) {
-			ztest_replay_t zr;
 			int test_future = FALSE;
 			(void) rw_rdlock(&ztest_shared->zs_name_lock);
 			(void) snprintf(name, 100, "%s/%s_%d", pool, pool, d);
@@ -3201,9 +3629,12 @@ ztest_run(char *pool)
 			if (test_future && ztest_shared->zs_txg > 0)
 				ztest_dmu_check_future_leak(za[d].za_os,
 				    ztest_shared->zs_txg);
-			zr.zr_os = za[d].za_os;
-			zil_replay(zr.zr_os, &zr, &zr.zr_assign,
-			    ztest_replay_vector);
+			replaytime = gethrtime();
+			ztest_replay(za[d].za_os, ztest_replay_workers);
+			replaytime = gethrtime() - replaytime;
+			if (zopt_verbose >= 3)
+				(void) printf("replayed %s in %llu usec\n",
+				    name, (u_longlong_t)(replaytime / 1000));
 			za[d].za_zilog = zil_open(za[d].za_os, NULL);
 		}
 		za[t].za_pool = spa_strdup(pool);
@@ -3299,6 +3730,370 @@ print_time(hrtime_t t, char *timebuf)
 		(void) sprintf(timebuf, "%llus", s);
 }
 
+static void
+ztest_bench_record(ztest_bench_arg_t *ba, hrtime_t lat)
+{
+	hrtime_t *newlat;
+	uint64_t newsize;
+
+	if (ba->ba_count == ba->ba_size) {
+		newsize = MAX(ba->ba_size * 2, 1024);
+		newlat = umem_alloc(newsize * sizeof (hrtime_t), UMEM_NOFAIL);
+		if (ba->ba_lat != NULL) {
+			bcopy(ba->ba_lat, newlat,
+			    ba->ba_count * sizeof (hrtime_t));
+			umem_free(ba->ba_lat, ba->ba_size * sizeof (hrtime_t));
+		}
+		ba->ba_lat = newlat;
+		ba->ba_size = newsize;
+	}
+	ba->ba_lat[ba->ba_count++] = lat;
+}
+
+static void *
+ztest_bench_thread(void *arg)
+{
+	ztest_bench_arg_t *ba = arg;
+	ztest_bench_t *zb = ba->ba_bench;
+	uint64_t size = 1ULL << zb->zb_writeshift;
+	uint64_t off = 0;
+	uint64_t seq = 0;
+	hrtime_t start;
+	dmu_tx_t *tx;
+	void *buf;
+	int error;
+
+	buf = umem_alloc(size, UMEM_NOFAIL);
+	(void) memset(buf, 0xa5, size);
+
+	for (;;) {
+		if (zb->zb_random)
+			off = ztest_random(ba->ba_objsize / size) * size;
+		if ((start = gethrtime()) >= ba->ba_stop)
+			break;
+		tx = dmu_tx_create(ba->ba_os);
+		dmu_tx_hold_write(tx, ba->ba_object, off, size);
+		error = dmu_tx_assign(tx, TXG_WAIT);
+		if (error) {
+			if (error != ENOSPC)
+				fatal(0, "dmu_tx_assign() = %d", error);
+			dmu_tx_abort(tx);
+			ba->ba_enospc++;
+			continue;
+		}
+		dmu_write(ba->ba_os, ba->ba_object, off, size, buf, tx);
+		if (ba->ba_zilog != NULL)
+			seq = ztest_log_write(ba->ba_zilog, tx, ba->ba_object,
+			    off, size, zb->zb_replay ? NULL : buf, B_FALSE);
+		dmu_tx_commit(tx);
+		if (ba->ba_commit)
+			zil_commit(ba->ba_zilog, seq, ba->ba_object);
+		if (!zb->zb_fsync || ba->ba_commit)
+			ztest_bench_record(ba, gethrtime() - start);
+		if (!zb->zb_random)
+			off = (off + size) % ba->ba_objsize;
+		/*
+		 * The pool is frozen under zb_replay, so overwrites would
+		 * free nothing; write each block once.
+		 */
+		if (zb->zb_replay && off == 0)
+			break;
+	}
+
+	umem_free(buf, size);
+
+	return (NULL);
+}
+
+static int
+ztest_bench_compare(const void *a, const void *b)
+{
+	hrtime_t la = *(const hrtime_t *)a;
+	hrtime_t lb = *(const hrtime_t *)b;
+
+	return (la < lb ? -1 : la > lb ? 1 : 0);
+}
+
+/*
+ * Return the given percentile, in tenths of a percent, of the sorted
+ * latencies, in microseconds.
+ */
+static u_longlong_t
+ztest_bench_pct(hrtime_t *lat, uint64_t count, uint64_t permille)
+{
+	return ((u_longlong_t)lat[MIN(count * permille / 1000, count - 1)] /
+	    (NANOSEC / MICROSEC));
+}
+
+/*
+ * Write every block of each thread's object in full, so that the
+ * benchmark's writes land on blocks that exist on disk.
+ */
+static void
+ztest_bench_fill(ztest_bench_arg_t *ba, uint64_t blocksize)
+{
+	dmu_tx_t *tx;
+	uint64_t off;
+	void *buf;
+	int t, error;
+
+	buf = umem_alloc(blocksize, UMEM_NOFAIL);
+	(void) memset(buf, 0x5a, blocksize);
+
+	for (t = 0; t < zopt_threads; t++) {
+		for (off = 0; off < ba[t].ba_objsize; off += blocksize) {
+			tx = dmu_tx_create(ba[t].ba_os);
+			dmu_tx_hold_write(tx, ba[t].ba_object, off, blocksize);
+			error = dmu_tx_assign(tx, TXG_WAIT);
+			if (error)
+				fatal(0, "dmu_tx_assign() = %d", error);
+			dmu_write(ba[t].ba_os, ba[t].ba_object, off, blocksize,
+			    buf, tx);
+			dmu_tx_commit(tx);
+		}
+	}
+
+	umem_free(buf, blocksize);
+}
+
+/*
+ * Run one pass of benchmark zb against a fresh dataset, with its
+ * tunable set to zb_setting[setting].
+ */
+static void
+ztest_bench_pass(char *pool, ztest_bench_t *zb, int setting)
+{
+	ztest_bench_arg_t *ba;
+	objset_t *os;
+	zilog_t *zilog = NULL;
+	spa_t *spa;
+	dmu_tx_t *tx;
+	hrtime_t *lat, start, elapsed;
+	uint64_t blocksize = 1ULL << zb->zb_blockshift;
+	uint64_t objsize, count, enospc, before[4];
+	int saved = *zb->zb_tunable;
+	char name[100];
+	int t, s, error;
+
+	kernel_init(FREAD | FWRITE);
+	error = spa_open(pool, &spa, FTAG);
+	if (error)
+		fatal(0, "spa_open() = %d", error);
+
+	(void) snprintf(name, 100, "%s/bench", pool);
+	(void) dmu_objset_destroy(name);
+	error = dmu_objset_create(name, DMU_OST_OTHER, NULL, NULL, NULL);
+	if (error)
+		fatal(0, "dmu_objset_create(%s) = %d", name, error);
+	error = dmu_objset_open(name, DMU_OST_OTHER, DS_MODE_STANDARD, &os);
+	if (error)
+		fatal(0, "dmu_objset_open('%s') = %d", name, error);
+
+	/*
+	 * Give each thread an object of its own.  Between them they cover
+	 * a quarter of the pool, so that overwriting them can't run the
+	 * pool out of space.
+	 */
+	objsize = P2ALIGN(spa_get_space(spa) / 4 / zopt_threads, blocksize);
+	objsize = MAX(objsize, blocksize);
+
+	ba = umem_zalloc(zopt_threads * sizeof (ztest_bench_arg_t),
+	    UMEM_NOFAIL);
+
+	for (t = 0; t < zopt_threads; t++) {
+		tx = dmu_tx_create(os);
+		dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0, blocksize);
+		error = dmu_tx_assign(tx, TXG_WAIT);
+		if (error)
+			fatal(0, "dmu_tx_assign() = %d", error);
+		ba[t].ba_bench = zb;
+		ba[t].ba_os = os;
+		ba[t].ba_object = dmu_object_alloc(os, DMU_OT_UINT64_OTHER,
+		    blocksize, DMU_OT_NONE, 0, tx);
+		ba[t].ba_objsize = objsize;
+		dmu_tx_commit(tx);
+	}
+
+	/*
+	 * Cycle the whole stack after filling the objects, so that the
+	 * run starts with nothing cached in the dbuf cache or the ARC.
+	 */
+	if (zb->zb_cold) {
+		ztest_bench_fill(ba, blocksize);
+		dmu_objset_close(os);
+		spa_close(spa, FTAG);
+		kernel_fini();
+
+		kernel_init(FREAD | FWRITE);
+		error = spa_open(pool, &spa, FTAG);
+		if (error)
+			fatal(0, "spa_open() = %d", error);
+		error = dmu_objset_open(name, DMU_OST_OTHER, DS_MODE_STANDARD,
+		    &os);
+		if (error)
+			fatal(0, "dmu_objset_open('%s') = %d", name, error);
+		for (t = 0; t < zopt_threads; t++)
+			ba[t].ba_os = os;
+	}
+	txg_wait_synced(spa_get_dsl(spa), 0);
+
+	/*
+	 * For zb_fsync, every write is logged but only the even-numbered
+	 * threads commit, so that each commit has other files' records
+	 * outstanding around its own.
+	 */
+	if (zb->zb_fsync) {
+		zilog = zil_open(os, NULL);
+		for (t = 0; t < zopt_threads; t++) {
+			ba[t].ba_zilog = zilog;
+			ba[t].ba_commit = (t % 2 == 0);
+		}
+	}
+
+	/*
+	 * For zb_replay, every write is logged as an indirect write and
+	 * the pool is frozen, so that none of them reach the uberblock.
+	 * The first commit, made before the freeze, puts the log chain in
+	 * the dataset's header on disk.
+	 */
+	if (zb->zb_replay) {
+		zilog = zil_open(os, ztest_get_data);
+		tx = dmu_tx_create(os);
+		dmu_tx_hold_write(tx, ba[0].ba_object, 0, sizeof (name));
+		error = dmu_tx_assign(tx, TXG_WAIT);
+		if (error)
+			fatal(0, "dmu_tx_assign() = %d", error);
+		dmu_write(os, ba[0].ba_object, 0, sizeof (name), name, tx);
+		(void) ztest_log_write(zilog, tx, ba[0].ba_object, 0,
+		    sizeof (name), name, B_FALSE);
+		dmu_tx_commit(tx);
+		zil_commit(zilog, UINT64_MAX, 0);
+		txg_wait_synced(spa_get_dsl(spa), 0);
+		spa_freeze(spa);
+		for (t = 0; t < zopt_threads; t++)
+			ba[t].ba_zilog = zilog;
+	}
+
+	*zb->zb_tunable = zb->zb_setting[setting];
+	for (s = 0; zb->zb_stats[s] != NULL; s++)
+		before[s] = kstat_named_value("zfs", zb->zb_kstat,
+		    zb->zb_stats[s]);
+
+	start = gethrtime();
+	for (t = 0; t < zopt_threads; t++) {
+		ba[t].ba_stop = start + zopt_passtime * NANOSEC;
+		error = thr_create(0, 0, ztest_bench_thread, &ba[t],
+		    THR_BOUND, &ba[t].ba_thread);
+		if (error)
+			fatal(0, "can't create thread %d: error %d", t, error);
+	}
+
+	count = enospc = 0;
+	for (t = 0; t < zopt_threads; t++) {
+		error = thr_join(ba[t].ba_thread, NULL, NULL);
+		if (error)
+			fatal(0, "thr_join(%d) = %d", t, error);
+		count += ba[t].ba_count;
+		enospc += ba[t].ba_enospc;
+	}
+	elapsed = gethrtime() - start;
+
+	(void) printf("%s=%d: %llu writes, %llu/sec, %llu ENOSPC\n",
+	    zb->zb_tunable_name, *zb->zb_tunable, (u_longlong_t)count,
+	    (u_longlong_t)(count * NANOSEC / MAX(elapsed, 1)),
+	    (u_longlong_t)enospc);
+
+	if (count != 0) {
+		lat = umem_alloc(count * sizeof (hrtime_t), UMEM_NOFAIL);
+		for (count = 0, t = 0; t < zopt_threads; t++) {
+			bcopy(ba[t].ba_lat, &lat[count],
+			    ba[t].ba_count * sizeof (hrtime_t));
+			count += ba[t].ba_count;
+		}
+		qsort(lat, count, sizeof (hrtime_t), ztest_bench_compare);
+		(void) printf("\tlatency (usec): p50 %llu, p90 %llu, p99 %llu, "
+		    "p99.9 %llu, max %llu\n",
+		    ztest_bench_pct(lat, count, 500),
+		    ztest_bench_pct(lat, count, 900),
+		    ztest_bench_pct(lat, count, 990),
+		    ztest_bench_pct(lat, count, 999),
+		    ztest_bench_pct(lat, count, 1000));
+		umem_free(lat, count * sizeof (hrtime_t));
+	}
+
+	/*
+	 * For zb_replay, commit the log and cycle the whole stack.  What
+	 * the writers did since the freeze is lost, so reopening the
+	 * dataset has to replay every write from the log.
+	 */
+	if (zb->zb_replay) {
+		zil_commit(zilog, UINT64_MAX, 0);
+		zil_close(zilog);
+		zilog = NULL;
+		dmu_objset_close(os);
+		spa_close(spa, FTAG);
+		kernel_fini();
+
+		kernel_init(FREAD | FWRITE);
+		error = spa_open(pool, &spa, FTAG);
+		if (error)
+			fatal(0, "spa_open() = %d", error);
+		error = dmu_objset_open(name, DMU_OST_OTHER, DS_MODE_STANDARD,
+		    &os);
+		if (error)
+			fatal(0, "dmu_objset_open('%s') = %d", name, error);
+
+		for (s = 0; zb->zb_stats[s] != NULL; s++)
+			before[s] = kstat_named_value("zfs", zb->zb_kstat,
+			    zb->zb_stats[s]);
+		start = gethrtime();
+		ztest_replay(os, *zb->zb_tunable);
+		elapsed = gethrtime() - start;
+		(void) printf("\treplay: %llu usec\n",
+		    (u_longlong_t)(elapsed / (NANOSEC / MICROSEC)));
+	}
+
+	(void) printf("\t%s:", zb->zb_kstat);
+	for (s = 0; zb->zb_stats[s] != NULL; s++) {
+		(void) printf(" %s %llu", zb->zb_stats[s],
+		    (u_longlong_t)(kstat_named_value("zfs", zb->zb_kstat,
+		    zb->zb_stats[s]) - before[s]));
+	}
+	(void) printf("\n");
+
+	*zb->zb_tunable = saved;
+
+	for (t = 0; t < zopt_threads; t++) {
+		if (ba[t].ba_lat != NULL)
+			umem_free(ba[t].ba_lat,
+			    ba[t].ba_size * sizeof (hrtime_t));
+	}
+	umem_free(ba, zopt_threads * sizeof (ztest_bench_arg_t));
+
+	if (zilog != NULL)
+		zil_close(zilog);
+	dmu_objset_close(os);
+	error = dmu_objset_destroy(name);
+	if (error)
+		fatal(0, "dmu_objset_destroy(%s) = %d", name, error);
+
+	spa_close(spa, FTAG);
+	kernel_fini();
+}
+
+static void
+ztest_bench_run(char *pool, ztest_bench_t *zb)
+{
+	int setting;
+
+	(void) printf("%s: %s, %d threads, %llu sec per setting\n",
+	    zb->zb_name, zb->zb_desc, zopt_threads,
+	    (u_longlong_t)zopt_passtime);
+
+	for (setting = 0; setting < 2; setting++)
+		ztest_bench_pass(pool, zb, setting);
+}
+
 /*
  * Create a storage pool with the given name and initial vdev size.
  * Then create the specified number of datasets in the pool.
@@ -3387,6 +4182,11 @@ main(int argc, char **argv)
 		ztest_init(zopt_pool);
 	}
 
+	if (zopt_bench != NULL) {
+		ztest_bench_run(zopt_pool, zopt_bench);
+		return (0);
+	}
+
 	/*
 	 * Initialize the call targets for each function.
 	 */
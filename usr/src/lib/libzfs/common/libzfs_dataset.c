@@ -864,18 +864,27 @@ zfs_validate_properties(libzfs_handle_t *hdl, zfs_type_t type, char *pool_name,
 
 		case ZFS_PROP_RECORDSIZE:
 		case ZFS_PROP_VOLBLOCKSIZE:
-			/* must be power of two within SPA_{MIN,MAX}BLOCKSIZE */
+		{
+			uint64_t maxbs = prop == ZFS_PROP_RECORDSIZE ?
+			    SPA_MAXBLOCKSIZE : SPA_OLD_MAXBLOCKSIZE;
+
+			/*
+			 * Must be power of two within SPA_{MIN,MAX}BLOCKSIZE.
+			 * Records above SPA_OLD_MAXBLOCKSIZE also need a pool
+			 * version the kernel checks for.
+			 */
 			if (intval < SPA_MINBLOCKSIZE ||
-			    intval > SPA_MAXBLOCKSIZE || !ISP2(intval)) {
+			    intval > maxbs || !ISP2(intval)) {
 				zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
 				    "'%s' must be power of 2 from %u "
 				    "to %uk"), propname,
 				    (uint_t)SPA_MINBLOCKSIZE,
-				    (uint_t)SPA_MAXBLOCKSIZE >> 10);
+				    (uint_t)maxbs >> 10);
 				(void) zfs_error(hdl, EZFS_BADPROP, errbuf);
 				goto error;
 			}
 			break;
+		}
 		case ZFS_PROP_SHAREISCSI:
 #ifdef __APPLE__
 			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
@@ -2927,7 +2936,7 @@ zfs_create(libzfs_handle_t *hdl, const char *path, zfs_type_t type,
 			    "volume block size must be power of 2 from "
 			    "%u to %uk"),
 			    (uint_t)SPA_MINBLOCKSIZE,
-			    (uint_t)SPA_MAXBLOCKSIZE >> 10);
+			    (uint_t)SPA_OLD_MAXBLOCKSIZE >> 10);
 
 			return (zfs_error(hdl, EZFS_BADPROP, errbuf));
 
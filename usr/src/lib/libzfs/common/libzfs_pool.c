@@ -80,7 +80,8 @@ zpool_name_valid(libzfs_handle_t *hdl, boolean_t isopen, const char *pool)
 	    (strncmp(pool, "mirror", 6) == 0 ||
 	    strncmp(pool, "raidz", 5) == 0 ||
 	    strncmp(pool, "spare", 5) == 0 ||
-	    strcmp(pool, "log") == 0)) {
+	    strcmp(pool, "log") == 0 ||
+	    strcmp(pool, "special") == 0)) {
 		zfs_error_aux(hdl,
 		    dgettext(TEXT_DOMAIN, "name is reserved"));
 		return (B_FALSE);
@@ -1989,6 +1990,45 @@ zpool_get_history(zpool_handle_t *zhp, nvlist_t **nvhisp)
 	return (err);
 }
 
+/*
+ * Retrieve the statistics of a pool's most recent txgs.
+ */
+int
+zpool_get_txg_history(zpool_handle_t *zhp, nvlist_t **nvp)
+{
+	zfs_cmd_t zc = { 0 };
+	libzfs_handle_t *hdl = zhp->zpool_hdl;
+
+	(void) strlcpy(zc.zc_name, zhp->zpool_name, sizeof (zc.zc_name));
+
+	if (zcmd_alloc_dst_nvlist(hdl, &zc, 0) != 0)
+		return (-1);
+
+	while (ioctl(hdl->libzfs_fd, ZFS_IOC_POOL_TXG_HISTORY, &zc) != 0) {
+		if (errno == ENOMEM) {
+			if (zcmd_expand_dst_nvlist(hdl, &zc) != 0) {
+				zcmd_free_nvlists(&zc);
+				return (-1);
+			}
+		} else {
+			zcmd_free_nvlists(&zc);
+			return (zpool_standard_error_fmt(hdl, errno,
+			    dgettext(TEXT_DOMAIN,
+			    "cannot get txg history for '%s'"),
+			    zhp->zpool_name));
+		}
+	}
+
+	if (zcmd_read_dst_nvlist(hdl, &zc, nvp) != 0) {
+		zcmd_free_nvlists(&zc);
+		return (-1);
+	}
+
+	zcmd_free_nvlists(&zc);
+
+	return (0);
+}
+
 void
 zpool_obj_to_path(zpool_handle_t *zhp, uint64_t dsobj, uint64_t obj,
     char *pathname, size_t len)
@@ -2333,6 +2373,7 @@ zpool_get_prop(zpool_handle_t *zhp, zpool_prop_t prop, char *propbuf,
 
 	case ZPOOL_PROP_DELEGATION:
 	case ZPOOL_PROP_AUTOREPLACE:
+	case ZPOOL_PROP_AUTOTRIM:
 		if (nvlist_lookup_nvlist(zhp->zpool_props,
 		    zpool_prop_to_name(prop), &nvp) != 0) {
 			value = zpool_prop_default_numeric(prop);
@@ -2347,6 +2388,17 @@ zpool_get_prop(zpool_handle_t *zhp, zpool_prop_t prop, char *propbuf,
 		(void) strlcpy(propbuf, value ? "on" : "off", proplen);
 		break;
 
+	case ZPOOL_PROP_FREEING:
+		if (nvlist_lookup_nvlist(zhp->zpool_props,
+		    zpool_prop_to_name(prop), &nvp) != 0) {
+			value = 0;
+		} else {
+			VERIFY(nvlist_lookup_uint64(nvp, ZFS_PROP_VALUE,
+			    &value) == 0);
+		}
+		zfs_nicenum(value, propbuf, proplen);
+		break;
+
 	default:
 		return (-1);
 	}
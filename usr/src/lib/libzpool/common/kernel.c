@@ -73,23 +73,102 @@ zk_thread_create(void (*func)(), void *arg)
  * kstats
  * =========================================================================
  */
-/*ARGSUSED*/
+/*
+ * Installed kstats are kept on a list so that ztest can read them back
+ * with kstat_named_value().  Only virtual kstats are supported.
+ */
+typedef struct ekstat {
+	kstat_t		e_ks;		/* the kstat itself */
+	list_node_t	e_node;		/* on kstat_list once installed */
+} ekstat_t;
+
+static kmutex_t kstat_lock;
+static list_t kstat_list;
+
+static void
+kstat_set_string(char *dst, const char *src)
+{
+	bzero(dst, KSTAT_STRLEN);
+	(void) strncpy(dst, src, KSTAT_STRLEN - 1);
+}
+
 kstat_t *
 kstat_create(char *module, int instance, char *name, char *class,
     uchar_t type, ulong_t ndata, uchar_t ks_flag)
 {
-	return (NULL);
+	ekstat_t *e;
+	kstat_t *ksp;
+
+	ASSERT(ks_flag & KSTAT_FLAG_VIRTUAL);
+
+	e = umem_zalloc(sizeof (ekstat_t), UMEM_NOFAIL);
+	ksp = &e->e_ks;
+	kstat_set_string(ksp->ks_module, module);
+	ksp->ks_instance = instance;
+	kstat_set_string(ksp->ks_name, name);
+	kstat_set_string(ksp->ks_class, class);
+	ksp->ks_type = type;
+	ksp->ks_flags = ks_flag;
+	ksp->ks_ndata = ndata;
+
+	return (ksp);
 }
 
-/*ARGSUSED*/
 void
 kstat_install(kstat_t *ksp)
-{}
+{
+	ekstat_t *e = (ekstat_t *)ksp;
+
+	mutex_enter(&kstat_lock);
+	list_insert_tail(&kstat_list, e);
+	mutex_exit(&kstat_lock);
+}
 
-/*ARGSUSED*/
 void
 kstat_delete(kstat_t *ksp)
-{}
+{
+	ekstat_t *e = (ekstat_t *)ksp;
+
+	mutex_enter(&kstat_lock);
+	if (list_link_active(&e->e_node))
+		list_remove(&kstat_list, e);
+	mutex_exit(&kstat_lock);
+
+	umem_free(e, sizeof (ekstat_t));
+}
+
+/*
+ * Return the current value of statistic stat of the named kstat
+ * module:name, or 0 if there is no such statistic.
+ */
+uint64_t
+kstat_named_value(char *module, char *name, char *stat)
+{
+	ekstat_t *e;
+	kstat_named_t *kn;
+	uint64_t value = 0;
+	int i;
+
+	mutex_enter(&kstat_lock);
+	for (e = list_head(&kstat_list); e != NULL;
+	    e = list_next(&kstat_list, e)) {
+		if (e->e_ks.ks_type != KSTAT_TYPE_NAMED ||
+		    strcmp(e->e_ks.ks_module, module) != 0 ||
+		    strcmp(e->e_ks.ks_name, name) != 0)
+			continue;
+		kn = e->e_ks.ks_data;
+		for (i = 0; i < e->e_ks.ks_ndata; i++) {
+			if (strcmp(kn[i].name, stat) == 0) {
+				value = kn[i].value.ui64;
+				break;
+			}
+		}
+		break;
+	}
+	mutex_exit(&kstat_lock);
+
+	return (value);
+}
 
 /*
  * =========================================================================
@@ -435,6 +514,47 @@ vn_rdwr(int uio, vnode_t *vp, void *addr, ssize_t len, offset_t offset,
 	return (0);
 }
 
+/*
+ * Release the backing store for [offset, offset + len) without changing
+ * the file's size, so that freed space in file vdevs is returned to the
+ * underlying filesystem.
+ */
+int
+vn_space(vnode_t *vp, offset_t offset, offset_t len)
+{
+#if defined(FALLOC_FL_PUNCH_HOLE) && defined(FALLOC_FL_KEEP_SIZE)
+	if (fallocate(vp->v_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+	    offset, len) == -1)
+		return (errno == EOPNOTSUPP ? ENOTSUP : errno);
+	return (0);
+#elif defined(F_PUNCHHOLE)
+	/*
+	 * F_PUNCHHOLE wants a range aligned to the filesystem's block
+	 * size, so release only the whole blocks inside the one given.
+	 */
+	fpunchhole_t fp = { 0 };
+	struct stat64 st;
+	offset_t end = offset + len;
+
+	if (fstat64(vp->v_fd, &st) == -1)
+		return (errno);
+	if (st.st_blksize > 0) {
+		offset = P2ROUNDUP(offset, (offset_t)st.st_blksize);
+		end = P2ALIGN(end, (offset_t)st.st_blksize);
+	}
+	if (end <= offset)
+		return (0);
+
+	fp.fp_offset = offset;
+	fp.fp_length = end - offset;
+	if (fcntl(vp->v_fd, F_PUNCHHOLE, &fp) == -1)
+		return (errno == EOPNOTSUPP ? ENOTSUP : errno);
+	return (0);
+#else
+	return (ENOTSUP);
+#endif
+}
+
 void
 vn_close(vnode_t *vp)
 {
@@ -780,6 +900,10 @@ kernel_init(int mode)
 
 	snprintf(hw_serial, sizeof (hw_serial), "%ld", gethostid());
 
+	mutex_init(&kstat_lock, NULL, MUTEX_DEFAULT, NULL);
+	list_create(&kstat_list, sizeof (ekstat_t),
+	    offsetof(ekstat_t, e_node));
+
 	spa_init(mode);
 }
 
@@ -787,6 +911,9 @@ void
 kernel_fini(void)
 {
 	spa_fini();
+
+	list_destroy(&kstat_list);
+	mutex_destroy(&kstat_lock);
 }
 
 int
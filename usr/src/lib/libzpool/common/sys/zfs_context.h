@@ -279,6 +279,7 @@ extern kstat_t *kstat_create(char *, int,
     char *, char *, uchar_t, ulong_t, uchar_t);
 extern void kstat_install(kstat_t *);
 extern void kstat_delete(kstat_t *);
+extern uint64_t kstat_named_value(char *, char *, char *);
 
 /*
  * Kernel memory
@@ -367,6 +368,7 @@ extern int vn_openat(char *path, int x1, int oflags, int mode, vnode_t **vpp,
 extern int vn_rdwr(int uio, vnode_t *vp, void *addr, ssize_t len,
     offset_t offset, int x1, int x2, rlim64_t x3, void *x4, ssize_t *residp);
 extern void vn_close(vnode_t *vp);
+extern int vn_space(vnode_t *vp, offset_t offset, offset_t len);
 
 #define	vn_remove(path, x1, x2)		remove(path)
 #define	vn_rename(from, to, seg)	rename((from), (to))
@@ -1578,6 +1578,7 @@ arc_kmem_reap_now(arc_reclaim_strategy_t strat)
 	kmem_cache_t		*prev_data_cache = NULL;
 	extern kmem_cache_t	*zio_buf_cache[];
 	extern kmem_cache_t	*zio_data_buf_cache[];
+	extern void		dbuf_cache_reap(void);
 
 #ifdef _KERNEL
 	if (arc_meta_used >= arc_meta_limit) {
@@ -1603,6 +1604,12 @@ arc_kmem_reap_now(arc_reclaim_strategy_t strat)
 	if (strat == ARC_RECLAIM_AGGR)
 		arc_shrink();
 
+	/*
+	 * Let the dbuf cache drop its ARC references down to its share of
+	 * the (possibly just reduced) target size.
+	 */
+	dbuf_cache_reap();
+
 	for (i = 0; i < SPA_MAXBLOCKSIZE >> SPA_MINBLOCKSHIFT; i++) {
 		if (zio_buf_cache[i] != prev_cache) {
 			prev_cache = zio_buf_cache[i];
@@ -2581,6 +2588,15 @@ arc_referenced(arc_buf_t *buf)
 #endif
 }
 
+/*
+ * The ARC's current target size, for caches layered on top of it.
+ */
+uint64_t
+arc_target_size(void)
+{
+	return (arc_c);
+}
+
 static void
 arc_write_ready(zio_t *zio)
 {
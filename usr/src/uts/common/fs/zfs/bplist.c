@@ -126,6 +126,22 @@ bplist_empty(bplist_t *bpl)
 	return (rv);
 }
 
+uint64_t
+bplist_count(bplist_t *bpl)
+{
+	uint64_t rv;
+
+	if (bpl->bpl_object == 0)
+		return (0);
+
+	mutex_enter(&bpl->bpl_lock);
+	VERIFY(0 == bplist_hold(bpl));
+	rv = bpl->bpl_phys->bpl_entries;
+	mutex_exit(&bpl->bpl_lock);
+
+	return (rv);
+}
+
 static int
 bplist_cache(bplist_t *bpl, uint64_t blkid)
 {
@@ -81,7 +81,84 @@ dbuf_dest(void *vdb, void *unused)
  */
 static dbuf_hash_table_t dbuf_hash_table;
 
-static uint64_t dbuf_hash_count;
+static taskq_t *dbuf_hash_taskq;
+
+/*
+ * The hash table starts at dbuf_hash_initial buckets and doubles in
+ * the background whenever it holds more than dbuf_hash_max_load dbufs
+ * per bucket.
+ */
+uint64_t dbuf_hash_initial = 1ULL << 16;
+int dbuf_hash_max_load = 2;
+
+/*
+ * When set, a write covering part of an uncached block waits for the
+ * old block to be read before it proceeds, instead of reading it in the
+ * background (see dbuf_will_dirty_range()).
+ */
+int zfs_partial_write_disable = 0;
+
+/*
+ * Hash table statistics.  Chains are buckets holding more than one
+ * dbuf; chain_max is the longest chain seen by an insert.  Grows counts
+ * the times the table doubled.  Partial_writes counts writes that
+ * dirtied part of an uncached block without waiting for it to be read,
+ * partial_waits the times anything had to wait for such a read anyway.
+ */
+typedef struct dbuf_stats {
+	kstat_named_t dbufstat_hash_elements;
+	kstat_named_t dbufstat_hash_elements_max;
+	kstat_named_t dbufstat_hash_buckets;
+	kstat_named_t dbufstat_hash_mutexes;
+	kstat_named_t dbufstat_hash_collisions;
+	kstat_named_t dbufstat_hash_chains;
+	kstat_named_t dbufstat_hash_chain_max;
+	kstat_named_t dbufstat_hash_grows;
+	kstat_named_t dbufstat_hash_grow_failures;
+	kstat_named_t dbufstat_cache_count;
+	kstat_named_t dbufstat_cache_size;
+	kstat_named_t dbufstat_cache_max_size;
+	kstat_named_t dbufstat_cache_hits;
+	kstat_named_t dbufstat_cache_evictions;
+	kstat_named_t dbufstat_partial_writes;
+	kstat_named_t dbufstat_partial_waits;
+} dbuf_stats_t;
+
+static dbuf_stats_t dbuf_stats = {
+	{ "hash_elements",		KSTAT_DATA_UINT64 },
+	{ "hash_elements_max",		KSTAT_DATA_UINT64 },
+	{ "hash_buckets",		KSTAT_DATA_UINT64 },
+	{ "hash_mutexes",		KSTAT_DATA_UINT64 },
+	{ "hash_collisions",		KSTAT_DATA_UINT64 },
+	{ "hash_chains",		KSTAT_DATA_UINT64 },
+	{ "hash_chain_max",		KSTAT_DATA_UINT64 },
+	{ "hash_grows",			KSTAT_DATA_UINT64 },
+	{ "hash_grow_failures",		KSTAT_DATA_UINT64 },
+	{ "cache_count",		KSTAT_DATA_UINT64 },
+	{ "cache_size",			KSTAT_DATA_UINT64 },
+	{ "cache_max_size",		KSTAT_DATA_UINT64 },
+	{ "cache_hits",			KSTAT_DATA_UINT64 },
+	{ "cache_evictions",		KSTAT_DATA_UINT64 },
+	{ "partial_writes",		KSTAT_DATA_UINT64 },
+	{ "partial_waits",		KSTAT_DATA_UINT64 }
+};
+
+#define	DBUFSTAT(stat)	(dbuf_stats.stat.value.ui64)
+
+#define	DBUFSTAT_INCR(stat, val) \
+	atomic_add_64(&dbuf_stats.stat.value.ui64, (val));
+
+#define	DBUFSTAT_BUMP(stat)	DBUFSTAT_INCR(stat, 1)
+#define	DBUFSTAT_BUMPDOWN(stat)	DBUFSTAT_INCR(stat, -1)
+
+#define	DBUFSTAT_MAX(stat, val) {					\
+	uint64_t m;							\
+	while ((val) > (m = dbuf_stats.stat.value.ui64) &&		\
+	    (m != atomic_cas_64(&dbuf_stats.stat.value.ui64, m, (val)))) \
+		continue;						\
+}
+
+static kstat_t *dbuf_ksp;
 
 static uint64_t
 dbuf_hash(void *os, uint64_t obj, uint8_t lvl, uint64_t blkid)
@@ -109,6 +186,96 @@ dbuf_hash(void *os, uint64_t obj, uint8_t lvl, uint64_t blkid)
 	(dbuf)->db_level == (level) &&			\
 	(dbuf)->db_blkid == (blkid))
 
+/*
+ * Return the head of hv's chain, in the grow table if its bucket has
+ * already been split.  The caller holds DBUF_HASH_MUTEX(h, hv).
+ */
+static dmu_buf_impl_t **
+dbuf_hash_bucket(dbuf_hash_table_t *h, uint64_t hv)
+{
+	uint64_t idx = hv & h->hash_table_mask;
+
+	ASSERT(MUTEX_HELD(DBUF_HASH_MUTEX(h, hv)));
+
+	if (h->hash_grow_table != NULL && idx < h->hash_grow_split)
+		return (&h->hash_grow_table[hv &
+		    (2 * h->hash_table_mask + 1)]);
+	return (&h->hash_table[idx]);
+}
+
+/*
+ * Double the hash table.  The new table is filled by splitting one
+ * bucket at a time under that bucket's mutex, so lookups elsewhere in
+ * the table are never held up; only the final switch-over takes all
+ * of the mutexes.
+ */
+/* ARGSUSED */
+static void
+dbuf_hash_grow(void *arg)
+{
+	dbuf_hash_table_t *h = &dbuf_hash_table;
+	uint64_t oldsize = h->hash_table_mask + 1;
+	uint64_t newmask = 2 * h->hash_table_mask + 1;
+	dmu_buf_impl_t **newtable, **oldtable;
+	uint64_t idx, i;
+
+	newtable = kmem_zalloc(2 * oldsize * sizeof (void *), KM_NOSLEEP);
+	if (newtable == NULL) {
+		DBUFSTAT_BUMP(dbufstat_hash_grow_failures);
+		h->hash_growing = 0;
+		return;
+	}
+
+	ASSERT(h->hash_grow_split == 0);
+	h->hash_grow_table = newtable;
+
+	for (idx = 0; idx < oldsize; idx++) {
+		kmutex_t *hmtx = DBUF_HASH_MUTEX(h, idx);
+		dmu_buf_impl_t *db, **dbp;
+		int len = 0, lo = 0, hi = 0;
+
+		mutex_enter(hmtx);
+		while ((db = h->hash_table[idx]) != NULL) {
+			uint64_t hv = DBUF_HASH(db->db_objset,
+			    db->db.db_object, db->db_level, db->db_blkid);
+
+			h->hash_table[idx] = db->db_hash_next;
+			dbp = &newtable[hv & newmask];
+			db->db_hash_next = *dbp;
+			*dbp = db;
+			len++;
+			if ((hv & newmask) == idx)
+				lo++;
+			else
+				hi++;
+		}
+		h->hash_grow_split = idx + 1;
+		mutex_exit(hmtx);
+
+		if (len > 1)
+			DBUFSTAT_BUMPDOWN(dbufstat_hash_chains);
+		if (lo > 1)
+			DBUFSTAT_BUMP(dbufstat_hash_chains);
+		if (hi > 1)
+			DBUFSTAT_BUMP(dbufstat_hash_chains);
+	}
+
+	for (i = 0; i <= h->hash_mutex_mask; i++)
+		mutex_enter(&h->hash_mutexes[i]);
+	oldtable = h->hash_table;
+	h->hash_table = newtable;
+	h->hash_table_mask = newmask;
+	h->hash_grow_table = NULL;
+	h->hash_grow_split = 0;
+	for (i = 0; i <= h->hash_mutex_mask; i++)
+		mutex_exit(&h->hash_mutexes[i]);
+
+	kmem_free(oldtable, oldsize * sizeof (void *));
+	DBUFSTAT(dbufstat_hash_buckets) = newmask + 1;
+	DBUFSTAT_BUMP(dbufstat_hash_grows);
+	h->hash_growing = 0;
+}
+
 dmu_buf_impl_t *
 dbuf_find(dnode_t *dn, uint8_t level, uint64_t blkid)
 {
@@ -116,21 +283,21 @@ dbuf_find(dnode_t *dn, uint8_t level, uint64_t blkid)
 	objset_impl_t *os = dn->dn_objset;
 	uint64_t obj = dn->dn_object;
 	uint64_t hv = DBUF_HASH(os, obj, level, blkid);
-	uint64_t idx = hv & h->hash_table_mask;
 	dmu_buf_impl_t *db;
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	for (db = h->hash_table[idx]; db != NULL; db = db->db_hash_next) {
+	mutex_enter(DBUF_HASH_MUTEX(h, hv));
+	for (db = *dbuf_hash_bucket(h, hv); db != NULL;
+	    db = db->db_hash_next) {
 		if (DBUF_EQUAL(db, os, obj, level, blkid)) {
 			mutex_enter(&db->db_mtx);
 			if (db->db_state != DB_EVICTING) {
-				mutex_exit(DBUF_HASH_MUTEX(h, idx));
+				mutex_exit(DBUF_HASH_MUTEX(h, hv));
 				return (db);
 			}
 			mutex_exit(&db->db_mtx);
 		}
 	}
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
+	mutex_exit(DBUF_HASH_MUTEX(h, hv));
 	return (NULL);
 }
 
@@ -149,15 +316,16 @@ dbuf_hash_insert(dmu_buf_impl_t *db)
 	int level = db->db_level;
 	uint64_t blkid = db->db_blkid;
 	uint64_t hv = DBUF_HASH(os, obj, level, blkid);
-	uint64_t idx = hv & h->hash_table_mask;
-	dmu_buf_impl_t *dbf;
+	dmu_buf_impl_t *dbf, **dbp;
+	int i;
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	for (dbf = h->hash_table[idx]; dbf != NULL; dbf = dbf->db_hash_next) {
+	mutex_enter(DBUF_HASH_MUTEX(h, hv));
+	dbp = dbuf_hash_bucket(h, hv);
+	for (dbf = *dbp, i = 0; dbf != NULL; dbf = dbf->db_hash_next, i++) {
 		if (DBUF_EQUAL(dbf, os, obj, level, blkid)) {
 			mutex_enter(&dbf->db_mtx);
 			if (dbf->db_state != DB_EVICTING) {
-				mutex_exit(DBUF_HASH_MUTEX(h, idx));
+				mutex_exit(DBUF_HASH_MUTEX(h, hv));
 				return (dbf);
 			}
 			mutex_exit(&dbf->db_mtx);
@@ -165,10 +333,30 @@ dbuf_hash_insert(dmu_buf_impl_t *db)
 	}
 
 	mutex_enter(&db->db_mtx);
-	db->db_hash_next = h->hash_table[idx];
-	h->hash_table[idx] = db;
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
-	atomic_add_64(&dbuf_hash_count, 1);
+	db->db_hash_next = *dbp;
+	*dbp = db;
+	mutex_exit(DBUF_HASH_MUTEX(h, hv));
+
+	if (i > 0) {
+		DBUFSTAT_BUMP(dbufstat_hash_collisions);
+		if (i == 1)
+			DBUFSTAT_BUMP(dbufstat_hash_chains);
+		DBUFSTAT_MAX(dbufstat_hash_chain_max, i + 1);
+	}
+	DBUFSTAT_BUMP(dbufstat_hash_elements);
+	DBUFSTAT_MAX(dbufstat_hash_elements_max,
+	    DBUFSTAT(dbufstat_hash_elements));
+
+	/*
+	 * Start growing the table once its chains get long on average.
+	 */
+	if (DBUFSTAT(dbufstat_hash_elements) >
+	    (h->hash_table_mask + 1) * dbuf_hash_max_load &&
+	    atomic_cas_32(&h->hash_growing, 0, 1) == 0) {
+		if (taskq_dispatch(dbuf_hash_taskq, dbuf_hash_grow, NULL,
+		    TQ_NOSLEEP) == 0)
+			h->hash_growing = 0;
+	}
 
 	return (NULL);
 }
@@ -183,8 +371,7 @@ dbuf_hash_remove(dmu_buf_impl_t *db)
 	dbuf_hash_table_t *h = &dbuf_hash_table;
 	uint64_t hv = DBUF_HASH(db->db_objset, db->db.db_object,
 	    db->db_level, db->db_blkid);
-	uint64_t idx = hv & h->hash_table_mask;
-	dmu_buf_impl_t *dbf, **dbp;
+	dmu_buf_impl_t *dbf, **dbp, **head;
 
 	/*
 	 * We musn't hold db_mtx to maintin lock ordering:
@@ -194,16 +381,137 @@ dbuf_hash_remove(dmu_buf_impl_t *db)
 	ASSERT(db->db_state == DB_EVICTING);
 	ASSERT(!MUTEX_HELD(&db->db_mtx));
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	dbp = &h->hash_table[idx];
+	mutex_enter(DBUF_HASH_MUTEX(h, hv));
+	head = dbp = dbuf_hash_bucket(h, hv);
 	while ((dbf = *dbp) != db) {
 		dbp = &dbf->db_hash_next;
 		ASSERT(dbf != NULL);
 	}
 	*dbp = db->db_hash_next;
 	db->db_hash_next = NULL;
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
-	atomic_add_64(&dbuf_hash_count, -1);
+	if (*head != NULL && (*head)->db_hash_next == NULL)
+		DBUFSTAT_BUMPDOWN(dbufstat_hash_chains);
+	mutex_exit(DBUF_HASH_MUTEX(h, hv));
+	DBUFSTAT_BUMPDOWN(dbufstat_hash_elements);
+}
+
+/*
+ * Cache of unreferenced dbufs.  When its last hold is released, a
+ * cached dbuf keeps its reference on its ARC buffer and goes on an LRU
+ * list instead of leaving the buffer to the ARC, so that the ARC can't
+ * evict it and a later hold finds it ready without going back through
+ * dbuf_create() and the ARC.  The cache is limited to 1/2^dbuf_cache_shift
+ * of the ARC's target size, so it shrinks when the ARC does; dbufs
+ * evicted from it simply drop their ARC reference.
+ */
+static kmutex_t dbuf_cache_lock;
+static list_t dbuf_cache_list;		/* most recently released first */
+static uint64_t dbuf_cache_size;	/* bytes of data on dbuf_cache_list */
+
+int dbuf_cache_shift = 5;
+
+static uint64_t
+dbuf_cache_target(void)
+{
+	uint64_t target = arc_target_size() >> dbuf_cache_shift;
+
+	DBUFSTAT(dbufstat_cache_max_size) = target;
+	return (target);
+}
+
+/*
+ * Take db off the cache if it is there, leaving it holding its ARC
+ * reference.  Returns TRUE if it was cached.
+ */
+static boolean_t
+dbuf_cache_remove(dmu_buf_impl_t *db)
+{
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+
+	if (!list_link_active(&db->db_cache_link))
+		return (B_FALSE);
+
+	mutex_enter(&dbuf_cache_lock);
+	list_remove(&dbuf_cache_list, db);
+	dbuf_cache_size -= db->db.db_size;
+	mutex_exit(&dbuf_cache_lock);
+
+	DBUFSTAT_BUMPDOWN(dbufstat_cache_count);
+	DBUFSTAT_INCR(dbufstat_cache_size, -(int64_t)db->db.db_size);
+	return (B_TRUE);
+}
+
+/*
+ * Called from dbuf_rele() when the last hold on db goes away.  Returns
+ * TRUE if db was cached, in which case it keeps its ARC reference.
+ */
+static boolean_t
+dbuf_cache_add(dmu_buf_impl_t *db)
+{
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+	ASSERT(refcount_is_zero(&db->db_holds));
+	ASSERT(db->db_blkid != DB_BONUS_BLKID);
+	ASSERT(!list_link_active(&db->db_cache_link));
+
+	if (dbuf_cache_shift <= 0 || db->db_state != DB_CACHED ||
+	    db->db.db_size > dbuf_cache_target())
+		return (B_FALSE);
+
+	mutex_enter(&dbuf_cache_lock);
+	list_insert_head(&dbuf_cache_list, db);
+	dbuf_cache_size += db->db.db_size;
+	mutex_exit(&dbuf_cache_lock);
+
+	DBUFSTAT_BUMP(dbufstat_cache_count);
+	DBUFSTAT_INCR(dbufstat_cache_size, db->db.db_size);
+	return (B_TRUE);
+}
+
+/*
+ * Evict the least recently released dbufs until the cache is no larger
+ * than target.  The lock order is db_mtx > dbuf_cache_lock, so dbufs
+ * whose db_mtx is busy (most likely because they are about to be held
+ * again) are skipped.
+ */
+static void
+dbuf_cache_evict(uint64_t target)
+{
+	dmu_buf_impl_t *db;
+
+	mutex_enter(&dbuf_cache_lock);
+	db = list_tail(&dbuf_cache_list);
+	while (db != NULL && dbuf_cache_size > target) {
+		if (!mutex_tryenter(&db->db_mtx)) {
+			db = list_prev(&dbuf_cache_list, db);
+			continue;
+		}
+		list_remove(&dbuf_cache_list, db);
+		dbuf_cache_size -= db->db.db_size;
+		mutex_exit(&dbuf_cache_lock);
+
+		ASSERT(refcount_is_zero(&db->db_holds));
+		DBUFSTAT_BUMPDOWN(dbufstat_cache_count);
+		DBUFSTAT_INCR(dbufstat_cache_size, -(int64_t)db->db.db_size);
+		DBUFSTAT_BUMP(dbufstat_cache_evictions);
+		VERIFY(arc_buf_remove_ref(db->db_buf, db) == 0);
+		mutex_exit(&db->db_mtx);
+
+		mutex_enter(&dbuf_cache_lock);
+		db = list_tail(&dbuf_cache_list);
+	}
+	mutex_exit(&dbuf_cache_lock);
+}
+
+/*
+ * Called by the ARC when it needs memory back.
+ */
+void
+dbuf_cache_reap(void)
+{
+	uint64_t target = dbuf_cache_target();
+
+	if (dbuf_cache_size > target)
+		dbuf_cache_evict(target);
 }
 
 static arc_evict_func_t dbuf_do_evict;
@@ -238,38 +546,49 @@ dbuf_evict(dmu_buf_impl_t *db)
 void
 dbuf_init(void)
 {
-	uint64_t hsize = 1ULL << 16;
+	uint64_t hsize = 1ULL << 10;
+	uint64_t nmutexes = DBUF_MUTEXES;
 	dbuf_hash_table_t *h = &dbuf_hash_table;
 	int i;
 
 	/*
-	 * The hash table is big enough to fill all of physical memory
-	 * with an average 4K block size.  The table will take up
-	 * totalmem*sizeof(void*)/4K (i.e. 2MB/GB with 8-byte pointers).
+	 * The hash table starts small and grows with the number of cached
+	 * dbufs (see dbuf_hash_grow()).  The mutexes are striped across
+	 * it, 64 per CPU, but there are never more mutexes than buckets.
 	 */
-	while (hsize * 4096 < physmem * PAGESIZE)
+	while (hsize < dbuf_hash_initial)
 		hsize <<= 1;
+	while (nmutexes < max_ncpus * 64ULL)
+		nmutexes <<= 1;
+	nmutexes = MIN(nmutexes, hsize);
 
-retry:
 	h->hash_table_mask = hsize - 1;
-#ifdef __APPLE__
 	h->hash_table = kmem_zalloc(hsize * sizeof (void *), KM_SLEEP);
-#else
-	h->hash_table = kmem_zalloc(hsize * sizeof (void *), KM_NOSLEEP);
-#endif
-	if (h->hash_table == NULL) {
-		/* XXX - we should really return an error instead of assert */
-		ASSERT(hsize > (1ULL << 10));
-		hsize >>= 1;
-		goto retry;
-	}
+	h->hash_mutex_mask = nmutexes - 1;
+	h->hash_mutexes = kmem_zalloc(nmutexes * sizeof (kmutex_t), KM_SLEEP);
+	for (i = 0; i < nmutexes; i++)
+		mutex_init(&h->hash_mutexes[i], NULL, MUTEX_DEFAULT, NULL);
+
+	dbuf_hash_taskq = taskq_create("dbuf_hash_grow", 1, minclsyspri,
+	    1, 1, 0);
 
 	dbuf_cache = kmem_cache_create("dmu_buf_impl_t",
 	    sizeof (dmu_buf_impl_t),
 	    0, dbuf_cons, dbuf_dest, NULL, NULL, NULL, 0);
 
-	for (i = 0; i < DBUF_MUTEXES; i++)
-		mutex_init(&h->hash_mutexes[i], NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&dbuf_cache_lock, NULL, MUTEX_DEFAULT, NULL);
+	list_create(&dbuf_cache_list, sizeof (dmu_buf_impl_t),
+	    offsetof(dmu_buf_impl_t, db_cache_link));
+
+	DBUFSTAT(dbufstat_hash_buckets) = hsize;
+	DBUFSTAT(dbufstat_hash_mutexes) = nmutexes;
+	dbuf_ksp = kstat_create("zfs", 0, "dbufstats", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (dbuf_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (dbuf_ksp != NULL) {
+		dbuf_ksp->ks_data = &dbuf_stats;
+		kstat_install(dbuf_ksp);
+	}
 }
 
 void
@@ -278,8 +597,23 @@ dbuf_fini(void)
 	dbuf_hash_table_t *h = &dbuf_hash_table;
 	int i;
 
-	for (i = 0; i < DBUF_MUTEXES; i++)
+	if (dbuf_ksp != NULL) {
+		kstat_delete(dbuf_ksp);
+		dbuf_ksp = NULL;
+	}
+
+	/* wait for any grow in progress */
+	taskq_destroy(dbuf_hash_taskq);
+
+	dbuf_cache_evict(0);
+	ASSERT(list_head(&dbuf_cache_list) == NULL);
+	list_destroy(&dbuf_cache_list);
+	mutex_destroy(&dbuf_cache_lock);
+
+	for (i = 0; i <= h->hash_mutex_mask; i++)
 		mutex_destroy(&h->hash_mutexes[i]);
+	kmem_free(h->hash_mutexes, (h->hash_mutex_mask + 1) *
+	    sizeof (kmutex_t));
 	kmem_free(h->hash_table, (h->hash_table_mask + 1) * sizeof (void *));
 	kmem_cache_destroy(dbuf_cache);
 }
@@ -598,9 +932,12 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 
 		mutex_enter(&db->db_mtx);
 		if ((flags & DB_RF_NEVERWAIT) == 0) {
+			if (db->db_state == DB_PARTIAL)
+				DBUFSTAT_BUMP(dbufstat_partial_waits);
 			while (db->db_state == DB_READ ||
-			    db->db_state == DB_FILL) {
-				ASSERT(db->db_state == DB_READ ||
+			    db->db_state == DB_FILL ||
+			    db->db_state == DB_PARTIAL) {
+				ASSERT(db->db_state != DB_FILL ||
 				    (flags & DB_RF_HAVESTRUCT) == 0);
 				cv_wait(&db->db_changed, &db->db_mtx);
 			}
@@ -620,7 +957,8 @@ dbuf_noread(dmu_buf_impl_t *db)
 	ASSERT(!refcount_is_zero(&db->db_holds));
 	ASSERT(db->db_blkid != DB_BONUS_BLKID);
 	mutex_enter(&db->db_mtx);
-	while (db->db_state == DB_READ || db->db_state == DB_FILL)
+	while (db->db_state == DB_READ || db->db_state == DB_FILL ||
+	    db->db_state == DB_PARTIAL)
 		cv_wait(&db->db_changed, &db->db_mtx);
 	if (db->db_state == DB_UNCACHED) {
 		arc_buf_contents_t type = DBUF_GET_BUFC_TYPE(db);
@@ -671,7 +1009,7 @@ dbuf_fix_old_data(dmu_buf_impl_t *db, uint64_t txg)
 	 * or (if there a no active holders)
 	 *	just null out the current db_data pointer.
 	 */
-	ASSERT(dr->dr_txg >= txg - 2);
+	ASSERT(dr->dr_txg >= txg - (TXG_CONCURRENT_STATES - 1));
 	if (db->db_blkid == DB_BONUS_BLKID) {
 		/* Note that the data bufs here are zio_bufs */
 		dr->dt.dl.dr_data = zio_buf_alloc(DN_MAX_BONUSLEN);
@@ -749,8 +1087,25 @@ dbuf_free_range(dnode_t *dn, uint64_t blkid, uint64_t nblks, dmu_tx_t *tx)
 			mutex_exit(&db->db_mtx);
 			continue;
 		}
-		if (db->db_state == DB_READ || db->db_state == DB_FILL) {
-			/* will be handled in dbuf_read_done or dbuf_rele */
+		if (db->db_state == DB_PARTIAL &&
+		    (db->db_last_dirty == NULL ||
+		    db->db_last_dirty->dr_txg != txg)) {
+			/*
+			 * The partial write isn't part of this txg, so the
+			 * txg it is part of still needs the old block
+			 * merged in.  Wait for that, then free the cached
+			 * block like any other.
+			 */
+			DBUFSTAT_BUMP(dbufstat_partial_waits);
+			while (db->db_state == DB_PARTIAL)
+				cv_wait(&db->db_changed, &db->db_mtx);
+		}
+		if (db->db_state == DB_READ || db->db_state == DB_FILL ||
+		    db->db_state == DB_PARTIAL) {
+			/*
+			 * will be handled in dbuf_read_done, dbuf_fill_done
+			 * or dbuf_partial_done
+			 */
 			db->db_freed_in_flight = TRUE;
 			mutex_exit(&db->db_mtx);
 			continue;
@@ -912,7 +1267,8 @@ dbuf_dirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 	 * syncing context don't bother holding ahead.
 	 */
 	ASSERT(db->db_level != 0 ||
-	    db->db_state == DB_CACHED || db->db_state == DB_FILL);
+	    db->db_state == DB_CACHED || db->db_state == DB_FILL ||
+	    db->db_state == DB_PARTIAL);
 
 	mutex_enter(&dn->dn_mtx);
 	/*
@@ -961,7 +1317,8 @@ dbuf_dirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 	    dn->dn_phys->dn_nlevels > db->db_level ||
 	    dn->dn_next_nlevels[txgoff] > db->db_level ||
 	    dn->dn_next_nlevels[(tx->tx_txg-1) & TXG_MASK] > db->db_level ||
-	    dn->dn_next_nlevels[(tx->tx_txg-2) & TXG_MASK] > db->db_level);
+	    dn->dn_next_nlevels[(tx->tx_txg-2) & TXG_MASK] > db->db_level ||
+	    dn->dn_next_nlevels[(tx->tx_txg-3) & TXG_MASK] > db->db_level);
 
 	/*
 	 * We should only be dirtying in syncing context if it's the
@@ -1057,6 +1414,9 @@ dbuf_dirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 
 	mutex_exit(&db->db_mtx);
 
+	if (!dmu_tx_is_syncing(tx))
+		dsl_pool_dirty_space(tx->tx_pool, db->db.db_size, tx);
+
 	if (db->db_blkid == DB_BONUS_BLKID) {
 		mutex_enter(&dn->dn_mtx);
 		ASSERT(!list_link_active(&dr->dr_dirty_node));
@@ -1231,6 +1591,136 @@ dbuf_will_dirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 	(void) dbuf_dirty(db, tx);
 }
 
+/*
+ * The old block of a partially written dbuf has been read: fill in the
+ * parts of db_data the writes haven't covered.
+ */
+static void
+dbuf_partial_done(zio_t *zio, arc_buf_t *buf, void *vdb)
+{
+	dmu_buf_impl_t *db = vdb;
+	uint64_t start, end, size;
+
+	mutex_enter(&db->db_mtx);
+	ASSERT3U(db->db_state, ==, DB_PARTIAL);
+	ASSERT(refcount_count(&db->db_holds) > 0);
+	ASSERT(db->db_buf != NULL);
+	/* the read was MUSTSUCCEED, as dbuf_will_dirty()'s would have been */
+	ASSERT(zio == NULL || zio->io_error == 0);
+
+	start = db->db_partial_start;
+	end = db->db_partial_end;
+	size = db->db.db_size;
+	if (db->db_freed_in_flight) {
+		/* we were freed in flight; the write's data goes too */
+		bzero(db->db.db_data, size);
+		db->db_freed_in_flight = FALSE;
+	} else {
+		bcopy(buf->b_data, db->db.db_data, start);
+		bcopy((char *)buf->b_data + end,
+		    (char *)db->db.db_data + end, size - end);
+	}
+	VERIFY(arc_buf_remove_ref(buf, db) == 1);
+	db->db_partial_start = db->db_partial_end = 0;
+	db->db_state = DB_CACHED;
+	cv_broadcast(&db->db_changed);
+	mutex_exit(&db->db_mtx);
+	dbuf_rele(db, NULL);
+}
+
+/*
+ * Like dbuf_will_dirty(), for a caller that is about to overwrite only
+ * [off, off + len) of the block.  If the block isn't cached, don't make
+ * the writer wait for it to be read: give the dbuf a fresh buffer to
+ * write into and read the old block in the background, copying it
+ * around the written range when it arrives.  Anyone who needs the
+ * whole block before then -- a reader, a write to another part of the
+ * block or in a later txg, or the sync of this one -- waits for the
+ * read like it would for any other DB_READ.
+ */
+void
+dbuf_will_dirty_range(dmu_buf_impl_t *db, uint64_t off, uint64_t len,
+    dmu_tx_t *tx)
+{
+	dnode_t *dn = db->db_dnode;
+	uint32_t aflags = ARC_NOWAIT;
+	arc_buf_contents_t type;
+	blkptr_t *bp;
+	zbookmark_t zb;
+
+	ASSERT(tx->tx_txg != 0);
+	ASSERT(!refcount_is_zero(&db->db_holds));
+	ASSERT(off + len <= db->db.db_size);
+
+	if (zfs_partial_write_disable || db->db_level != 0 ||
+	    db->db_blkid == DB_BONUS_BLKID ||
+	    db->db.db_object == DMU_META_DNODE_OBJECT ||
+	    RW_WRITE_HELD(&dn->dn_struct_rwlock)) {
+		dbuf_will_dirty(db, tx);
+		return;
+	}
+
+	rw_enter(&dn->dn_struct_rwlock, RW_READER);
+	mutex_enter(&db->db_mtx);
+
+	/*
+	 * Already partial in this txg: a write that extends the written
+	 * range keeps it contiguous, so it can go ahead as well -- unless
+	 * the block has since been freed, in which case dbuf_partial_done()
+	 * would zero the new data along with the old.
+	 */
+	if (db->db_state == DB_PARTIAL && !db->db_freed_in_flight &&
+	    db->db_last_dirty != NULL &&
+	    db->db_last_dirty->dr_txg == tx->tx_txg &&
+	    off <= db->db_partial_end && off + len >= db->db_partial_start) {
+		db->db_partial_start = MIN(db->db_partial_start, off);
+		db->db_partial_end = MAX(db->db_partial_end, off + len);
+		mutex_exit(&db->db_mtx);
+		rw_exit(&dn->dn_struct_rwlock);
+		(void) dbuf_dirty(db, tx);
+		return;
+	}
+
+	/*
+	 * Otherwise only an uncached block that really is on disk, and
+	 * isn't dirty in an earlier txg, is worth the trouble; holes and
+	 * freed blocks are "read" without any I/O anyway.
+	 */
+	bp = db->db_blkptr;
+	if (db->db_state != DB_UNCACHED || db->db_last_dirty != NULL ||
+	    bp == NULL || BP_IS_HOLE(bp) ||
+	    dnode_block_freed(dn, db->db_blkid)) {
+		mutex_exit(&db->db_mtx);
+		rw_exit(&dn->dn_struct_rwlock);
+		dbuf_will_dirty(db, tx);
+		return;
+	}
+
+	ASSERT(db->db_buf == NULL);
+	type = DBUF_GET_BUFC_TYPE(db);
+	dbuf_set_data(db, arc_buf_alloc(dn->dn_objset->os_spa,
+	    db->db.db_size, db, type));
+	db->db_partial_start = off;
+	db->db_partial_end = off + len;
+	db->db_state = DB_PARTIAL;
+	mutex_exit(&db->db_mtx);
+	DBUFSTAT_BUMP(dbufstat_partial_writes);
+
+	zb.zb_objset = db->db_objset->os_dsl_dataset ?
+	    db->db_objset->os_dsl_dataset->ds_object : 0;
+	zb.zb_object = db->db.db_object;
+	zb.zb_level = 0;
+	zb.zb_blkid = db->db_blkid;
+
+	dbuf_add_ref(db, NULL);
+	(void) arc_read(NULL, dn->dn_objset->os_spa, bp,
+	    dmu_ot[dn->dn_type].ot_byteswap, dbuf_partial_done, db,
+	    ZIO_PRIORITY_ASYNC_READ, ZIO_FLAG_MUSTSUCCEED, &aflags, &zb);
+	rw_exit(&dn->dn_struct_rwlock);
+
+	(void) dbuf_dirty(db, tx);
+}
+
 void
 dmu_buf_will_fill(dmu_buf_t *db_fake, dmu_tx_t *tx)
 {
@@ -1296,6 +1786,9 @@ dbuf_clear(dmu_buf_impl_t *db)
 	ASSERT(MUTEX_HELD(&db->db_mtx));
 	ASSERT(refcount_is_zero(&db->db_holds));
 
+	if (dbuf_cache_remove(db))
+		VERIFY(arc_buf_remove_ref(db->db_buf, db) == 0);
+
 	dbuf_evict_user(db);
 
 	if (db->db_state == DB_CACHED) {
@@ -1514,6 +2007,7 @@ dbuf_destroy(dmu_buf_impl_t *db)
 	db->db_buf = NULL;
 
 	ASSERT(!list_link_active(&db->db_link));
+	ASSERT(!list_link_active(&db->db_cache_link));
 	ASSERT(db->db.db_data == NULL);
 	ASSERT(db->db_hash_next == NULL);
 	ASSERT(db->db_blkptr == NULL);
@@ -1525,6 +2019,17 @@ dbuf_destroy(dmu_buf_impl_t *db)
 
 void
 dbuf_prefetch(dnode_t *dn, uint64_t blkid)
+{
+	dbuf_prefetch_level(dn, 0, blkid);
+}
+
+/*
+ * Start an asynchronous read of the block at the given level, so that a
+ * later dbuf_hold() finds it in the ARC.  Indirect blocks are prefetched
+ * by dmu_zfetch ahead of the data they map.
+ */
+void
+dbuf_prefetch_level(dnode_t *dn, int level, uint64_t blkid)
 {
 	dmu_buf_impl_t *db = NULL;
 	blkptr_t *bp = NULL;
@@ -1532,11 +2037,14 @@ dbuf_prefetch(dnode_t *dn, uint64_t blkid)
 	ASSERT(blkid != DB_BONUS_BLKID);
 	ASSERT(RW_LOCK_HELD(&dn->dn_struct_rwlock));
 
-	if (dnode_block_freed(dn, blkid))
+	if (level >= dn->dn_nlevels)
+		return;
+
+	if (level == 0 && dnode_block_freed(dn, blkid))
 		return;
 
 	/* dbuf_find() returns with db_mtx held */
-	if (db = dbuf_find(dn, 0, blkid)) {
+	if (db = dbuf_find(dn, level, blkid)) {
 		if (refcount_count(&db->db_holds) > 0) {
 			/*
 			 * This dbuf is active.  We assume that it is
@@ -1550,17 +2058,18 @@ dbuf_prefetch(dnode_t *dn, uint64_t blkid)
 		db = NULL;
 	}
 
-	if (dbuf_findbp(dn, 0, blkid, TRUE, &db, &bp) == 0) {
+	if (dbuf_findbp(dn, level, blkid, TRUE, &db, &bp) == 0) {
 		if (bp && !BP_IS_HOLE(bp)) {
 			uint32_t aflags = ARC_NOWAIT | ARC_PREFETCH;
 			zbookmark_t zb;
 			zb.zb_objset = dn->dn_objset->os_dsl_dataset ?
 			    dn->dn_objset->os_dsl_dataset->ds_object : 0;
 			zb.zb_object = dn->dn_object;
-			zb.zb_level = 0;
+			zb.zb_level = level;
 			zb.zb_blkid = blkid;
 
 			(void) arc_read(NULL, dn->dn_objset->os_spa, bp,
+			    level > 0 ? byteswap_uint64_array :
 			    dmu_ot[dn->dn_type].ot_byteswap,
 			    NULL, NULL, ZIO_PRIORITY_ASYNC_READ,
 			    ZIO_FLAG_CANFAIL | ZIO_FLAG_SPECULATIVE,
@@ -1611,7 +2120,12 @@ top:
 	}
 
 	if (db->db_buf && refcount_is_zero(&db->db_holds)) {
-		arc_buf_add_ref(db->db_buf, db);
+		if (dbuf_cache_remove(db)) {
+			/* it kept its ARC reference */
+			DBUFSTAT_BUMP(dbufstat_cache_hits);
+		} else {
+			arc_buf_add_ref(db->db_buf, db);
+		}
 		if (db->db_buf->b_data == NULL) {
 			dbuf_clear(db);
 			if (parent) {
@@ -1743,8 +2257,13 @@ dbuf_rele(dmu_buf_impl_t *db, void *tag)
 			VERIFY(arc_buf_remove_ref(buf, db) == 1);
 			dbuf_evict(db);
 		} else {
-			VERIFY(arc_buf_remove_ref(db->db_buf, db) == 0);
+			boolean_t cached = dbuf_cache_add(db);
+
+			if (!cached)
+				VERIFY(arc_buf_remove_ref(db->db_buf, db) == 0);
 			mutex_exit(&db->db_mtx);
+			if (cached && dbuf_cache_size > dbuf_cache_target())
+				dbuf_cache_evict(dbuf_cache_target());
 		}
 	} else {
 		mutex_exit(&db->db_mtx);
@@ -1916,6 +2435,15 @@ dbuf_sync_leaf(dbuf_dirty_record_t *dr, dmu_tx_t *tx)
 	dprintf_dbuf_bp(db, db->db_blkptr, "blkptr=%p", db->db_blkptr);
 
 	mutex_enter(&db->db_mtx);
+	/*
+	 * A partial write's old block may still be on its way in; what we
+	 * write out must include it.
+	 */
+	if (db->db_state == DB_PARTIAL) {
+		DBUFSTAT_BUMP(dbufstat_partial_waits);
+		while (db->db_state == DB_PARTIAL)
+			cv_wait(&db->db_changed, &db->db_mtx);
+	}
 	/*
 	 * To be synced, we must be dirtied.  But we
 	 * might have been freed after the dirty.
@@ -2128,7 +2656,7 @@ dbuf_write(dbuf_dirty_record_t *dr, arc_buf_t *data, int checksum,
 
 	zio_flags = ZIO_FLAG_MUSTSUCCEED;
 	if (dmu_ot[dn->dn_type].ot_metadata || zb.zb_level != 0)
-		zio_flags |= ZIO_FLAG_METADATA;
+		zio_flags |= ZIO_FLAG_METADATA | ZIO_FLAG_SPECIAL;
 	if (BP_IS_OLDER(db->db_blkptr, txg))
 		dsl_dataset_block_kill(
 		    os->os_dsl_dataset, db->db_blkptr, zio, tx);
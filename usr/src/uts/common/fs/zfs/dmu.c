@@ -244,7 +244,8 @@ dmu_buf_hold_array_by_dnode(dnode_t *dn, uint64_t offset,
 			dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
 			mutex_enter(&db->db_mtx);
 			while (db->db_state == DB_READ ||
-			    db->db_state == DB_FILL)
+			    db->db_state == DB_FILL ||
+			    db->db_state == DB_PARTIAL)
 				cv_wait(&db->db_changed, &db->db_mtx);
 			if (db->db_state == DB_UNCACHED)
 				err = EIO;
@@ -463,7 +464,8 @@ dmu_write(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
 		if (tocpy == db->db_size)
 			dmu_buf_will_fill(db, tx);
 		else
-			dmu_buf_will_dirty(db, tx);
+			dbuf_will_dirty_range((dmu_buf_impl_t *)db, bufoff,
+			    tocpy, tx);
 
 		bcopy(buf, (char *)db->db_data + bufoff, tocpy);
 
@@ -538,6 +540,7 @@ dmu_write_uio(objset_t *os, uint64_t object, uio_t *uio, uint64_t size, dmu_tx_t
 	dmu_buf_t **dbp;
 	int numbufs, i;
 	int err = 0;
+	void *tmp;
 
 	if (size == 0)
 		return (0);
@@ -568,6 +571,36 @@ dmu_write_uio(objset_t *os, uint64_t object, uio_t *uio, uint64_t size, dmu_tx_t
 
 		ASSERT(i == 0 || i == numbufs-1 || tocpy == db->db_size);
 
+		/*
+		 * A partial write to a block that isn't cached can go
+		 * ahead without waiting for the rest of the block to be
+		 * read (see dbuf_will_dirty_range()), but then the dbuf
+		 * has nothing to fall back on if the copy faults half
+		 * way.  So copy the user's data in first, and dirty the
+		 * dbuf only once we have all of it.  The peek at db_state
+		 * is unlocked; being wrong just costs the read or a bcopy.
+		 */
+		if (tocpy != db->db_size &&
+		    ((dmu_buf_impl_t *)db)->db_state != DB_CACHED) {
+			tmp = zio_buf_alloc(tocpy);
+#ifdef __APPLE__
+			err = uio_move(tmp, tocpy, UIO_WRITE, uio);
+#else
+			err = uiomove(tmp, tocpy, UIO_WRITE, uio);
+#endif
+			if (err == 0) {
+				dbuf_will_dirty_range((dmu_buf_impl_t *)db,
+				    bufoff, tocpy, tx);
+				bcopy(tmp, (char *)db->db_data + bufoff, tocpy);
+			}
+			zio_buf_free(tmp, tocpy);
+			if (err)
+				break;
+
+			size -= tocpy;
+			continue;
+		}
+
 		if (tocpy == db->db_size)
 			dmu_buf_will_fill(db, tx);
 		else
@@ -852,7 +885,7 @@ dmu_sync(zio_t *pio, dmu_buf_t *db_fake,
 	zb.zb_blkid = db->db_blkid;
 	zio_flags = ZIO_FLAG_MUSTSUCCEED;
 	if (dmu_ot[db->db_dnode->dn_type].ot_metadata || zb.zb_level != 0)
-		zio_flags |= ZIO_FLAG_METADATA;
+		zio_flags |= ZIO_FLAG_METADATA | ZIO_FLAG_SPECIAL;
 	zio = arc_write(pio, os->os_spa,
 	    zio_checksum_select(db->db_dnode->dn_checksum, os->os_checksum),
 	    zio_compress_select(db->db_dnode->dn_compress, os->os_compress),
@@ -1076,13 +1109,17 @@ dmu_init(void)
 {
 	dbuf_init();
 	dnode_init();
+	zfetch_init();
 	arc_init();
+	dsl_pool_init();
 }
 
 void
 dmu_fini(void)
 {
+	dsl_pool_fini();
 	arc_fini();
+	zfetch_fini();
 	dnode_fini();
 	dbuf_fini();
 }
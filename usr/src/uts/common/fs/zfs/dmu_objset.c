@@ -77,6 +77,18 @@ dmu_objset_ds(objset_t *os)
 	return (os->os->os_dsl_dataset);
 }
 
+int
+dmu_objset_logbias(objset_t *os)
+{
+	return (os->os->os_logbias);
+}
+
+int
+dmu_objset_syncprop(objset_t *os)
+{
+	return (os->os->os_sync);
+}
+
 dmu_objset_type_t
 dmu_objset_type(objset_t *os)
 {
@@ -137,6 +149,28 @@ copies_changed_cb(void *arg, uint64_t newval)
 	osi->os_copies = newval;
 }
 
+static void
+logbias_changed_cb(void *arg, uint64_t newval)
+{
+	objset_impl_t *osi = arg;
+
+	ASSERT(newval == ZFS_LOGBIAS_LATENCY ||
+	    newval == ZFS_LOGBIAS_THROUGHPUT);
+
+	osi->os_logbias = newval;
+}
+
+static void
+sync_changed_cb(void *arg, uint64_t newval)
+{
+	objset_impl_t *osi = arg;
+
+	ASSERT(newval == ZFS_SYNC_STANDARD || newval == ZFS_SYNC_ALWAYS ||
+	    newval == ZFS_SYNC_DISABLED);
+
+	osi->os_sync = newval;
+}
+
 void
 dmu_objset_byteswap(void *buf, size_t size)
 {
@@ -203,6 +237,12 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 		if (err == 0)
 			err = dsl_prop_register(ds, "copies",
 			    copies_changed_cb, osi);
+		if (err == 0)
+			err = dsl_prop_register(ds, "logbias",
+			    logbias_changed_cb, osi);
+		if (err == 0)
+			err = dsl_prop_register(ds, "sync",
+			    sync_changed_cb, osi);
 		if (err) {
 			VERIFY(arc_buf_remove_ref(osi->os_phys_buf,
 			    &osi->os_phys_buf) == 1);
@@ -214,6 +254,8 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 		osi->os_checksum = ZIO_CHECKSUM_FLETCHER_4;
 		osi->os_compress = ZIO_COMPRESS_LZJB;
 		osi->os_copies = spa_max_replication(spa);
+		osi->os_logbias = ZFS_LOGBIAS_LATENCY;
+		osi->os_sync = ZFS_SYNC_STANDARD;
 	}
 
 	osi->os_zil = zil_alloc(&osi->os, &osi->os_phys->os_zil_header);
@@ -370,6 +412,10 @@ dmu_objset_evict(dsl_dataset_t *ds, void *arg)
 		    compression_changed_cb, osi));
 		VERIFY(0 == dsl_prop_unregister(ds, "copies",
 		    copies_changed_cb, osi));
+		VERIFY(0 == dsl_prop_unregister(ds, "logbias",
+		    logbias_changed_cb, osi));
+		VERIFY(0 == dsl_prop_unregister(ds, "sync",
+		    sync_changed_cb, osi));
 	}
 
 	/*
@@ -717,6 +763,26 @@ out:
 	return (err);
 }
 
+/*
+ * The dirty dnodes of an objset are split into at most
+ * zfs_sync_taskq_threads sublists of at least zfs_sync_dnodes_per_task
+ * dnodes each, which are synced in parallel on the pool's dp_sync_taskq.
+ */
+extern int zfs_sync_taskq_threads;
+int zfs_sync_dnodes_per_task = 32;
+
+typedef struct sync_objset_arg {
+	objset_impl_t	*soa_os;
+	zio_t		*soa_zio;
+	dmu_tx_t	*soa_tx;
+	uint64_t	soa_refcnt;	/* outstanding tasks, plus caller */
+} sync_objset_arg_t;
+
+typedef struct sync_dnodes_arg {
+	list_t			sda_list;
+	sync_objset_arg_t	*sda_soa;
+} sync_dnodes_arg_t;
+
 static void
 dmu_objset_sync_dnodes(list_t *list, dmu_tx_t *tx)
 {
@@ -738,6 +804,52 @@ dmu_objset_sync_dnodes(list_t *list, dmu_tx_t *tx)
 	}
 }
 
+/*
+ * Called once all of the objset's dnodes have been synced: write out the
+ * meta-dnode's blocks and then the root block itself.
+ */
+static void
+dmu_objset_sync_done(sync_objset_arg_t *soa)
+{
+	objset_impl_t *os = soa->soa_os;
+	dmu_tx_t *tx = soa->soa_tx;
+	dbuf_dirty_record_t *dr;
+	list_t *list;
+
+	list = &os->os_meta_dnode->dn_dirty_records[tx->tx_txg & TXG_MASK];
+	while (dr = list_head(list)) {
+		ASSERT(dr->dr_dbuf->db_level == 0);
+		list_remove(list, dr);
+		if (dr->dr_zio)
+			zio_nowait(dr->dr_zio);
+	}
+	/*
+	 * Free intent log blocks up to this tx.
+	 */
+	zil_sync(os->os_zil, tx);
+	zio_nowait(soa->soa_zio);
+	kmem_free(soa, sizeof (sync_objset_arg_t));
+}
+
+static void
+dmu_objset_sync_rele(sync_objset_arg_t *soa)
+{
+	if (atomic_add_64_nv(&soa->soa_refcnt, -1) == 0)
+		dmu_objset_sync_done(soa);
+}
+
+static void
+dmu_objset_sync_dnodes_task(void *arg)
+{
+	sync_dnodes_arg_t *sda = arg;
+	sync_objset_arg_t *soa = sda->sda_soa;
+
+	dmu_objset_sync_dnodes(&sda->sda_list, soa->soa_tx);
+	list_destroy(&sda->sda_list);
+	kmem_free(sda, sizeof (sync_dnodes_arg_t));
+	dmu_objset_sync_rele(soa);
+}
+
 /* ARGSUSED */
 static void
 ready(zio_t *zio, arc_buf_t *abuf, void *arg)
@@ -777,15 +889,22 @@ killer(zio_t *zio, arc_buf_t *abuf, void *arg)
 	arc_release(os->os_phys_buf, &os->os_phys_buf);
 }
 
-/* called from dsl */
+/*
+ * Called from dsl.  The dirty dnodes, and then the root block, are
+ * written asynchronously on the pool's dp_sync_taskq; the caller must
+ * taskq_wait() for it before waiting on pio.
+ */
 void
 dmu_objset_sync(objset_impl_t *os, zio_t *pio, dmu_tx_t *tx)
 {
 	int txgoff;
 	zbookmark_t zb;
 	zio_t *zio;
-	list_t *list;
-	dbuf_dirty_record_t *dr;
+	list_t *list, dirty;
+	dnode_t *dn;
+	sync_objset_arg_t *soa;
+	sync_dnodes_arg_t *sda;
+	uint64_t count, pertask;
 
 	dprintf_ds(os->os_dsl_dataset, "txg=%llu\n", tx->tx_txg);
 
@@ -817,8 +936,8 @@ dmu_objset_sync(objset_impl_t *os, zio_t *pio, dmu_tx_t *tx)
 	    os->os_md_compress,
 	    dmu_get_replication_level(os, &zb, DMU_OT_OBJSET),
 	    tx->tx_txg, os->os_rootbp, os->os_phys_buf, ready, killer, os,
-	    ZIO_PRIORITY_ASYNC_WRITE, ZIO_FLAG_MUSTSUCCEED | ZIO_FLAG_METADATA,
-	    &zb);
+	    ZIO_PRIORITY_ASYNC_WRITE,
+	    ZIO_FLAG_MUSTSUCCEED | ZIO_FLAG_METADATA | ZIO_FLAG_SPECIAL, &zb);
 
 	/*
 	 * Sync meta-dnode - the parent IO for the sync is the root block
@@ -828,21 +947,56 @@ dmu_objset_sync(objset_impl_t *os, zio_t *pio, dmu_tx_t *tx)
 
 	txgoff = tx->tx_txg & TXG_MASK;
 
+	/*
+	 * Freed dnodes are synced here; freeing modifies objset-wide
+	 * state and is comparatively rare.
+	 */
 	dmu_objset_sync_dnodes(&os->os_free_dnodes[txgoff], tx);
-	dmu_objset_sync_dnodes(&os->os_dirty_dnodes[txgoff], tx);
 
-	list = &os->os_meta_dnode->dn_dirty_records[txgoff];
-	while (dr = list_head(list)) {
-		ASSERT(dr->dr_dbuf->db_level == 0);
-		list_remove(list, dr);
-		if (dr->dr_zio)
-			zio_nowait(dr->dr_zio);
-	}
+	soa = kmem_alloc(sizeof (sync_objset_arg_t), KM_SLEEP);
+	soa->soa_os = os;
+	soa->soa_zio = zio;
+	soa->soa_tx = tx;
+	soa->soa_refcnt = 1;
+
 	/*
-	 * Free intent log blocks up to this tx.
+	 * Take the dirty list private so that the tasks never share it.
 	 */
-	zil_sync(os->os_zil, tx);
-	zio_nowait(zio);
+	list = &dirty;
+	list_create(list, sizeof (dnode_t),
+	    offsetof(dnode_t, dn_dirty_link[txgoff]));
+	mutex_enter(&os->os_lock);
+	list_move_tail(list, &os->os_dirty_dnodes[txgoff]);
+	mutex_exit(&os->os_lock);
+
+	count = 0;
+	for (dn = list_head(list); dn; dn = list_next(list, dn))
+		count++;
+	pertask = MAX(zfs_sync_dnodes_per_task,
+	    (count + zfs_sync_taskq_threads - 1) / zfs_sync_taskq_threads);
+	pertask = MAX(pertask, 1);
+
+	/*
+	 * Hand the dirty dnodes out in sublists.  The last task to finish
+	 * (or dmu_objset_sync_rele() below, if there are none) issues the
+	 * root block write.
+	 */
+	while (list_head(list) != NULL) {
+		sda = kmem_alloc(sizeof (sync_dnodes_arg_t), KM_SLEEP);
+		list_create(&sda->sda_list, sizeof (dnode_t),
+		    offsetof(dnode_t, dn_dirty_link[txgoff]));
+		sda->sda_soa = soa;
+		for (count = 0; count < pertask &&
+		    (dn = list_head(list)) != NULL; count++) {
+			list_remove(list, dn);
+			list_insert_tail(&sda->sda_list, dn);
+		}
+		atomic_add_64(&soa->soa_refcnt, 1);
+		(void) taskq_dispatch(tx->tx_pool->dp_sync_taskq,
+		    dmu_objset_sync_dnodes_task, sda, TQ_SLEEP);
+	}
+	list_destroy(list);
+	dmu_objset_sync_rele(soa);
 }
 
 void
@@ -587,6 +587,10 @@ restore_object(struct restorearg *ra, objset_t *os, struct drr_object *drro)
 		return (EINVAL);
 	}
 
+	/* a stream of large blocks needs a pool that can hold them */
+	if (drro->drr_blksz > spa_maxblocksize(dmu_objset_spa(os)))
+		return (ENOTSUP);
+
 	tx = dmu_tx_create(os);
 
 	if (err == ENOENT) {
@@ -693,6 +697,7 @@ restore_write(struct restorearg *ra, objset_t *os,
 	int err;
 
 	if (drrw->drr_offset + drrw->drr_length < drrw->drr_offset ||
+	    drrw->drr_length > SPA_MAXBLOCKSIZE ||
 	    drrw->drr_type >= DMU_OT_NUMTYPES)
 		return (EINVAL);
 
@@ -763,7 +768,8 @@ dmu_recvbackup(char *tosnap, struct drr_begin *drrb, uint64_t *sizep,
 	bzero(&ra, sizeof (ra));
 	ra.vp = vp;
 	ra.voff = voffset;
-	ra.bufsize = 1<<20;
+	/* room for a whole write record of the largest block, and then some */
+	ra.bufsize = 2 * SPA_MAXBLOCKSIZE;
 	ra.buf = kmem_alloc(ra.bufsize, KM_SLEEP);
 
 	if (drrb->drr_magic == DMU_BACKUP_MAGIC) {
@@ -586,6 +586,15 @@ traverse_segment(traverse_handle_t *th, zseg_t *zseg, blkptr_t *mosbp)
 
 		dsp = DN_BONUS(dn_tmp);
 
+		/*
+		 * A dataset whose blocks are being freed in the background
+		 * is only partially there; leave it to the free queue.
+		 */
+		if ((dsp->ds_flags & DS_FLAG_DESTROYING) &&
+		    !(th->th_advance & ADVANCE_DESTROYED))
+			return (advance_objset(zseg, zb->zb_objset + 1,
+			    th->th_advance));
+
 		bc = &th->th_cache[ZB_MDN_CACHE][ZB_MAXLEVEL - 1];
 		dn = &((objset_phys_t *)bc->bc_data)->os_meta_dnode;
 
@@ -831,6 +840,34 @@ traverse_add_pool(traverse_handle_t *th, uint64_t mintxg, uint64_t maxtxg)
 		    0, 0, -1, 0);
 }
 
+/*
+ * Continue a post-order traversal of an objset from bookmark zb, as left
+ * by an earlier traverse_more() of the same objset.
+ */
+void
+traverse_resume_objset(traverse_handle_t *th, uint64_t mintxg, uint64_t maxtxg,
+    const zbookmark_t *zb)
+{
+	ASSERT(!(th->th_advance & ADVANCE_PRE));
+
+	traverse_add_segment(th, mintxg, maxtxg,
+	    zb->zb_objset, zb->zb_object, zb->zb_level, zb->zb_blkid,
+	    zb->zb_objset, 0, -1, 0);
+}
+
+/*
+ * Only the level-0 blocks of ordinary objects can be large.  Everything
+ * else a cache entry holds is an indirect block, a dnode block or an
+ * objset, none of which is ever bigger than SPA_OLD_MAXBLOCKSIZE.
+ */
+static uint64_t
+traverse_cache_size(int depth, int level)
+{
+	if (depth == ZB_DN_CACHE && level == 0)
+		return (SPA_MAXBLOCKSIZE);
+	return (SPA_OLD_MAXBLOCKSIZE);
+}
+
 traverse_handle_t *
 traverse_init(spa_t *spa, blkptr_cb_t func, void *arg, int advance,
     int zio_flags)
@@ -856,7 +893,7 @@ traverse_init(spa_t *spa, blkptr_cb_t func, void *arg, int advance,
 			if ((advance & ADVANCE_DATA) ||
 			    l != 0 || d != ZB_DN_CACHE)
 				th->th_cache[d][l].bc_data =
-				    zio_buf_alloc(SPA_MAXBLOCKSIZE);
+				    zio_buf_alloc(traverse_cache_size(d, l));
 		}
 	}
 
@@ -873,7 +910,7 @@ traverse_fini(traverse_handle_t *th)
 		for (l = 0; l < ZB_MAXLEVEL; l++)
 			if (th->th_cache[d][l].bc_data != NULL)
 				zio_buf_free(th->th_cache[d][l].bc_data,
-				    SPA_MAXBLOCKSIZE);
+				    traverse_cache_size(d, l));
 
 	while ((zseg = list_head(&th->th_seglist)) != NULL) {
 		list_remove(&th->th_seglist, zseg);
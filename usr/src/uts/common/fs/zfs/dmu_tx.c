@@ -175,7 +175,7 @@ dmu_tx_count_write(dmu_tx_hold_t *txh, uint64_t off, uint64_t len)
 		return;
 
 	min_bs = SPA_MINBLOCKSHIFT;
-	max_bs = SPA_MAXBLOCKSHIFT;
+	max_bs = highbit(spa_maxblocksize(txh->txh_tx->tx_pool->dp_spa)) - 1;
 	min_ibs = DN_MIN_INDBLKSHIFT;
 	max_ibs = DN_MAX_INDBLKSHIFT;
 
@@ -551,9 +551,9 @@ dmu_tx_hold_zap(dmu_tx_t *tx, uint64_t object, int add, char *name)
 		 */
 		if (dsl_dataset_block_freeable(dn->dn_objset->os_dsl_dataset,
 		    dn->dn_phys->dn_blkptr[0].blk_birth))
-			txh->txh_space_tooverwrite += SPA_MAXBLOCKSIZE;
+			txh->txh_space_tooverwrite += SPA_OLD_MAXBLOCKSIZE;
 		else
-			txh->txh_space_towrite += SPA_MAXBLOCKSIZE;
+			txh->txh_space_towrite += SPA_OLD_MAXBLOCKSIZE;
 		return;
 	}
 
@@ -739,6 +739,17 @@ dmu_tx_try_assign(dmu_tx_t *tx, uint64_t txg_how)
 	if (tx->tx_err)
 		return (tx->tx_err);
 
+	/*
+	 * If the pool is holding too much dirty data, have dmu_tx_wait()
+	 * delay us before we hold the open txg.  Each tx is delayed at most
+	 * once; callers that retry with a new tx pass TXG_WAITED.
+	 */
+	if (!tx->tx_dirty_delayed && txg_how != TXG_WAITED &&
+	    txg_how < TXG_INITIAL && dsl_pool_need_dirty_delay(tx->tx_pool)) {
+		tx->tx_wait_dirty = B_TRUE;
+		return (ERESTART);
+	}
+
 	tx->tx_txg = txg_hold_open(tx->tx_pool, &tx->tx_txgh);
 	tx->tx_needassign_txh = NULL;
 
@@ -855,9 +866,16 @@ dmu_tx_unassign(dmu_tx_t *tx)
  *	whenever you're holding locks.  On an ERESTART error, the caller
  *	should drop locks, do a dmu_tx_wait(tx), and try again.
  *
- * (3)	A specific txg.  Use this if you need to ensure that multiple
+ * (3)	TXG_WAITED.  Like TXG_NOWAIT, but the caller has already done a
+ *	dmu_tx_wait() for this operation, so the write throttle does not
+ *	delay it again.
+ *
+ * (4)	A specific txg.  Use this if you need to ensure that multiple
  *	transactions all sync in the same txg.  Like TXG_NOWAIT, it
  *	returns ERESTART if it can't assign you into the requested txg.
+ *
+ * Unless a specific txg is requested, the write throttle may delay the
+ * tx while the pool has too much dirty data (see dsl_pool.c).
  */
 int
 dmu_tx_assign(dmu_tx_t *tx, uint64_t txg_how)
@@ -886,6 +904,14 @@ void
 dmu_tx_wait(dmu_tx_t *tx)
 {
 	ASSERT(tx->tx_txg == 0);
+
+	if (tx->tx_wait_dirty) {
+		dsl_pool_dirty_delay(tx->tx_pool);
+		tx->tx_wait_dirty = B_FALSE;
+		tx->tx_dirty_delayed = B_TRUE;
+		return;
+	}
+
 	ASSERT(tx->tx_lasttried_txg != 0);
 
 	if (tx->tx_needassign_txh) {
@@ -45,19 +45,113 @@ uint32_t	zfetch_max_streams = 8;
 uint32_t	zfetch_min_sec_reap = 2;
 /* max number of blocks to fetch at a time */
 uint32_t	zfetch_block_cap = 256;
+/* max number of bytes a stream may prefetch ahead of the reader (8Mb) */
+uint64_t	zfetch_max_distance = 8 * 1024 * 1024;
+/* bytes of data mapped by indirect blocks prefetched ahead (64Mb) */
+uint64_t	zfetch_max_idistance = 64 * 1024 * 1024;
 /* number of bytes in a array_read at which we stop prefetching (1Mb) */
 uint64_t	zfetch_array_rd_sz = 1024 * 1024;
 
+/*
+ * Prefetch statistics.  A hit is a read that matched an existing stream,
+ * a miss one that did not.  Ramp-downs count streams whose distance was
+ * halved because the blocks they prefetched were gone before they were
+ * read; resets count streams dropped for the same reason once their
+ * distance could shrink no further.
+ */
+typedef struct zfetch_stats {
+	kstat_named_t zfetchstat_hits;
+	kstat_named_t zfetchstat_misses;
+	kstat_named_t zfetchstat_colinear_hits;
+	kstat_named_t zfetchstat_colinear_misses;
+	kstat_named_t zfetchstat_stride_hits;
+	kstat_named_t zfetchstat_reclaim_successes;
+	kstat_named_t zfetchstat_reclaim_failures;
+	kstat_named_t zfetchstat_streams_resets;
+	kstat_named_t zfetchstat_streams_ramp_ups;
+	kstat_named_t zfetchstat_streams_ramp_downs;
+	kstat_named_t zfetchstat_blocks_issued;
+	kstat_named_t zfetchstat_indirects_issued;
+} zfetch_stats_t;
+
+static zfetch_stats_t zfetch_stats = {
+	{ "hits",			KSTAT_DATA_UINT64 },
+	{ "misses",			KSTAT_DATA_UINT64 },
+	{ "colinear_hits",		KSTAT_DATA_UINT64 },
+	{ "colinear_misses",		KSTAT_DATA_UINT64 },
+	{ "stride_hits",		KSTAT_DATA_UINT64 },
+	{ "reclaim_successes",		KSTAT_DATA_UINT64 },
+	{ "reclaim_failures",		KSTAT_DATA_UINT64 },
+	{ "streams_resets",		KSTAT_DATA_UINT64 },
+	{ "streams_ramp_ups",		KSTAT_DATA_UINT64 },
+	{ "streams_ramp_downs",		KSTAT_DATA_UINT64 },
+	{ "blocks_issued",		KSTAT_DATA_UINT64 },
+	{ "indirects_issued",		KSTAT_DATA_UINT64 }
+};
+
+#define	ZFETCHSTAT_INCR(stat, val) \
+	atomic_add_64(&zfetch_stats.stat.value.ui64, (val));
+
+#define	ZFETCHSTAT_BUMP(stat)	ZFETCHSTAT_INCR(stat, 1)
+
+static kstat_t *zfetch_ksp;
+
+/*
+ * The prefetch a stream update decided on.  dmu_zfetch_dofetch() fills
+ * this in and advances the stream under zst_lock; the blocks are read
+ * by dmu_zfetch_issue() once the zfetch locks have been dropped, so
+ * that concurrent readers of the same file never wait on prefetch I/O
+ * setup.
+ */
+typedef struct zfetch_issue {
+	uint64_t	zi_offset;	/* stream start, in blocks */
+	uint64_t	zi_len;		/* blocks per stride */
+	uint64_t	zi_stride;	/* length of stride, in blocks */
+	zfetch_dirn_t	zi_direction;	/* direction of prefetch */
+	uint64_t	zi_tail;	/* first stride to prefetch */
+	uint64_t	zi_limit;	/* end of the prefetch window */
+	uint64_t	zi_iblkid;	/* first level-1 block to prefetch */
+	uint64_t	zi_icount;	/* number of level-1 blocks */
+	int		zi_valid;	/* anything to issue at all */
+} zfetch_issue_t;
+
 /* forward decls for static routines */
-static int		dmu_zfetch_colinear(zfetch_t *, zstream_t *);
-static void		dmu_zfetch_dofetch(zfetch_t *, zstream_t *);
+static int		dmu_zfetch_colinear(zfetch_t *, zstream_t *,
+    zfetch_issue_t *);
+static void		dmu_zfetch_dofetch(zfetch_t *, zstream_t *, int,
+    zfetch_issue_t *);
 static uint64_t		dmu_zfetch_fetch(dnode_t *, uint64_t, uint64_t);
 static uint64_t		dmu_zfetch_fetchsz(dnode_t *, uint64_t, uint64_t);
-static int		dmu_zfetch_find(zfetch_t *, zstream_t *, int);
+static int		dmu_zfetch_find(zfetch_t *, zstream_t *, int,
+    zfetch_issue_t *);
+static void		dmu_zfetch_issue(dnode_t *, zfetch_issue_t *);
+static uint64_t		dmu_zfetch_max_cap(dnode_t *);
 static int		dmu_zfetch_stream_insert(zfetch_t *, zstream_t *);
 static zstream_t	*dmu_zfetch_stream_reclaim(zfetch_t *);
 static void		dmu_zfetch_stream_remove(zfetch_t *, zstream_t *);
 static int		dmu_zfetch_streams_equal(zstream_t *, zstream_t *);
+static uint64_t		dmu_zfetch_walk(dnode_t *, zfetch_issue_t *, int);
+
+void
+zfetch_init(void)
+{
+	zfetch_ksp = kstat_create("zfs", 0, "zfetchstats", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (zfetch_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (zfetch_ksp != NULL) {
+		zfetch_ksp->ks_data = &zfetch_stats;
+		kstat_install(zfetch_ksp);
+	}
+}
+
+void
+zfetch_fini(void)
+{
+	if (zfetch_ksp != NULL) {
+		kstat_delete(zfetch_ksp);
+		zfetch_ksp = NULL;
+	}
+}
 
 /*
  * Given a zfetch structure and a zstream structure, determine whether the
@@ -73,7 +167,7 @@ static int		dmu_zfetch_streams_equal(zstream_t *, zstream_t *);
  * If no co-linear streams are found, return NULL.
  */
 static int
-dmu_zfetch_colinear(zfetch_t *zf, zstream_t *zh)
+dmu_zfetch_colinear(zfetch_t *zf, zstream_t *zh, zfetch_issue_t *zi)
 {
 	zstream_t	*z_walk;
 	zstream_t	*z_comp;
@@ -109,9 +203,10 @@ dmu_zfetch_colinear(zfetch_t *zf, zstream_t *zh)
 				mutex_destroy(&z_comp->zst_lock);
 				kmem_free(z_comp, sizeof (zstream_t));
 
-				dmu_zfetch_dofetch(zf, z_walk);
+				dmu_zfetch_dofetch(zf, z_walk, 1, zi);
 
 				rw_exit(&zf->zf_rwlock);
+				ZFETCHSTAT_BUMP(zfetchstat_colinear_hits);
 				return (1);
 			}
 
@@ -127,72 +222,162 @@ dmu_zfetch_colinear(zfetch_t *zf, zstream_t *zh)
 				mutex_destroy(&z_comp->zst_lock);
 				kmem_free(z_comp, sizeof (zstream_t));
 
-				dmu_zfetch_dofetch(zf, z_walk);
+				dmu_zfetch_dofetch(zf, z_walk, 1, zi);
 
 				rw_exit(&zf->zf_rwlock);
+				ZFETCHSTAT_BUMP(zfetchstat_colinear_hits);
 				return (1);
 			}
 		}
 	}
 
 	rw_exit(&zf->zf_rwlock);
+	ZFETCHSTAT_BUMP(zfetchstat_colinear_misses);
 	return (0);
 }
 
 /*
- * Given a zstream_t, determine the bounds of the prefetch.  Then call the
- * routine that actually prefetches the individual blocks.
+ * The furthest, in blocks, that a stream may run ahead of its reader:
+ * zfetch_block_cap, further limited to zfetch_max_distance bytes so that
+ * large-block files don't pin far more of the ARC than small-block ones.
+ */
+static uint64_t
+dmu_zfetch_max_cap(dnode_t *dn)
+{
+	uint64_t	cap;
+
+	cap = zfetch_max_distance >> dn->dn_datablkshift;
+	return (MAX(MIN(cap, zfetch_block_cap), 1));
+}
+
+/*
+ * Given a zstream_t, determine the bounds of the prefetch and advance the
+ * stream past them.  The blocks themselves are read by dmu_zfetch_issue()
+ * after the caller drops its locks.  If ramp is set, the last prefetch
+ * paid off, so let the stream run further ahead.
  */
 static void
-dmu_zfetch_dofetch(zfetch_t *zf, zstream_t *zs)
+dmu_zfetch_dofetch(zfetch_t *zf, zstream_t *zs, int ramp,
+    zfetch_issue_t *zi)
 {
-	uint64_t	prefetch_tail;
-	uint64_t	prefetch_limit;
-	uint64_t	prefetch_ofst;
-	uint64_t	prefetch_len;
-	uint64_t	blocks_fetched;
+	dnode_t		*dn = zf->zf_dnode;
+	uint64_t	maxcap;
 
 	zs->zst_stride = MAX((int64_t)zs->zst_stride, zs->zst_len);
-	zs->zst_cap = MIN(zfetch_block_cap, 2 * zs->zst_cap);
+	maxcap = MAX(dmu_zfetch_max_cap(dn), zs->zst_len);
+	if (ramp && zs->zst_cap < maxcap) {
+		zs->zst_cap = MIN(maxcap, 2 * zs->zst_cap);
+		ZFETCHSTAT_BUMP(zfetchstat_streams_ramp_ups);
+	}
 
-	prefetch_tail = MAX((int64_t)zs->zst_ph_offset,
+	zi->zi_offset = zs->zst_offset;
+	zi->zi_len = zs->zst_len;
+	zi->zi_stride = zs->zst_stride;
+	zi->zi_direction = zs->zst_direction;
+	zi->zi_tail = MAX((int64_t)zs->zst_ph_offset,
 	    (int64_t)(zs->zst_offset + zs->zst_stride));
 	/*
 	 * XXX: use a faster division method?
 	 */
-	prefetch_limit = zs->zst_offset + zs->zst_len +
+	zi->zi_limit = zs->zst_offset + zs->zst_len +
 	    (zs->zst_cap * zs->zst_stride) / zs->zst_len;
+	zi->zi_icount = 0;
+	zi->zi_valid = 1;
 
-	while (prefetch_tail < prefetch_limit) {
-		prefetch_ofst = zs->zst_offset + zs->zst_direction *
-		    (prefetch_tail - zs->zst_offset);
+	/* only sizes the prefetch; nothing is read while we hold zst_lock */
+	zs->zst_ph_offset = dmu_zfetch_walk(dn, zi, 0);
+	zs->zst_last = lbolt;
 
-		prefetch_len = zs->zst_len;
+	/*
+	 * Keep the level-1 indirect blocks mapping the next
+	 * zfetch_max_idistance bytes of a forward stream in flight too, so
+	 * that the data prefetch never stalls on a synchronous indirect read
+	 * in dbuf_findbp().
+	 */
+	if (zs->zst_direction == ZFETCH_FORWARD && dn->dn_nlevels > 1 &&
+	    zfetch_max_idistance != 0) {
+		int		epbs = dn->dn_indblkshift - SPA_BLKPTRSHIFT;
+		uint64_t	first, last;
+
+		first = MAX(zs->zst_ipf_blkid, zi->zi_tail >> epbs);
+		last = MIN(zs->zst_ph_offset +
+		    (zfetch_max_idistance >> dn->dn_datablkshift),
+		    dn->dn_maxblkid) >> epbs;
+		if (first <= last) {
+			zi->zi_iblkid = first;
+			zi->zi_icount = last - first + 1;
+			zs->zst_ipf_blkid = last + 1;
+		}
+	}
+}
+
+/*
+ * Walk the strides of a prefetch decided by dmu_zfetch_dofetch(),
+ * returning the new prefetch offset for the stream.  If issue is set,
+ * actually prefetch the blocks; otherwise just compute how far the walk
+ * would get.
+ */
+static uint64_t
+dmu_zfetch_walk(dnode_t *dn, zfetch_issue_t *zi, int issue)
+{
+	uint64_t	prefetch_tail;
+	uint64_t	prefetch_ofst;
+	uint64_t	prefetch_len;
+	uint64_t	blocks_fetched;
+
+	prefetch_tail = zi->zi_tail;
+	while (prefetch_tail < zi->zi_limit) {
+		prefetch_ofst = zi->zi_offset + zi->zi_direction *
+		    (prefetch_tail - zi->zi_offset);
+
+		prefetch_len = zi->zi_len;
 
 		/*
 		 * Don't prefetch beyond the end of the file, if working
 		 * backwards.
 		 */
-		if ((zs->zst_direction == ZFETCH_BACKWARD) &&
+		if ((zi->zi_direction == ZFETCH_BACKWARD) &&
 		    (prefetch_ofst > prefetch_tail)) {
 			prefetch_len += prefetch_ofst;
 			prefetch_ofst = 0;
 		}
 
 		/* don't prefetch more than we're supposed to */
-		if (prefetch_len > zs->zst_len)
+		if (prefetch_len > zi->zi_len)
 			break;
 
-		blocks_fetched = dmu_zfetch_fetch(zf->zf_dnode,
-		    prefetch_ofst, zs->zst_len);
+		if (issue) {
+			blocks_fetched = dmu_zfetch_fetch(dn,
+			    prefetch_ofst, zi->zi_len);
+		} else {
+			blocks_fetched = dmu_zfetch_fetchsz(dn,
+			    prefetch_ofst, zi->zi_len);
+		}
 
-		prefetch_tail += zs->zst_stride;
+		prefetch_tail += zi->zi_stride;
 		/* stop if we've run out of stuff to prefetch */
-		if (blocks_fetched < zs->zst_len)
+		if (blocks_fetched < zi->zi_len)
 			break;
 	}
-	zs->zst_ph_offset = prefetch_tail;
-	zs->zst_last = lbolt;
+	return (prefetch_tail);
+}
+
+/*
+ * Read the indirect and data blocks of a prefetch decided under the zfetch
+ * locks.  The caller still holds dn_struct_rwlock, which keeps the dnode's
+ * block tree stable; only the zfetch locks have been dropped.
+ */
+static void
+dmu_zfetch_issue(dnode_t *dn, zfetch_issue_t *zi)
+{
+	uint64_t	i;
+
+	for (i = 0; i < zi->zi_icount; i++)
+		dbuf_prefetch_level(dn, 1, zi->zi_iblkid + i);
+	if (zi->zi_icount != 0)
+		ZFETCHSTAT_INCR(zfetchstat_indirects_issued, zi->zi_icount);
+
+	(void) dmu_zfetch_walk(dn, zi, 1);
 }
 
 /*
@@ -232,6 +417,7 @@ dmu_zfetch_fetch(dnode_t *dn, uint64_t blkid, uint64_t nblks)
 	for (i = 0; i < fetchsz; i++) {
 		dbuf_prefetch(dn, blkid + i);
 	}
+	ZFETCHSTAT_INCR(zfetchstat_blocks_issued, fetchsz);
 
 	return (fetchsz);
 }
@@ -266,15 +452,24 @@ dmu_zfetch_fetchsz(dnode_t *dn, uint64_t blkid, uint64_t nblks)
 
 /*
  * given a zfetch and a zsearch structure, see if there is an associated zstream
- * for this block read.  If so, it starts a prefetch for the stream it
- * located and returns true, otherwise it returns false
+ * for this block read.  If so, it sets up a prefetch for the stream it
+ * located in zi and returns true, otherwise it returns false
+ *
+ * A read that was not already cached means the stream's last prefetch went
+ * to waste, either because it was evicted before use or because the reader
+ * has passed it.  In the first case the stream is running too far ahead and
+ * its distance is halved; once the distance is at its minimum the stream is
+ * dropped, as before.  In the second case, and on every cached read, the
+ * distance is allowed to grow again.
  */
 static int
-dmu_zfetch_find(zfetch_t *zf, zstream_t *zh, int prefetched)
+dmu_zfetch_find(zfetch_t *zf, zstream_t *zh, int prefetched,
+    zfetch_issue_t *zi)
 {
 	zstream_t	*zs;
 	int64_t		diff;
 	int		reset = !prefetched;
+	int		ramp;
 	int		rc = 0;
 
 	if (zh == NULL)
@@ -308,6 +503,7 @@ top:
 		    zh->zst_offset < zs->zst_offset + zs->zst_len) {
 			/* already fetched */
 			rc = 1;
+			ZFETCHSTAT_BUMP(zfetchstat_hits);
 			goto out;
 		}
 
@@ -383,6 +579,7 @@ top:
 
 			zs->zst_offset += zs->zst_stride;
 			zs->zst_direction = ZFETCH_FORWARD;
+			ZFETCHSTAT_BUMP(zfetchstat_stride_hits);
 
 			break;
 
@@ -404,16 +601,34 @@ top:
 			    (2 * zs->zst_stride)) ?
 			    (zs->zst_ph_offset - (2 * zs->zst_stride)) : 0;
 			zs->zst_direction = ZFETCH_BACKWARD;
+			ZFETCHSTAT_BUMP(zfetchstat_stride_hits);
 
 			break;
 		}
 	}
 
 	if (zs) {
+		/*
+		 * A miss inside the range we already prefetched means the
+		 * blocks were evicted before they were read: back off.  A
+		 * miss beyond it means the reader outran us: keep going.
+		 */
+		ramp = !reset;
+		if (reset && zs->zst_direction == ZFETCH_FORWARD &&
+		    zh->zst_offset >= zs->zst_ph_offset) {
+			reset = 0;
+			ramp = 1;
+		} else if (reset && zs->zst_cap > zs->zst_len) {
+			zs->zst_cap = MAX(zs->zst_cap >> 1, zs->zst_len);
+			ZFETCHSTAT_BUMP(zfetchstat_streams_ramp_downs);
+			reset = 0;
+		}
+
 		if (reset) {
 			zstream_t *remove = zs;
 
 			rc = 0;
+			ZFETCHSTAT_BUMP(zfetchstat_streams_resets);
 			mutex_exit(&zs->zst_lock);
 			rw_exit(&zf->zf_rwlock);
 			rw_enter(&zf->zf_rwlock, RW_WRITER);
@@ -432,9 +647,12 @@ top:
 			}
 		} else {
 			rc = 1;
-			dmu_zfetch_dofetch(zf, zs);
+			ZFETCHSTAT_BUMP(zfetchstat_hits);
+			dmu_zfetch_dofetch(zf, zs, ramp, zi);
 			mutex_exit(&zs->zst_lock);
 		}
+	} else {
+		ZFETCHSTAT_BUMP(zfetchstat_misses);
 	}
 out:
 	rw_exit(&zf->zf_rwlock);
@@ -521,8 +739,10 @@ dmu_zfetch_stream_reclaim(zfetch_t *zf)
 		dmu_zfetch_stream_remove(zf, zs);
 		mutex_destroy(&zs->zst_lock);
 		bzero(zs, sizeof (zstream_t));
+		ZFETCHSTAT_BUMP(zfetchstat_reclaim_successes);
 	} else {
 		zf->zf_alloc_fail++;
+		ZFETCHSTAT_BUMP(zfetchstat_reclaim_failures);
 	}
 	rw_exit(&zf->zf_rwlock);
 
@@ -573,6 +793,7 @@ dmu_zfetch_streams_equal(zstream_t *zs1, zstream_t *zs2)
 void
 dmu_zfetch(zfetch_t *zf, uint64_t offset, uint64_t size, int prefetched)
 {
+	zfetch_issue_t	zi;
 	zstream_t	zst;
 	zstream_t	*newstream;
 	int		fetched;
@@ -596,10 +817,13 @@ dmu_zfetch(zfetch_t *zf, uint64_t offset, uint64_t size, int prefetched)
 	zst.zst_len = (P2ROUNDUP(offset + size, blksz) -
 	    P2ALIGN(offset, blksz)) >> blkshft;
 
-	fetched = dmu_zfetch_find(zf, &zst, prefetched);
+	zi.zi_valid = 0;
+	fetched = dmu_zfetch_find(zf, &zst, prefetched, &zi);
 	if (!fetched) {
-		fetched = dmu_zfetch_colinear(zf, &zst);
+		fetched = dmu_zfetch_colinear(zf, &zst, &zi);
 	}
+	if (zi.zi_valid)
+		dmu_zfetch_issue(zf->zf_dnode, &zi);
 
 	if (!fetched) {
 		newstream = dmu_zfetch_stream_reclaim(zf);
@@ -416,6 +416,16 @@ dnode_undirty_dbufs(list_t *list)
 		uint64_t txg = dr->dr_txg;
 
 		mutex_enter(&db->db_mtx);
+		/*
+		 * A partial write's old block may still be on its way in,
+		 * and dbuf_partial_done() holds the dbuf until it lands.
+		 * Wait for it, so that dnode_evict_dbufs() can evict the
+		 * dbuf once we drop the dirty record's hold.
+		 */
+		if (db->db_level == 0) {
+			while (db->db_state == DB_PARTIAL)
+				cv_wait(&db->db_changed, &db->db_mtx);
+		}
 		/* XXX - use dbuf_undirty()? */
 		list_remove(list, dr);
 		ASSERT(db->db_last_dirty == dr);
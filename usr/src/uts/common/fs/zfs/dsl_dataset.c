@@ -52,7 +52,7 @@ static dsl_syncfunc_t dsl_dataset_destroy_sync;
 
 #define	DS_REF_MAX	(1ULL << 62)
 
-#define	DSL_DEADLIST_BLOCKSIZE	SPA_MAXBLOCKSIZE
+#define	DSL_DEADLIST_BLOCKSIZE	SPA_OLD_MAXBLOCKSIZE
 
 /*
  * We use weighted reference counts to express the various forms of exclusion
@@ -926,6 +926,204 @@ kill_blkptr(traverse_blk_cache_t *bc, spa_t *spa, void *arg)
 	return (0);
 }
 
+/*
+ * Destroyed head datasets are freed in the background.  Destroy leaves
+ * the dataset object in place, marked DS_FLAG_DESTROYING, and adds it to
+ * the pool's free queue: a ZAP in the pool directory, keyed by dataset
+ * object, of dsl_free_entry_t.  Each txg, dsl_dataset_free_queue_sync()
+ * frees up to zfs_free_max_blocks of the queued blocks and saves where
+ * the traversal stopped.  Until it has been freed, the space is charged
+ * to the root dsl_dir, and is reported by the "freeing" pool property.
+ */
+uint64_t zfs_free_max_blocks = 100000;
+
+static void
+dsl_dataset_free_enqueue(dsl_dataset_t *ds, dmu_tx_t *tx)
+{
+	dsl_dir_t *dd = ds->ds_dir;
+	dsl_pool_t *dp = dd->dd_pool;
+	dsl_dir_t *rdd = dp->dp_root_dir;
+	objset_t *mos = dp->dp_meta_objset;
+	dsl_free_entry_t fe;
+	uint64_t rootused;
+	char name[20];
+
+	ASSERT(dmu_tx_is_syncing(tx));
+	ASSERT(ds->ds_phys->ds_next_snap_obj == 0);
+	ASSERT(dd != rdd);
+
+	if (dp->dp_free_queue_obj == 0) {
+		dp->dp_free_queue_obj = zap_create(mos,
+		    DMU_OT_ZAP_OTHER, DMU_OT_NONE, 0, tx);
+		VERIFY(0 == zap_add(mos, DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_FREE_QUEUE, sizeof (uint64_t), 1,
+		    &dp->dp_free_queue_obj, tx));
+	}
+
+	/*
+	 * Move the space from our dsl_dir, which is about to be destroyed,
+	 * to the root.  A reservation further up can keep the root from
+	 * seeing all of dd_used_bytes, so charge it what it actually lost.
+	 */
+	mutex_enter(&rdd->dd_lock);
+	rootused = rdd->dd_used_bytes;
+	mutex_exit(&rdd->dd_lock);
+	fe.fe_compressed = dd->dd_phys->dd_compressed_bytes;
+	fe.fe_uncompressed = dd->dd_phys->dd_uncompressed_bytes;
+	dsl_dir_diduse_space(dd, -dd->dd_used_bytes,
+	    -fe.fe_compressed, -fe.fe_uncompressed, tx);
+	mutex_enter(&rdd->dd_lock);
+	fe.fe_used = rootused - rdd->dd_used_bytes;
+	mutex_exit(&rdd->dd_lock);
+	dsl_dir_diduse_space(rdd, fe.fe_used,
+	    fe.fe_compressed, fe.fe_uncompressed, tx);
+
+	fe.fe_mintxg = ds->ds_phys->ds_prev_snap_txg;
+	fe.fe_bookmark.zb_objset = ds->ds_object;
+	fe.fe_bookmark.zb_object = 1;
+	fe.fe_bookmark.zb_level = 0;
+	fe.fe_bookmark.zb_blkid = 0;
+
+	dmu_buf_will_dirty(ds->ds_dbuf, tx);
+	ds->ds_phys->ds_flags |= DS_FLAG_DESTROYING;
+
+	(void) snprintf(name, sizeof (name), "%llx",
+	    (u_longlong_t)ds->ds_object);
+	VERIFY(0 == zap_add(mos, dp->dp_free_queue_obj, name,
+	    sizeof (uint64_t), DSL_FREE_ENTRY_INTS, &fe, tx));
+
+	mutex_enter(&dp->dp_lock);
+	dp->dp_freeing += fe.fe_used;
+	mutex_exit(&dp->dp_lock);
+}
+
+int
+dsl_dataset_free_queue_load(dsl_pool_t *dp)
+{
+	objset_t *mos = dp->dp_meta_objset;
+	zap_cursor_t zc;
+	zap_attribute_t za;
+	dsl_free_entry_t fe;
+	int err;
+
+	err = zap_lookup(mos, DMU_POOL_DIRECTORY_OBJECT, DMU_POOL_FREE_QUEUE,
+	    sizeof (uint64_t), 1, &dp->dp_free_queue_obj);
+	if (err == ENOENT)
+		return (0);
+	if (err)
+		return (err);
+
+	for (zap_cursor_init(&zc, mos, dp->dp_free_queue_obj);
+	    (err = zap_cursor_retrieve(&zc, &za)) == 0;
+	    zap_cursor_advance(&zc)) {
+		err = zap_lookup(mos, dp->dp_free_queue_obj, za.za_name,
+		    sizeof (uint64_t), DSL_FREE_ENTRY_INTS, &fe);
+		if (err)
+			break;
+		dp->dp_freeing += fe.fe_used;
+	}
+	zap_cursor_fini(&zc);
+
+	return (err == ENOENT ? 0 : err);
+}
+
+void
+dsl_dataset_free_queue_sync(dsl_pool_t *dp, dmu_tx_t *tx)
+{
+	objset_t *mos = dp->dp_meta_objset;
+	uint64_t used, compressed, uncompressed, dsobj, count;
+	uint64_t nblocks = 0;
+	traverse_handle_t *th;
+	struct killarg ka;
+	zap_cursor_t zc;
+	zap_attribute_t za;
+	dsl_free_entry_t fe;
+	boolean_t done;
+	zio_t *zio;
+	int err;
+
+	ASSERT(dmu_tx_is_syncing(tx));
+	ASSERT(dp->dp_free_queue_obj != 0);
+
+	zio = zio_root(dp->dp_spa, NULL, NULL, ZIO_FLAG_MUSTSUCCEED);
+	ka.usedp = &used;
+	ka.compressedp = &compressed;
+	ka.uncompressedp = &uncompressed;
+	ka.zio = zio;
+	ka.tx = tx;
+
+	while (nblocks < zfs_free_max_blocks) {
+		zap_cursor_init(&zc, mos, dp->dp_free_queue_obj);
+		err = zap_cursor_retrieve(&zc, &za);
+		zap_cursor_fini(&zc);
+		if (err == ENOENT)
+			break;
+		VERIFY(err == 0);
+		VERIFY(0 == zap_lookup(mos, dp->dp_free_queue_obj, za.za_name,
+		    sizeof (uint64_t), DSL_FREE_ENTRY_INTS, &fe));
+		dsobj = fe.fe_bookmark.zb_objset;
+
+		used = compressed = uncompressed = 0;
+		th = traverse_init(dp->dp_spa, kill_blkptr, &ka,
+		    ADVANCE_POST | ADVANCE_DESTROYED, ZIO_FLAG_MUSTSUCCEED);
+		traverse_resume_objset(th, fe.fe_mintxg, -1ULL, &fe.fe_bookmark);
+		while (nblocks + th->th_callbacks < zfs_free_max_blocks &&
+		    (err = traverse_more(th)) == EAGAIN)
+			continue;
+		nblocks += th->th_callbacks;
+		done = (list_head(&th->th_seglist) == NULL);
+		if (!done)
+			fe.fe_bookmark = ((zseg_t *)
+			    list_head(&th->th_seglist))->seg_start;
+		traverse_fini(th);
+
+		/*
+		 * Release what we freed from the root's charge; once the
+		 * dataset is gone, release whatever is left of it.
+		 */
+		if (done) {
+			used = fe.fe_used;
+			compressed = fe.fe_compressed;
+			uncompressed = fe.fe_uncompressed;
+		} else {
+			used = MIN(used, fe.fe_used);
+			compressed = MIN(compressed, fe.fe_compressed);
+			uncompressed = MIN(uncompressed, fe.fe_uncompressed);
+		}
+		dsl_dir_diduse_space(dp->dp_root_dir,
+		    -used, -compressed, -uncompressed, tx);
+		fe.fe_used -= used;
+		fe.fe_compressed -= compressed;
+		fe.fe_uncompressed -= uncompressed;
+
+		mutex_enter(&dp->dp_lock);
+		ASSERT3U(dp->dp_freeing, >=, used);
+		dp->dp_freeing -= used;
+		mutex_exit(&dp->dp_lock);
+
+		if (!done) {
+			VERIFY(0 == zap_update(mos, dp->dp_free_queue_obj,
+			    za.za_name, sizeof (uint64_t), DSL_FREE_ENTRY_INTS,
+			    &fe, tx));
+			break;
+		}
+		VERIFY(0 == zap_remove(mos, dp->dp_free_queue_obj,
+		    za.za_name, tx));
+		VERIFY(0 == dmu_object_free(mos, dsobj, tx));
+	}
+
+	err = zio_wait(zio);
+	ASSERT3U(err, ==, 0);
+
+	VERIFY(0 == zap_count(mos, dp->dp_free_queue_obj, &count));
+	if (count == 0) {
+		VERIFY(0 == zap_destroy(mos, dp->dp_free_queue_obj, tx));
+		VERIFY(0 == zap_remove(mos, DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_FREE_QUEUE, tx));
+		dp->dp_free_queue_obj = 0;
+	}
+}
+
 /* ARGSUSED */
 static int
 dsl_dataset_rollback_check(void *arg1, void *arg2, dmu_tx_t *tx)
@@ -1099,6 +1297,7 @@ dsl_dataset_destroy_sync(void *arg1, void *tag, cred_t *cr, dmu_tx_t *tx)
 	objset_t *mos = dp->dp_meta_objset;
 	dsl_dataset_t *ds_prev = NULL;
 	uint64_t obj;
+	boolean_t queued = B_FALSE;
 
 	ASSERT3U(ds->ds_open_refcount, ==, DS_REF_MAX);
 	ASSERT3U(ds->ds_phys->ds_num_children, <=, 1);
@@ -1261,27 +1460,35 @@ dsl_dataset_destroy_sync(void *arg1, void *tag, cred_t *cr, dmu_tx_t *tx)
 		 * deadlist should be empty.  (If it's a clone, it's
 		 * safe to ignore the deadlist contents.)
 		 */
-		struct killarg ka;
-
 		ASSERT(after_branch_point || bplist_empty(&ds->ds_deadlist));
 		bplist_close(&ds->ds_deadlist);
 		bplist_destroy(mos, ds->ds_phys->ds_deadlist_obj, tx);
 		ds->ds_phys->ds_deadlist_obj = 0;
 
 		/*
-		 * Free everything that we point to (that's born after
-		 * the previous snapshot, if we are a clone)
+		 * Everything that we point to (that's born after the
+		 * previous snapshot, if we are a clone) is freed in the
+		 * background by the pool's free queue.  Older pools have
+		 * no queue, so free it all now.
 		 *
 		 * XXX we're doing this long task with the config lock held
 		 */
-		ka.usedp = &used;
-		ka.compressedp = &compressed;
-		ka.uncompressedp = &uncompressed;
-		ka.zio = zio;
-		ka.tx = tx;
-		err = traverse_dsl_dataset(ds, ds->ds_phys->ds_prev_snap_txg,
-		    ADVANCE_POST, kill_blkptr, &ka);
-		ASSERT3U(err, ==, 0);
+		if (spa_version(dp->dp_spa) >= SPA_VERSION_FREE_QUEUE) {
+			dsl_dataset_free_enqueue(ds, tx);
+			queued = B_TRUE;
+		} else {
+			struct killarg ka;
+
+			ka.usedp = &used;
+			ka.compressedp = &compressed;
+			ka.uncompressedp = &uncompressed;
+			ka.zio = zio;
+			ka.tx = tx;
+			err = traverse_dsl_dataset(ds,
+			    ds->ds_phys->ds_prev_snap_txg, ADVANCE_POST,
+			    kill_blkptr, &ka);
+			ASSERT3U(err, ==, 0);
+		}
 	}
 
 	err = zio_wait(zio);
@@ -1333,8 +1540,9 @@ dsl_dataset_destroy_sync(void *arg1, void *tag, cred_t *cr, dmu_tx_t *tx)
 	    cr, "dataset = %llu", ds->ds_object);
 
 	dsl_dataset_close(ds, DS_MODE_EXCLUSIVE, tag);
-	VERIFY(0 == dmu_object_free(mos, obj, tx));
-
+	/* A queued dataset's object is freed with its last block */
+	if (!queued)
+		VERIFY(0 == dmu_object_free(mos, obj, tx));
 }
 
 /* ARGSUSED */
@@ -746,11 +746,12 @@ dsl_dir_tempreserve_impl(dsl_dir_t *dd, uint64_t asize,
 	 * may free up space for us).
 	 */
 	if (asize > 0 && est_used > quota) {
-		if (dd->dd_space_towrite[txg & TXG_MASK] != 0 ||
-		    dd->dd_space_towrite[(txg-1) & TXG_MASK] != 0 ||
-		    dd->dd_space_towrite[(txg-2) & TXG_MASK] != 0 ||
-		    dd->dd_used_bytes < quota)
+		if (dd->dd_used_bytes < quota)
 			edquot = ERESTART;
+		for (i = 0; i < TXG_CONCURRENT_STATES; i++) {
+			if (dd->dd_space_towrite[(txg - i) & TXG_MASK] != 0)
+				edquot = ERESTART;
+		}
 		dprintf_dd(dd, "failing: used=%lluK est_used = %lluK "
 		    "quota=%lluK tr=%lluK err=%d\n",
 		    dd->dd_used_bytes>>10, est_used>>10,
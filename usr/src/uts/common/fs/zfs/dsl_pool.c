@@ -36,6 +36,92 @@
 #include <sys/zio.h>
 #include <sys/zfs_context.h>
 #include <sys/fs/zfs.h>
+#include <sys/kstat.h>
+
+/*
+ * Write throttle.  The dirty data of all txgs that have not yet synced
+ * is limited to zfs_dirty_data_max (by default zfs_dirty_data_max_percent
+ * of physical memory, at most zfs_dirty_data_max_max).
+ *
+ * Once dirty data exceeds zfs_delay_min_dirty_percent of the limit, each
+ * transaction is delayed before it is assigned, by
+ *
+ *	zfs_delay_scale * (dirty - min) / (zfs_dirty_data_max - dirty)
+ *
+ * nanoseconds (at most zfs_delay_max_ns).  The delay is zero at the
+ * minimum and grows without bound towards the limit, so writers settle
+ * at the rate the pool can sync instead of stalling for whole txgs.  At
+ * the limit they wait for a txg to finish syncing.
+ *
+ * The open txg is pushed out early once it holds
+ * zfs_dirty_data_sync_percent of the limit.
+ */
+uint64_t zfs_dirty_data_max = 0;
+uint64_t zfs_dirty_data_max_max = 4ULL << 30;
+int zfs_dirty_data_max_percent = 10;
+int zfs_dirty_data_sync_percent = 20;
+int zfs_delay_min_dirty_percent = 60;
+uint64_t zfs_delay_scale = 500000;
+uint64_t zfs_delay_max_ns = 100000000;
+
+/*
+ * Number of threads used by each pool to sync objsets, and the dirty
+ * dnodes within them, in parallel (see dmu_objset_sync()).
+ */
+int zfs_sync_taskq_threads = 8;
+
+typedef struct dsl_pool_stats {
+	kstat_named_t dpstat_dirty_txgs;
+	kstat_named_t dpstat_dirty_bytes;
+	kstat_named_t dpstat_dirty_kicks;
+	kstat_named_t dpstat_dirty_max_waits;
+	kstat_named_t dpstat_delays;
+	kstat_named_t dpstat_delay_time;
+} dsl_pool_stats_t;
+
+static dsl_pool_stats_t dsl_pool_stats = {
+	{ "dirty_txgs",		KSTAT_DATA_UINT64 },
+	{ "dirty_bytes",	KSTAT_DATA_UINT64 },
+	{ "dirty_kicks",	KSTAT_DATA_UINT64 },
+	{ "dirty_max_waits",	KSTAT_DATA_UINT64 },
+	{ "delays",		KSTAT_DATA_UINT64 },
+	{ "delay_time_ns",	KSTAT_DATA_UINT64 }
+};
+
+#define	DPSTAT_INCR(stat, val) \
+	atomic_add_64(&dsl_pool_stats.stat.value.ui64, (val));
+
+#define	DPSTAT_BUMP(stat)	DPSTAT_INCR(stat, 1)
+
+static kstat_t *dsl_pool_ksp;
+
+void
+dsl_pool_init(void)
+{
+	if (zfs_dirty_data_max == 0) {
+		zfs_dirty_data_max = MIN(zfs_dirty_data_max_max,
+		    (uint64_t)physmem * PAGESIZE *
+		    zfs_dirty_data_max_percent / 100);
+	}
+
+	dsl_pool_ksp = kstat_create("zfs", 0, "dsl_pool", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (dsl_pool_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+
+	if (dsl_pool_ksp != NULL) {
+		dsl_pool_ksp->ks_data = &dsl_pool_stats;
+		kstat_install(dsl_pool_ksp);
+	}
+}
+
+void
+dsl_pool_fini(void)
+{
+	if (dsl_pool_ksp != NULL) {
+		kstat_delete(dsl_pool_ksp);
+		dsl_pool_ksp = NULL;
+	}
+}
 
 static int
 dsl_pool_open_mos_dir(dsl_pool_t *dp, dsl_dir_t **ddp)
@@ -62,8 +148,14 @@ dsl_pool_open_impl(spa_t *spa, uint64_t txg)
 	dp->dp_spa = spa;
 	dp->dp_meta_rootbp = *bp;
 	rw_init(&dp->dp_config_rwlock, NULL, RW_DEFAULT, NULL);
+	mutex_init(&dp->dp_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&dp->dp_spaceavail_cv, NULL, CV_DEFAULT, NULL);
 	txg_init(dp, txg);
 
+	dp->dp_sync_taskq = taskq_create("dp_sync_taskq",
+	    zfs_sync_taskq_threads, maxclsyspri, zfs_sync_taskq_threads,
+	    INT_MAX, TASKQ_PREPOPULATE);
+
 	txg_list_create(&dp->dp_dirty_datasets,
 	    offsetof(dsl_dataset_t, ds_dirty_link));
 	txg_list_create(&dp->dp_dirty_dirs,
@@ -104,6 +196,10 @@ dsl_pool_open(spa_t *spa, uint64_t txg, dsl_pool_t **dpp)
 	if (err)
 		goto out;
 
+	err = dsl_dataset_free_queue_load(dp);
+	if (err)
+		goto out;
+
 out:
 	rw_exit(&dp->dp_config_rwlock);
 	if (err)
@@ -131,9 +227,13 @@ dsl_pool_close(dsl_pool_t *dp)
 	txg_list_destroy(&dp->dp_dirty_dirs);
 	list_destroy(&dp->dp_synced_objsets);
 
+	taskq_destroy(dp->dp_sync_taskq);
+
 	arc_flush();
 	txg_fini(dp);
 	rw_destroy(&dp->dp_config_rwlock);
+	cv_destroy(&dp->dp_spaceavail_cv);
+	mutex_destroy(&dp->dp_lock);
 	kmem_free(dp, sizeof (dsl_pool_t));
 }
 
@@ -186,9 +286,23 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 			dmu_buf_rele(ds->ds_dbuf, ds);
 		dsl_dataset_sync(ds, zio, tx);
 	}
+	/*
+	 * The objsets sync on dp_sync_taskq; their writes are only all
+	 * children of the root zio once the taskq has drained.
+	 */
+	taskq_wait(dp->dp_sync_taskq);
 	err = zio_wait(zio);
 	ASSERT(err == 0);
 
+	/*
+	 * Free the next part of any destroyed datasets.  This runs before
+	 * the sync tasks so that a dataset destroyed in this txg is first
+	 * traversed once its final state is on disk.  Only the first pass
+	 * does it: each later pass would free another zfs_free_max_blocks.
+	 */
+	if (dp->dp_free_queue_obj != 0 && spa_sync_pass(dp->dp_spa) == 1)
+		dsl_dataset_free_queue_sync(dp, tx);
+
 	while (dstg = txg_list_remove(&dp->dp_sync_tasks, txg))
 		dsl_sync_task_group_sync(dstg, tx);
 	while (dd = txg_list_remove(&dp->dp_dirty_dirs, txg))
@@ -198,6 +312,7 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 	    list_head(&mosi->os_free_dnodes[txg & TXG_MASK]) != NULL) {
 		zio = zio_root(dp->dp_spa, NULL, NULL, ZIO_FLAG_MUSTSUCCEED);
 		dmu_objset_sync(mosi, zio, tx);
+		taskq_wait(dp->dp_sync_taskq);
 		err = zio_wait(zio);
 		ASSERT(err == 0);
 		dprintf_bp(&dp->dp_meta_rootbp, "meta objset rootbp is %s", "");
@@ -205,6 +320,22 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 	}
 
 	dmu_tx_commit(tx);
+
+	/*
+	 * This txg's dirty data is on disk; let throttled writers in.
+	 */
+	mutex_enter(&dp->dp_lock);
+	if (dp->dp_dirty_pertxg[txg & TXG_MASK] != 0) {
+		DPSTAT_BUMP(dpstat_dirty_txgs);
+		DPSTAT_INCR(dpstat_dirty_bytes,
+		    dp->dp_dirty_pertxg[txg & TXG_MASK]);
+		ASSERT3U(dp->dp_dirty_total, >=,
+		    dp->dp_dirty_pertxg[txg & TXG_MASK]);
+		dp->dp_dirty_total -= dp->dp_dirty_pertxg[txg & TXG_MASK];
+		dp->dp_dirty_pertxg[txg & TXG_MASK] = 0;
+		cv_broadcast(&dp->dp_spaceavail_cv);
+	}
+	mutex_exit(&dp->dp_lock);
 }
 
 void
@@ -220,6 +351,22 @@ dsl_pool_zil_clean(dsl_pool_t *dp)
 	}
 }
 
+/*
+ * Space still to be freed from destroyed datasets (the "freeing" pool
+ * property).
+ */
+uint64_t
+dsl_pool_freeing(dsl_pool_t *dp)
+{
+	uint64_t freeing;
+
+	mutex_enter(&dp->dp_lock);
+	freeing = dp->dp_freeing;
+	mutex_exit(&dp->dp_lock);
+
+	return (freeing);
+}
+
 /*
  * TRUE if the current thread is the tx_sync_thread or if we
  * are being called from SPA context during pool initialization.
@@ -253,3 +400,106 @@ dsl_pool_adjustedsize(dsl_pool_t *dp, boolean_t netfree)
 
 	return (space - resv);
 }
+
+/*
+ * Account for data dirtied in open context by tx.  Once the open txg
+ * holds zfs_dirty_data_sync_percent of the limit, push it out.
+ */
+void
+dsl_pool_dirty_space(dsl_pool_t *dp, int64_t space, dmu_tx_t *tx)
+{
+	uint64_t txg = tx->tx_txg;
+	boolean_t kick;
+
+	if (space <= 0)
+		return;
+
+	mutex_enter(&dp->dp_lock);
+	dp->dp_dirty_pertxg[txg & TXG_MASK] += space;
+	dp->dp_dirty_total += space;
+	kick = (dp->dp_dirty_pertxg[txg & TXG_MASK] >=
+	    zfs_dirty_data_max * zfs_dirty_data_sync_percent / 100);
+	mutex_exit(&dp->dp_lock);
+
+	if (kick && txg_kick(dp, txg))
+		DPSTAT_BUMP(dpstat_dirty_kicks);
+}
+
+/*
+ * TRUE if txg holds enough dirty data that it should be pushed out.
+ * The sync thread checks this after each sync, since a kick from
+ * dsl_pool_dirty_space() is dropped while the quiesce pipeline is full.
+ */
+boolean_t
+dsl_pool_need_dirty_sync(dsl_pool_t *dp, uint64_t txg)
+{
+	uint64_t sync_min_bytes =
+	    zfs_dirty_data_max * zfs_dirty_data_sync_percent / 100;
+
+	/* a stale value only delays the push until the next check */
+	return (dp->dp_dirty_pertxg[txg & TXG_MASK] >= sync_min_bytes ||
+	    dp->dp_dirty_total >= zfs_dirty_data_max);
+}
+
+boolean_t
+dsl_pool_need_dirty_delay(dsl_pool_t *dp)
+{
+	uint64_t delay_min_bytes =
+	    zfs_dirty_data_max * zfs_delay_min_dirty_percent / 100;
+
+	/* a stale value only shifts the start of the delay slightly */
+	return (dp->dp_dirty_total > delay_min_bytes);
+}
+
+/*
+ * Delay a transaction according to the write throttle.  Delays are
+ * handed out back to back (dp_last_wakeup), so that many writers
+ * together are admitted at one transaction per delay rather than all
+ * sleeping for the same period and then rushing in at once.
+ */
+void
+dsl_pool_dirty_delay(dsl_pool_t *dp)
+{
+	uint64_t delay_min_bytes =
+	    zfs_dirty_data_max * zfs_delay_min_dirty_percent / 100;
+	uint64_t dirty;
+	hrtime_t now, wakeup, delay;
+	clock_t ticks;
+
+	mutex_enter(&dp->dp_lock);
+
+	if (dp->dp_dirty_total >= zfs_dirty_data_max) {
+		DPSTAT_BUMP(dpstat_dirty_max_waits);
+		while (dp->dp_dirty_total >= zfs_dirty_data_max)
+			cv_wait(&dp->dp_spaceavail_cv, &dp->dp_lock);
+	}
+
+	dirty = dp->dp_dirty_total;
+	if (dirty <= delay_min_bytes) {
+		mutex_exit(&dp->dp_lock);
+		return;
+	}
+
+	delay = MIN(zfs_delay_scale * (dirty - delay_min_bytes) /
+	    (zfs_dirty_data_max - dirty), zfs_delay_max_ns);
+
+	now = gethrtime();
+	wakeup = MIN(MAX(now, dp->dp_last_wakeup) + delay,
+	    now + zfs_delay_max_ns);
+	dp->dp_last_wakeup = wakeup;
+
+	DPSTAT_BUMP(dpstat_delays);
+	DPSTAT_INCR(dpstat_delay_time, wakeup - now);
+
+	/*
+	 * Sleep in clock ticks; a delay shorter than a tick is made up
+	 * by the writers scheduled after it.  A txg finishing its sync
+	 * wakes us early.
+	 */
+	ticks = (clock_t)((wakeup - now) * hz / NANOSEC);
+	if (ticks > 0) {
+		(void) cv_timedwait(&dp->dp_spaceavail_cv, &dp->dp_lock,
+		    lbolt + ticks);
+	}
+	mutex_exit(&dp->dp_lock);
+}
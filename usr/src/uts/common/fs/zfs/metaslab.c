@@ -36,6 +36,115 @@
 
 uint64_t metaslab_aliquot = 512ULL << 10;
 
+/*
+ * The dynamic-fit allocator allocates first-fit from a per-alignment
+ * cursor while the metaslab is healthy, which keeps writes sequential.
+ * Once the largest free segment drops below metaslab_df_alloc_threshold
+ * or the free space drops below metaslab_df_free_pct percent, first-fit
+ * would wade through lots of small segments on each allocation, so it
+ * switches to best-fit using a second tree sorted by segment size.
+ */
+uint64_t metaslab_df_alloc_threshold = SPA_OLD_MAXBLOCKSIZE;
+int metaslab_df_free_pct = 4;
+
+/*
+ * A metaslab's space map object is an append-only log, so it is
+ * rewritten from the in-core map once it holds metaslab_condense_factor
+ * times as many entries as the in-core map has segments.  Metaslabs
+ * that aren't loaded would never be checked, and would replay an ever
+ * growing log on their next activation, so they are loaded for the
+ * check once the log reaches metaslab_condense_min_size bytes and has
+ * doubled in size since it was last checked.
+ */
+int metaslab_condense_factor = 2;
+uint64_t metaslab_condense_min_size = 128ULL << 10;
+
+/*
+ * Loading a space map means synchronous reads of its object, which we'd
+ * rather not do from the allocation path (usually spa_sync()).  So each
+ * txg, the metaslab_preload_limit highest-weight metaslabs in each group
+ * are loaded in the background by the pool's preload taskq.  Maps that
+ * aren't active are unloaded once they've gone metaslab_unload_delay
+ * txgs without being allocated from or preloaded.
+ */
+int metaslab_preload_enabled = B_TRUE;
+int metaslab_preload_limit = 3;
+int metaslab_unload_delay = 8;
+
+/*
+ * Allocation throttle.  Each top-level vdev's group counts the async
+ * write bytes issued to it and not yet completed.  A group holding more
+ * than metaslab_throttle_pct percent over its share of the class's
+ * queued bytes (plus one aliquot of slack) is skipped by the rotor, so
+ * a slow or saturated vdev doesn't hold up the whole txg.  The rotor's
+ * free space bias still applies, so fullness evens out over time.
+ */
+int metaslab_throttle_enabled = B_TRUE;
+int metaslab_throttle_pct = 50;
+
+/*
+ * Scale a metaslab's weight down by the fragmentation of its free space
+ * (see space_map_fragmentation()), so that among metaslabs with similar
+ * free space, the one with the larger free segments is preferred.
+ */
+int metaslab_fragmentation_factor_enabled = B_TRUE;
+
+/*
+ * Allocation statistics.  Allocation times are kept as a power-of-two
+ * histogram: bucket N counts allocations that took less than 2^N us.
+ */
+typedef struct metaslab_stats {
+	kstat_named_t msstat_ff_allocs;
+	kstat_named_t msstat_ff_time;
+	kstat_named_t msstat_df_allocs;
+	kstat_named_t msstat_df_time;
+	kstat_named_t msstat_alloc_failures;
+	kstat_named_t msstat_load_stalls;
+	kstat_named_t msstat_load_stall_time;
+	kstat_named_t msstat_preloads;
+	kstat_named_t msstat_unloads;
+	kstat_named_t msstat_throttled;
+	kstat_named_t msstat_time_hist[16];
+} metaslab_stats_t;
+
+static metaslab_stats_t metaslab_stats = {
+	{ "ff_allocs",			KSTAT_DATA_UINT64 },
+	{ "ff_time_ns",			KSTAT_DATA_UINT64 },
+	{ "df_allocs",			KSTAT_DATA_UINT64 },
+	{ "df_time_ns",			KSTAT_DATA_UINT64 },
+	{ "alloc_failures",		KSTAT_DATA_UINT64 },
+	{ "load_stalls",		KSTAT_DATA_UINT64 },
+	{ "load_stall_time_ns",		KSTAT_DATA_UINT64 },
+	{ "preloads",			KSTAT_DATA_UINT64 },
+	{ "unloads",			KSTAT_DATA_UINT64 },
+	{ "throttled",			KSTAT_DATA_UINT64 },
+	{
+		{ "time_1us",		KSTAT_DATA_UINT64 },
+		{ "time_2us",		KSTAT_DATA_UINT64 },
+		{ "time_4us",		KSTAT_DATA_UINT64 },
+		{ "time_8us",		KSTAT_DATA_UINT64 },
+		{ "time_16us",		KSTAT_DATA_UINT64 },
+		{ "time_32us",		KSTAT_DATA_UINT64 },
+		{ "time_64us",		KSTAT_DATA_UINT64 },
+		{ "time_128us",		KSTAT_DATA_UINT64 },
+		{ "time_256us",		KSTAT_DATA_UINT64 },
+		{ "time_512us",		KSTAT_DATA_UINT64 },
+		{ "time_1ms",		KSTAT_DATA_UINT64 },
+		{ "time_2ms",		KSTAT_DATA_UINT64 },
+		{ "time_4ms",		KSTAT_DATA_UINT64 },
+		{ "time_8ms",		KSTAT_DATA_UINT64 },
+		{ "time_16ms",		KSTAT_DATA_UINT64 },
+		{ "time_long",		KSTAT_DATA_UINT64 }
+	}
+};
+
+#define	MSSTAT_INCR(stat, val) \
+	atomic_add_64(&metaslab_stats.stat.value.ui64, (val));
+
+#define	MSSTAT_BUMP(stat)	MSSTAT_INCR(stat, 1)
+
+static kstat_t *metaslab_ksp;
+
 /*
  * ==========================================================================
  * Metaslab classes
@@ -84,6 +193,7 @@ metaslab_class_add(metaslab_class_t *mc, metaslab_group_t *mg)
 		mgnext->mg_prev = mg;
 	}
 	mc->mc_rotor = mg;
+	mc->mc_groups++;
 	mg->mg_class = mc;
 }
 
@@ -108,6 +218,29 @@ metaslab_class_remove(metaslab_class_t *mc, metaslab_group_t *mg)
 	mg->mg_prev = NULL;
 	mg->mg_next = NULL;
 	mg->mg_class = NULL;
+	mc->mc_groups--;
+}
+
+void
+metaslab_stat_init(void)
+{
+	metaslab_ksp = kstat_create("zfs", 0, "metaslab_alloc", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (metaslab_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+
+	if (metaslab_ksp != NULL) {
+		metaslab_ksp->ks_data = &metaslab_stats;
+		kstat_install(metaslab_ksp);
+	}
+}
+
+void
+metaslab_stat_fini(void)
+{
+	if (metaslab_ksp != NULL) {
+		kstat_delete(metaslab_ksp);
+		metaslab_ksp = NULL;
+	}
 }
 
 /*
@@ -163,6 +296,38 @@ metaslab_group_destroy(metaslab_group_t *mg)
 	kmem_free(mg, sizeof (metaslab_group_t));
 }
 
+/*
+ * Account for async write bytes issued to or completed by this group's
+ * vdev.  Called from the zio pipeline.
+ */
+void
+metaslab_group_queued(metaslab_group_t *mg, int64_t delta)
+{
+	metaslab_class_t *mc = mg->mg_class;
+
+	atomic_add_64(&mg->mg_alloc_queued, delta);
+	if (mc != NULL)
+		atomic_add_64(&mc->mc_alloc_queued, delta);
+}
+
+/*
+ * Does this group have more than its share of the class's queued writes?
+ */
+static boolean_t
+metaslab_group_throttled(metaslab_group_t *mg)
+{
+	metaslab_class_t *mc = mg->mg_class;
+	uint64_t share;
+
+	if (!metaslab_throttle_enabled || mc->mc_groups < 2)
+		return (B_FALSE);
+
+	share = mc->mc_alloc_queued / mc->mc_groups;
+
+	return (mg->mg_alloc_queued > share +
+	    share * metaslab_throttle_pct / 100 + mg->mg_aliquot);
+}
+
 static void
 metaslab_group_add(metaslab_group_t *mg, metaslab_t *msp)
 {
@@ -272,7 +437,7 @@ metaslab_ff_free(space_map_t *sm, uint64_t start, uint64_t size)
 	/* No need to update cursor */
 }
 
-static space_map_ops_t metaslab_ff_ops = {
+space_map_ops_t metaslab_ff_ops = {
 	metaslab_ff_load,
 	metaslab_ff_unload,
 	metaslab_ff_alloc,
@@ -280,6 +445,149 @@ static space_map_ops_t metaslab_ff_ops = {
 	metaslab_ff_free
 };
 
+/*
+ * ==========================================================================
+ * The dynamic-fit block allocator
+ * ==========================================================================
+ */
+static int
+metaslab_segsize_compare(const void *x1, const void *x2)
+{
+	const space_seg_t *s1 = x1;
+	const space_seg_t *s2 = x2;
+	uint64_t ss_size1 = s1->ss_end - s1->ss_start;
+	uint64_t ss_size2 = s2->ss_end - s2->ss_start;
+
+	if (ss_size1 < ss_size2)
+		return (-1);
+	if (ss_size1 > ss_size2)
+		return (1);
+
+	if (s1->ss_start < s2->ss_start)
+		return (-1);
+	if (s1->ss_start > s2->ss_start)
+		return (1);
+
+	return (0);
+}
+
+static void
+metaslab_df_load(space_map_t *sm)
+{
+	space_seg_t *ss;
+
+	metaslab_ff_load(sm);
+
+	ASSERT(sm->sm_pp_root == NULL);
+	sm->sm_pp_root = kmem_alloc(sizeof (avl_tree_t), KM_SLEEP);
+	avl_create(sm->sm_pp_root, metaslab_segsize_compare,
+	    sizeof (space_seg_t), offsetof(struct space_seg, ss_pp_node));
+
+	for (ss = avl_first(&sm->sm_root); ss; ss = AVL_NEXT(&sm->sm_root, ss))
+		avl_add(sm->sm_pp_root, ss);
+}
+
+static void
+metaslab_df_unload(space_map_t *sm)
+{
+	void *cookie = NULL;
+
+	while (avl_destroy_nodes(sm->sm_pp_root, &cookie) != NULL)
+		continue;
+	avl_destroy(sm->sm_pp_root);
+	kmem_free(sm->sm_pp_root, sizeof (avl_tree_t));
+	sm->sm_pp_root = NULL;
+
+	metaslab_ff_unload(sm);
+}
+
+/*
+ * Return the size of the largest free segment in the map.
+ */
+static uint64_t
+metaslab_df_maxsize(space_map_t *sm)
+{
+	space_seg_t *ss = avl_last(sm->sm_pp_root);
+
+	return (ss == NULL ? 0 : ss->ss_end - ss->ss_start);
+}
+
+/*
+ * Best-fit: find the smallest segment that can hold an aligned block of
+ * the given size.  Segments of exactly the right size are consumed whole.
+ */
+static uint64_t
+metaslab_df_bestfit(space_map_t *sm, uint64_t size)
+{
+	avl_tree_t *t = sm->sm_pp_root;
+	uint64_t align = size & -size;
+	space_seg_t *ss, ssearch;
+	avl_index_t where;
+
+	ssearch.ss_start = 0;
+	ssearch.ss_end = size;
+
+	ss = avl_find(t, &ssearch, &where);
+	if (ss == NULL)
+		ss = avl_nearest(t, where, AVL_AFTER);
+
+	while (ss != NULL) {
+		uint64_t offset = P2ROUNDUP(ss->ss_start, align);
+
+		if (offset + size <= ss->ss_end)
+			return (offset);
+		ss = AVL_NEXT(t, ss);
+	}
+
+	return (-1ULL);
+}
+
+static uint64_t
+metaslab_df_alloc(space_map_t *sm, uint64_t size)
+{
+	hrtime_t start = gethrtime();
+	hrtime_t delta;
+	uint64_t offset;
+	int bestfit, bucket;
+
+	bestfit = (metaslab_df_maxsize(sm) < metaslab_df_alloc_threshold ||
+	    sm->sm_space * 100 < sm->sm_size * metaslab_df_free_pct);
+
+	if (bestfit)
+		offset = metaslab_df_bestfit(sm, size);
+	else
+		offset = metaslab_ff_alloc(sm, size);
+
+	delta = gethrtime() - start;
+	bucket = MIN(highbit(delta >> 10), 15);
+
+	if (bestfit) {
+		MSSTAT_BUMP(msstat_df_allocs);
+		MSSTAT_INCR(msstat_df_time, delta);
+	} else {
+		MSSTAT_BUMP(msstat_ff_allocs);
+		MSSTAT_INCR(msstat_ff_time, delta);
+	}
+	MSSTAT_BUMP(msstat_time_hist[bucket]);
+	if (offset == -1ULL)
+		MSSTAT_BUMP(msstat_alloc_failures);
+
+	return (offset);
+}
+
+space_map_ops_t metaslab_df_ops = {
+	metaslab_df_load,
+	metaslab_df_unload,
+	metaslab_df_alloc,
+	metaslab_ff_claim,
+	metaslab_ff_free
+};
+
+/*
+ * The block allocator used when a metaslab's space map is loaded.
+ */
+space_map_ops_t *zfs_metaslab_ops = &metaslab_df_ops;
+
 /*
  * ==========================================================================
  * Metaslabs
@@ -294,6 +602,7 @@ metaslab_init(metaslab_group_t *mg, space_map_obj_t *smo,
 
 	msp = kmem_zalloc(sizeof (metaslab_t), KM_SLEEP);
 	mutex_init(&msp->ms_lock, NULL, MUTEX_DEFAULT, NULL);
+	msp->ms_fragmentation = ZFS_FRAG_INVALID;
 
 	msp->ms_smo_syncing = *smo;
 
@@ -379,9 +688,24 @@ metaslab_weight(metaslab_t *msp)
 	ASSERT(MUTEX_HELD(&msp->ms_lock));
 
 	/*
-	 * The baseline weight is the metaslab's free space.
+	 * The in-core map's histogram is only meaningful while it's loaded;
+	 * otherwise keep the fragmentation we saw when it was last loaded.
+	 */
+	if (sm->sm_loaded)
+		msp->ms_fragmentation = space_map_fragmentation(sm);
+
+	/*
+	 * The baseline weight is the metaslab's free space, less the
+	 * fraction of it that's fragmented.  Even a fully fragmented
+	 * metaslab keeps 1% of it, so that it stays allocatable for as
+	 * long as it has any free space at all.
 	 */
 	space = sm->sm_size - smo->smo_alloc;
+	if (metaslab_fragmentation_factor_enabled &&
+	    msp->ms_fragmentation != ZFS_FRAG_INVALID && space != 0) {
+		space = space * (100 - (msp->ms_fragmentation - 1)) / 100;
+		space = MAX(space, SPA_MINBLOCKSIZE);
+	}
 	weight = space;
 
 	/*
@@ -422,9 +746,16 @@ metaslab_activate(metaslab_t *msp, uint64_t activation_weight)
 	ASSERT(MUTEX_HELD(&msp->ms_lock));
 
 	if ((msp->ms_weight & METASLAB_ACTIVE_MASK) == 0) {
-		int error = space_map_load(sm, &metaslab_ff_ops,
+		hrtime_t start = gethrtime();
+		boolean_t stalled = !sm->sm_loaded;
+		int error = space_map_load(sm, zfs_metaslab_ops,
 		    SM_FREE, &msp->ms_smo,
 		    msp->ms_group->mg_vd->vdev_spa->spa_meta_objset);
+		if (stalled) {
+			MSSTAT_BUMP(msstat_load_stalls);
+			MSSTAT_INCR(msstat_load_stall_time,
+			    gethrtime() - start);
+		}
 		if (error) {
 			metaslab_group_sort(msp->ms_group, msp, 0);
 			return (error);
@@ -467,6 +798,7 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 	space_map_obj_t *smo = &msp->ms_smo_syncing;
 	dmu_buf_t *db;
 	dmu_tx_t *tx;
+	int condense = B_FALSE;
 	int t;
 
 	tx = dmu_tx_create_assigned(spa_get_dsl(spa), txg);
@@ -497,8 +829,21 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 
 	space_map_walk(freemap, space_map_add, freed_map);
 
+	if (!sm->sm_loaded && spa_sync_pass(spa) == 1 &&
+	    smo->smo_objsize >= metaslab_condense_min_size &&
+	    smo->smo_objsize >= 2 * msp->ms_condense_checked) {
+		/*
+		 * Load the map so we can see whether it's worth condensing.
+		 * If it isn't active, metaslab_sync_done() will evict it.
+		 */
+		msp->ms_condense_checked = smo->smo_objsize;
+		(void) space_map_load(sm, zfs_metaslab_ops, SM_FREE,
+		    &msp->ms_smo, mos);
+	}
+
 	if (sm->sm_loaded && spa_sync_pass(spa) == 1 && smo->smo_objsize >=
-	    2 * sizeof (uint64_t) * avl_numnodes(&sm->sm_root)) {
+	    metaslab_condense_factor * sizeof (uint64_t) *
+	    avl_numnodes(&sm->sm_root)) {
 		/*
 		 * The in-core space map representation is twice as compact
 		 * as the on-disk one, so it's time to condense the latter
@@ -525,11 +870,15 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 		mutex_exit(&msp->ms_lock);
 		space_map_truncate(smo, mos, tx);
 		mutex_enter(&msp->ms_lock);
+		condense = B_TRUE;
 	}
 
 	space_map_sync(allocmap, SM_ALLOC, smo, mos, tx);
 	space_map_sync(freemap, SM_FREE, smo, mos, tx);
 
+	if (condense)
+		msp->ms_condense_checked = smo->smo_objsize;
+
 	mutex_exit(&msp->ms_lock);
 
 	VERIFY(0 == dmu_bonus_hold(mos, smo->smo_object, FTAG, &db));
@@ -541,6 +890,64 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 	dmu_tx_commit(tx);
 }
 
+/*
+ * Unload an inactive metaslab's space map if it has gone cold.  It can
+ * only be evicted once all future allocations from it have synced: if
+ * we unloaded it now and then loaded it a moment later, the map
+ * wouldn't reflect those allocations.
+ */
+static void
+metaslab_evict(metaslab_t *msp, uint64_t txg)
+{
+	int t;
+
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+	ASSERT((msp->ms_weight & METASLAB_ACTIVE_MASK) == 0);
+
+	if (msp->ms_access_txg + metaslab_unload_delay > txg)
+		return;
+
+	for (t = 1; t < TXG_CONCURRENT_STATES; t++)
+		if (msp->ms_allocmap[(txg + t) & TXG_MASK].sm_space)
+			return;
+
+	space_map_unload(&msp->ms_map);
+	MSSTAT_BUMP(msstat_unloads);
+}
+
+/*
+ * Called after a transaction group has completely synced, but before
+ * metaslab_sync_done(), to discard everything the metaslab freed in it.
+ * The freed space isn't allocatable until metaslab_sync_done(), so no
+ * new data can land in a range while it is being discarded.  Adjacent
+ * frees have already been merged into single segments by space_map_add().
+ */
+void
+metaslab_trim(metaslab_t *msp, uint64_t txg, zio_t *pio)
+{
+	space_map_t *freed_map = &msp->ms_freemap[TXG_CLEAN(txg) & TXG_MASK];
+	vdev_t *vd = msp->ms_group->mg_vd;
+	space_seg_t *ss;
+
+	if (vd->vdev_notrim)
+		return;
+
+	mutex_enter(&msp->ms_lock);
+
+	if (freed_map->sm_size != 0) {
+		for (ss = avl_first(&freed_map->sm_root); ss != NULL;
+		    ss = AVL_NEXT(&freed_map->sm_root, ss)) {
+			zio_nowait(zio_trim(pio, vd->vdev_spa, vd,
+			    ss->ss_start, ss->ss_end - ss->ss_start,
+			    NULL, NULL, ZIO_PRIORITY_FREE,
+			    ZIO_FLAG_CONFIG_HELD | ZIO_FLAG_CANFAIL |
+			    ZIO_FLAG_DONT_RETRY | ZIO_FLAG_DONT_PROPAGATE));
+		}
+	}
+
+	mutex_exit(&msp->ms_lock);
+}
+
 /*
  * Called after a transaction group has completely synced to mark
  * all of the metaslab's free space as usable.
@@ -592,22 +999,104 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 	 * future allocations have synced.  (If we unloaded it now and then
 	 * loaded a moment later, the map wouldn't reflect those allocations.)
 	 */
-	if (sm->sm_loaded && (msp->ms_weight & METASLAB_ACTIVE_MASK) == 0) {
-		int evictable = 1;
+	if (sm->sm_loaded && (msp->ms_weight & METASLAB_ACTIVE_MASK) == 0)
+		metaslab_evict(msp, txg);
 
-		for (t = 1; t < TXG_CONCURRENT_STATES; t++)
-			if (msp->ms_allocmap[(txg + t) & TXG_MASK].sm_space)
-				evictable = 0;
+	metaslab_group_sort(mg, msp, metaslab_weight(msp));
+
+	mutex_exit(&msp->ms_lock);
+}
+
+/*
+ * Return the fragmentation of a group's free space: the average over its
+ * metaslabs whose maps have been loaded at least once.
+ */
+uint64_t
+metaslab_group_fragmentation(metaslab_group_t *mg)
+{
+	vdev_t *vd = mg->mg_vd;
+	uint64_t frag = 0, valid = 0;
+	int m;
+
+	for (m = 0; m < vd->vdev_ms_count; m++) {
+		metaslab_t *msp = vd->vdev_ms[m];
 
-		if (evictable)
-			space_map_unload(sm);
+		if (msp == NULL || msp->ms_fragmentation == ZFS_FRAG_INVALID)
+			continue;
+		frag += msp->ms_fragmentation;
+		valid++;
 	}
 
-	metaslab_group_sort(mg, msp, metaslab_weight(msp));
+	if (valid == 0)
+		return (ZFS_FRAG_INVALID);
+
+	return (frag / valid);
+}
+
+/*
+ * Load a metaslab's space map ahead of need.  Runs from the pool's
+ * preload taskq; see metaslab_group_preload().
+ */
+static void
+metaslab_preload(void *arg)
+{
+	metaslab_t *msp = arg;
+	spa_t *spa = msp->ms_group->mg_vd->vdev_spa;
 
+	mutex_enter(&msp->ms_lock);
+	if (!msp->ms_map.sm_loaded) {
+		(void) space_map_load(&msp->ms_map, zfs_metaslab_ops,
+		    SM_FREE, &msp->ms_smo, spa->spa_meta_objset);
+		MSSTAT_BUMP(msstat_preloads);
+	}
+	msp->ms_preload_pending = B_FALSE;
 	mutex_exit(&msp->ms_lock);
 }
 
+/*
+ * Called once per txg after the group's metaslabs have synced.  Mark
+ * the metaslab_preload_limit highest-weight metaslabs as recently used
+ * and queue any that aren't loaded; then unload inactive maps that have
+ * gone cold.
+ */
+void
+metaslab_group_preload(metaslab_group_t *mg, uint64_t txg)
+{
+	vdev_t *vd = mg->mg_vd;
+	spa_t *spa = vd->vdev_spa;
+	avl_tree_t *t = &mg->mg_metaslab_tree;
+	metaslab_t *msp;
+	uint64_t m;
+	int i = 0;
+
+	if (metaslab_preload_enabled && spa->spa_metaslab_taskq != NULL) {
+		mutex_enter(&mg->mg_lock);
+		for (msp = avl_first(t); msp != NULL && msp->ms_weight != 0 &&
+		    i < metaslab_preload_limit; msp = AVL_NEXT(t, msp), i++) {
+			msp->ms_access_txg = txg;
+			if (msp->ms_map.sm_loaded || msp->ms_preload_pending)
+				continue;
+			msp->ms_preload_pending = B_TRUE;
+			if (taskq_dispatch(spa->spa_metaslab_taskq,
+			    metaslab_preload, msp, TQ_NOSLEEP) == 0)
+				msp->ms_preload_pending = B_FALSE;
+		}
+		mutex_exit(&mg->mg_lock);
+	}
+
+	for (m = 0; m < vd->vdev_ms_count; m++) {
+		msp = vd->vdev_ms[m];
+		if (msp == NULL || !msp->ms_map.sm_loaded)
+			continue;
+		mutex_enter(&msp->ms_lock);
+		if (msp->ms_map.sm_loaded && !msp->ms_map.sm_loading &&
+		    (msp->ms_weight & METASLAB_ACTIVE_MASK) == 0 &&
+		    msp->ms_freemap[0].sm_size != 0)
+			metaslab_evict(msp, txg);
+		mutex_exit(&msp->ms_lock);
+	}
+}
+
 static uint64_t
 metaslab_distance(metaslab_t *msp, dva_t *dva)
 {
@@ -703,6 +1192,8 @@ metaslab_group_alloc(metaslab_group_t *mg, uint64_t size, uint64_t txg,
 	if (msp->ms_allocmap[txg & TXG_MASK].sm_space == 0)
 		vdev_dirty(mg->mg_vd, VDD_METASLAB, msp, txg);
 
+	msp->ms_access_txg = txg;
+
 	space_map_add(&msp->ms_allocmap[txg & TXG_MASK], offset, size);
 
 	mutex_exit(&msp->ms_lock);
@@ -721,6 +1212,8 @@ metaslab_alloc_dva(spa_t *spa, metaslab_class_t *mc, uint64_t psize,
 	vdev_t *vd;
 	int dshift = 3;
 	int all_zero;
+	boolean_t throttle = (hintdva == NULL);
+	boolean_t throttled;
 	uint64_t offset = -1ULL;
 	uint64_t asize;
 	uint64_t distance;
@@ -748,6 +1241,10 @@ metaslab_alloc_dva(spa_t *spa, metaslab_class_t *mc, uint64_t psize,
 	 * ourselves on the same vdev as our gang block header.  That
 	 * way, we can hope for locality in vdev_cache, plus it makes our
 	 * fault domains something tractable.
+	 *
+	 * Groups with more than their share of queued writes are skipped
+	 * on the first pass (see metaslab_group_throttled()), unless we're
+	 * placing a gang member next to its header.
 	 */
 	if (hintdva) {
 		vd = vdev_lookup_top(spa, DVA_GET_VDEV(&hintdva[d]));
@@ -771,11 +1268,20 @@ metaslab_alloc_dva(spa_t *spa, metaslab_class_t *mc, uint64_t psize,
 	rotor = mg;
 top:
 	all_zero = B_TRUE;
+	throttled = B_FALSE;
 	do {
 		vd = mg->mg_vd;
 
 		ASSERT(mg->mg_class == mc);
 
+		if (throttle && metaslab_group_throttled(mg)) {
+			MSSTAT_BUMP(msstat_throttled);
+			throttled = B_TRUE;
+			mc->mc_rotor = mg->mg_next;
+			mc->mc_allocated = 0;
+			continue;
+		}
+
 		distance = vd->vdev_asize >> dshift;
 		if (distance <= (1ULL << vd->vdev_ms_shift))
 			distance = 0;
@@ -832,6 +1338,14 @@ top:
 		mc->mc_allocated = 0;
 	} while ((mg = mg->mg_next) != rotor);
 
+	/*
+	 * If every group we passed over was busy, take the space anyway.
+	 */
+	if (throttled) {
+		throttle = B_FALSE;
+		goto top;
+	}
+
 	if (!all_zero) {
 		dshift++;
 		ASSERT(dshift < 64);
@@ -122,6 +122,7 @@ spa_activate(spa_t *spa)
 
 	spa->spa_normal_class = metaslab_class_create();
 	spa->spa_log_class = metaslab_class_create();
+	spa->spa_special_class = metaslab_class_create();
 
 	for (t = 0; t < ZIO_TYPES; t++) {
 		spa->spa_zio_issue_taskq[t] = taskq_create("spa_zio_issue",
@@ -132,6 +133,9 @@ spa_activate(spa_t *spa)
 		    TASKQ_PREPOPULATE);
 	}
 
+	spa->spa_metaslab_taskq = taskq_create("metaslab_preload",
+	    1, maxclsyspri, 1, INT_MAX, TASKQ_PREPOPULATE);
+
 	list_create(&spa->spa_dirty_list, sizeof (vdev_t),
 	    offsetof(vdev_t, vdev_dirty_node));
 
@@ -172,12 +176,18 @@ spa_deactivate(spa_t *spa)
 		spa->spa_zio_intr_taskq[t] = NULL;
 	}
 
+	taskq_destroy(spa->spa_metaslab_taskq);
+	spa->spa_metaslab_taskq = NULL;
+
 	metaslab_class_destroy(spa->spa_normal_class);
 	spa->spa_normal_class = NULL;
 
 	metaslab_class_destroy(spa->spa_log_class);
 	spa->spa_log_class = NULL;
 
+	metaslab_class_destroy(spa->spa_special_class);
+	spa->spa_special_class = NULL;
+
 	/*
 	 * If this was part of an import or the open otherwise failed, we may
 	 * still have errors left in the queues.  Empty them just in case.
@@ -253,6 +263,12 @@ spa_unload(spa_t *spa)
 		spa->spa_sync_on = B_FALSE;
 	}
 
+	/*
+	 * Wait for any metaslab preloads to finish reading the MOS.
+	 */
+	if (spa->spa_metaslab_taskq != NULL)
+		taskq_wait(spa->spa_metaslab_taskq);
+
 	/*
 	 * Wait for any outstanding prefetch I/O to complete.
 	 */
@@ -712,6 +728,7 @@ spa_load(spa_t *spa, nvlist_t *config, spa_load_state_t state, int mosconfig)
 	}
 
 	spa->spa_delegation = zfs_prop_default_numeric(ZPOOL_PROP_DELEGATION);
+	spa->spa_autotrim = zfs_prop_default_numeric(ZPOOL_PROP_AUTOTRIM);
 
 	error = zap_lookup(spa->spa_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
 	    DMU_POOL_PROPS, sizeof (uint64_t), 1, &spa->spa_pool_props_object);
@@ -736,6 +753,10 @@ spa_load(spa_t *spa, nvlist_t *config, spa_load_state_t state, int mosconfig)
 		    spa->spa_pool_props_object,
 		    zpool_prop_to_name(ZPOOL_PROP_DELEGATION),
 		    sizeof (uint64_t), 1, &spa->spa_delegation);
+		(void) zap_lookup(spa->spa_meta_objset,
+		    spa->spa_pool_props_object,
+		    zpool_prop_to_name(ZPOOL_PROP_AUTOTRIM),
+		    sizeof (uint64_t), 1, &spa->spa_autotrim);
 	}
 
 	/*
@@ -2302,6 +2323,70 @@ spa_vdev_setpath(spa_t *spa, uint64_t guid, const char *newpath)
  * ==========================================================================
  */
 
+/*
+ * Scrub/resilver throttle.  The number of scrub I/Os we keep in flight
+ * floats between zfs_scrub_min_inflight and spa_scrub_maxinflight (which
+ * is zfs_scrub_limit per leaf vdev).  Every zfs_scrub_adjust_interval
+ * ticks we sample the demand reads on each top-level vdev: if any of them
+ * has zfs_scrub_busy_queued or more reads waiting, or its reads have been
+ * waiting zfs_scrub_busy_wait ticks on average, we halve the limit and
+ * delay each scrub I/O.  Once no demand read has been seen for
+ * zfs_scrub_idle ticks we drop the delay and double the limit again.
+ */
+int zfs_scrub_min_inflight = 2;		/* floor for the scrub I/O limit */
+int zfs_scrub_adjust_interval = 10;	/* ticks between adjustments */
+int zfs_scrub_busy_queued = 2;		/* demand reads queued on a vdev */
+int zfs_scrub_busy_wait = 2;		/* average demand read wait (ticks) */
+int zfs_scrub_idle = 50;		/* idle window in ticks */
+int zfs_scrub_delay = 4;		/* ticks to delay each scrub I/O */
+int zfs_resilver_delay = 2;		/* ticks to delay each resilver I/O */
+
+static void
+spa_scrub_adjust(spa_t *spa)
+{
+	vdev_t *rvd = spa->spa_root_vdev;
+	uint64_t now, last = 0;
+	uint64_t floor, limit;
+	boolean_t busy = B_FALSE;
+	int c;
+
+	for (c = 0; c < rvd->vdev_children; c++) {
+		uint64_t queued = 0, wait = 0;
+
+		vdev_queue_demand(rvd->vdev_child[c], &queued, &wait, &last);
+		if (queued >= zfs_scrub_busy_queued ||
+		    (queued != 0 && wait >= zfs_scrub_busy_wait))
+			busy = B_TRUE;
+	}
+	now = lbolt64;
+
+	mutex_enter(&spa->spa_scrub_lock);
+
+	floor = MIN(zfs_scrub_min_inflight, spa->spa_scrub_maxinflight);
+	floor = MAX(floor, 1);
+	limit = spa->spa_scrub_limit;
+
+	if (busy) {
+		limit = MAX(limit >> 1, floor);
+		spa->spa_scrub_delay = (spa->spa_scrub_type ==
+		    POOL_SCRUB_RESILVER) ? zfs_resilver_delay : zfs_scrub_delay;
+	} else if (now - last >= zfs_scrub_idle) {
+		limit = MIN(limit << 1, spa->spa_scrub_maxinflight);
+		spa->spa_scrub_delay = 0;
+	}
+
+	/*
+	 * The ceiling moves as leaf vdevs come and go.
+	 */
+	spa->spa_scrub_limit = MAX(MIN(limit, spa->spa_scrub_maxinflight),
+	    floor);
+	if (spa->spa_scrub_inflight < spa->spa_scrub_limit)
+		cv_broadcast(&spa->spa_scrub_io_cv);
+
+	spa->spa_scrub_adjusted = now;
+	mutex_exit(&spa->spa_scrub_lock);
+}
+
 static void
 spa_scrub_io_done(zio_t *zio)
 {
@@ -2318,7 +2403,7 @@ spa_scrub_io_done(zio_t *zio)
 		mutex_exit(&vd->vdev_stat_lock);
 	}
 
-	if (--spa->spa_scrub_inflight < spa->spa_scrub_maxinflight)
+	if (--spa->spa_scrub_inflight < spa->spa_scrub_limit)
 		cv_broadcast(&spa->spa_scrub_io_cv);
 
 	ASSERT(spa->spa_scrub_inflight >= 0);
@@ -2331,18 +2416,33 @@ spa_scrub_io_start(spa_t *spa, blkptr_t *bp, int priority, int flags,
     zbookmark_t *zb)
 {
 	size_t size = BP_GET_LSIZE(bp);
+	uint64_t scrub_delay;
 	void *data;
 
+	/*
+	 * Only the scrub thread issues scrub I/O, so it is the only one
+	 * that updates spa_scrub_adjusted.
+	 */
+	if (lbolt64 - spa->spa_scrub_adjusted >= zfs_scrub_adjust_interval)
+		spa_scrub_adjust(spa);
+
 	mutex_enter(&spa->spa_scrub_lock);
 	/*
 	 * Do not give too much work to vdev(s).
 	 */
-	while (spa->spa_scrub_inflight >= spa->spa_scrub_maxinflight) {
+	while (spa->spa_scrub_inflight >= spa->spa_scrub_limit) {
 		cv_wait(&spa->spa_scrub_io_cv, &spa->spa_scrub_lock);
 	}
 	spa->spa_scrub_inflight++;
+	scrub_delay = spa->spa_scrub_delay;
 	mutex_exit(&spa->spa_scrub_lock);
 
+	/*
+	 * Foreground I/O is waiting behind us; give it a chance to run.
+	 */
+	if (scrub_delay != 0 && !spa_traverse_wanted(spa))
+		delay(scrub_delay);
+
 	data = arc_data_buf_alloc(size);
 
 	if (zb->zb_level == -1 && BP_GET_TYPE(bp) != DMU_OT_OBJSET)
@@ -2454,6 +2554,9 @@ spa_scrub_thread(spa_t *spa)
 	mutex_enter(&spa->spa_scrub_lock);
 	spa->spa_scrub_errors = 0;
 	spa->spa_scrub_active = 1;
+	spa->spa_scrub_limit = spa->spa_scrub_maxinflight;
+	spa->spa_scrub_delay = 0;
+	spa->spa_scrub_adjusted = lbolt64;
 	ASSERT(spa->spa_scrub_inflight == 0);
 
 	while (!spa->spa_scrub_stop) {
@@ -2548,6 +2651,8 @@ spa_scrub_thread(spa_t *spa)
 
 	spa->spa_scrub_type = POOL_SCRUB_NONE;
 	spa->spa_scrub_active = 0;
+	spa->spa_scrub_limit = 0;
+	spa->spa_scrub_delay = 0;
 	spa->spa_scrub_thread = NULL;
 	cv_broadcast(&spa->spa_scrub_cv);
 	CALLB_CPR_EXIT(&cprinfo);	/* drops &spa->spa_scrub_lock */
@@ -3014,6 +3119,16 @@ spa_sync_props(void *arg1, void *arg2, cred_t *cr, dmu_tx_t *tx)
 			    zpool_prop_to_name(ZPOOL_PROP_AUTOREPLACE), 8, 1,
 			    &intval, tx) == 0);
 			break;
+
+		case ZPOOL_PROP_AUTOTRIM:
+			VERIFY(nvlist_lookup_uint64(nvp,
+			    nvpair_name(nvpair), &intval) == 0);
+			VERIFY(zap_update(mos,
+			    spa->spa_pool_props_object,
+			    zpool_prop_to_name(ZPOOL_PROP_AUTOTRIM), 8, 1,
+			    &intval, tx) == 0);
+			spa->spa_autotrim = intval;
+			break;
 		}
 		spa_history_internal_log(LOG_POOL_PROPSET,
 		    spa, tx, cr, "%s %lld %s",
@@ -3022,6 +3137,26 @@ spa_sync_props(void *arg1, void *arg2, cred_t *cr, dmu_tx_t *tx)
 	}
 }
 
+/*
+ * Bytes written to the pool so far, as counted by the top-level vdevs.
+ */
+static uint64_t
+spa_bytes_written(spa_t *spa)
+{
+	vdev_t *rvd = spa->spa_root_vdev;
+	uint64_t bytes = 0;
+	int c;
+
+	for (c = 0; c < rvd->vdev_children; c++) {
+		vdev_t *cvd = rvd->vdev_child[c];
+
+		mutex_enter(&cvd->vdev_stat_lock);
+		bytes += cvd->vdev_stat.vs_bytes[ZIO_TYPE_WRITE];
+		mutex_exit(&cvd->vdev_stat_lock);
+	}
+	return (bytes);
+}
+
 /*
  * Sync the specified transaction group.  New blocks may be dirtied as
  * part of the process, so we iterate until it converges.
@@ -3036,12 +3171,19 @@ spa_sync(spa_t *spa, uint64_t txg)
 	vdev_t *vd;
 	dmu_tx_t *tx;
 	int dirty_vdevs;
+	int c;
+	uint64_t ndirty, nwritten, ndeferred;
 
 	/*
 	 * Lock out configuration changes.
 	 */
 	spa_config_enter(spa, RW_READER, FTAG);
 
+	mutex_enter(&dp->dp_lock);
+	ndirty = dp->dp_dirty_pertxg[txg & TXG_MASK];
+	mutex_exit(&dp->dp_lock);
+	nwritten = spa_bytes_written(spa);
+
 	spa->spa_syncing_txg = txg;
 	spa->spa_sync_pass = 0;
 
@@ -3100,6 +3242,7 @@ spa_sync(spa_t *spa, uint64_t txg)
 		bplist_sync(bpl, tx);
 	} while (dirty_vdevs);
 
+	ndeferred = bplist_count(bpl);
 	bplist_close(bpl);
 
 	dprintf("txg %llu passes %d\n", txg, spa->spa_sync_pass);
@@ -3133,6 +3276,9 @@ spa_sync(spa_t *spa, uint64_t txg)
 
 	dmu_tx_commit(tx);
 
+	txg_history_sync_stats(dp, txg, ndirty,
+	    spa_bytes_written(spa) - nwritten, spa->spa_sync_pass, ndeferred);
+
 	/*
 	 * Clear the dirty config list.
 	 */
@@ -3169,12 +3315,40 @@ spa_sync(spa_t *spa, uint64_t txg)
 	 */
 	dsl_pool_zil_clean(dp);
 
+	/*
+	 * If autotrim is on, discard everything freed in this txg before
+	 * vdev_sync_done() makes it allocatable again.
+	 */
+	if (spa->spa_autotrim) {
+		zio_t *zio = zio_root(spa, NULL, NULL,
+		    ZIO_FLAG_CONFIG_HELD | ZIO_FLAG_CANFAIL);
+
+		vd = txg_list_head(&spa->spa_vdev_txg_list, TXG_CLEAN(txg));
+		while (vd != NULL) {
+			vdev_trim(vd, txg, zio);
+			vd = txg_list_next(&spa->spa_vdev_txg_list, vd,
+			    TXG_CLEAN(txg));
+		}
+
+		(void) zio_wait(zio);
+	}
+
 	/*
 	 * Update usable space statistics.
 	 */
 	while (vd = txg_list_remove(&spa->spa_vdev_txg_list, TXG_CLEAN(txg)))
 		vdev_sync_done(vd, txg);
 
+	/*
+	 * Get the metaslabs we're likely to allocate from next loaded
+	 * before we need them, and unload the ones that have gone cold.
+	 */
+	for (c = 0; c < rvd->vdev_children; c++) {
+		vd = rvd->vdev_child[c];
+		if (vd->vdev_mg != NULL && vd->vdev_ms != NULL)
+			metaslab_group_preload(vd->vdev_mg, txg);
+	}
+
 	/*
 	 * It had better be the case that we didn't dirty anything
 	 * since vdev_config_sync().
@@ -3322,8 +3496,18 @@ spa_get_props(spa_t *spa, nvlist_t **nvp)
 
 	VERIFY(nvlist_alloc(nvp, NV_UNIQUE_NAME, KM_SLEEP) == 0);
 
+	/* "freeing" is not stored; it comes from the pool's free queue */
+	VERIFY(nvlist_alloc(&propval, NV_UNIQUE_NAME, KM_SLEEP) == 0);
+	VERIFY(nvlist_add_uint64(propval, ZFS_PROP_SOURCE,
+	    ZFS_SRC_NONE) == 0);
+	VERIFY(nvlist_add_uint64(propval, ZFS_PROP_VALUE,
+	    dsl_pool_freeing(spa_get_dsl(spa))) == 0);
+	VERIFY(nvlist_add_nvlist(*nvp, zpool_prop_to_name(ZPOOL_PROP_FREEING),
+	    propval) == 0);
+	nvlist_free(propval);
+
 	mutex_enter(&spa->spa_props_lock);
-	/* If no props object, then just return empty nvlist */
+	/* If no props object, then just return the computed ones */
 	if (spa->spa_pool_props_object == 0) {
 		mutex_exit(&spa->spa_props_lock);
 		return (0);
@@ -1014,6 +1014,17 @@ spa_max_replication(spa_t *spa)
 	return (MIN(SPA_DVAS_PER_BP, spa_max_replication_override));
 }
 
+/*
+ * Return the largest block size this pool's on-disk version allows.
+ */
+uint64_t
+spa_maxblocksize(spa_t *spa)
+{
+	if (spa_version(spa) < SPA_VERSION_LARGE_BLOCKS)
+		return (SPA_OLD_MAXBLOCKSIZE);
+	return (SPA_MAXBLOCKSIZE);
+}
+
 uint64_t
 bp_get_dasize(spa_t *spa, const blkptr_t *bp)
 {
@@ -1079,6 +1090,7 @@ spa_init(int mode)
 	refcount_init();
 	unique_init();
 	zio_init();
+	metaslab_stat_init();
 	dmu_init();
 	zil_init();
 	zfs_prop_init();
@@ -1092,6 +1104,7 @@ spa_fini(void)
 
 	zil_fini();
 	dmu_fini();
+	metaslab_stat_fini();
 	zio_fini();
 	unique_fini();
 	refcount_fini();
@@ -1114,3 +1127,13 @@ spa_has_slogs(spa_t *spa)
 {
 	return (spa->spa_log_class->mc_rotor != NULL);
 }
+
+/*
+ * Return whether this pool has special (metadata) vdevs.  As with
+ * spa_has_slogs(), no locking is needed.
+ */
+boolean_t
+spa_has_special(spa_t *spa)
+{
+	return (spa->spa_special_class->mc_rotor != NULL);
+}
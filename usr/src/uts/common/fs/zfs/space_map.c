@@ -54,6 +54,28 @@ space_map_seg_compare(const void *x1, const void *x2)
 	return (0);
 }
 
+/*
+ * Keep the segment size histogram in step with the segments in sm_root.
+ */
+static void
+space_map_hist_add(space_map_t *sm, space_seg_t *ss)
+{
+	int idx = highbit(ss->ss_end - ss->ss_start) - 1;
+
+	ASSERT(idx >= 0 && idx < SPACE_MAP_HISTOGRAM_SIZE);
+	sm->sm_hist[idx]++;
+}
+
+static void
+space_map_hist_remove(space_map_t *sm, space_seg_t *ss)
+{
+	int idx = highbit(ss->ss_end - ss->ss_start) - 1;
+
+	ASSERT(idx >= 0 && idx < SPACE_MAP_HISTOGRAM_SIZE);
+	ASSERT(sm->sm_hist[idx] != 0);
+	sm->sm_hist[idx]--;
+}
+
 void
 space_map_create(space_map_t *sm, uint64_t start, uint64_t size, uint8_t shift,
 	kmutex_t *lp)
@@ -113,14 +135,33 @@ space_map_add(space_map_t *sm, uint64_t start, uint64_t size)
 	merge_before = (ss_before != NULL && ss_before->ss_end == start);
 	merge_after = (ss_after != NULL && ss_after->ss_start == end);
 
+	/*
+	 * The picker-private tree may be sorted by segment size, so any
+	 * segment whose size changes must be taken out and put back.
+	 */
 	if (merge_before && merge_after) {
 		avl_remove(&sm->sm_root, ss_before);
+		if (sm->sm_pp_root) {
+			avl_remove(sm->sm_pp_root, ss_before);
+			avl_remove(sm->sm_pp_root, ss_after);
+		}
+		space_map_hist_remove(sm, ss_before);
+		space_map_hist_remove(sm, ss_after);
 		ss_after->ss_start = ss_before->ss_start;
 		kmem_free(ss_before, sizeof (*ss_before));
+		ss = ss_after;
 	} else if (merge_before) {
+		if (sm->sm_pp_root)
+			avl_remove(sm->sm_pp_root, ss_before);
+		space_map_hist_remove(sm, ss_before);
 		ss_before->ss_end = end;
+		ss = ss_before;
 	} else if (merge_after) {
+		if (sm->sm_pp_root)
+			avl_remove(sm->sm_pp_root, ss_after);
+		space_map_hist_remove(sm, ss_after);
 		ss_after->ss_start = start;
+		ss = ss_after;
 	} else {
 		ss = kmem_alloc(sizeof (*ss), KM_SLEEP);
 		ss->ss_start = start;
@@ -128,6 +169,10 @@ space_map_add(space_map_t *sm, uint64_t start, uint64_t size)
 		avl_insert(&sm->sm_root, ss, where);
 	}
 
+	if (sm->sm_pp_root)
+		avl_add(sm->sm_pp_root, ss);
+	space_map_hist_add(sm, ss);
+
 	sm->sm_space += size;
 }
 
@@ -162,12 +207,19 @@ space_map_remove(space_map_t *sm, uint64_t start, uint64_t size)
 	left_over = (ss->ss_start != start);
 	right_over = (ss->ss_end != end);
 
+	if (sm->sm_pp_root)
+		avl_remove(sm->sm_pp_root, ss);
+	space_map_hist_remove(sm, ss);
+
 	if (left_over && right_over) {
 		newseg = kmem_alloc(sizeof (*newseg), KM_SLEEP);
 		newseg->ss_start = end;
 		newseg->ss_end = ss->ss_end;
 		ss->ss_end = start;
 		avl_insert_here(&sm->sm_root, newseg, ss, AVL_AFTER);
+		if (sm->sm_pp_root)
+			avl_add(sm->sm_pp_root, newseg);
+		space_map_hist_add(sm, newseg);
 	} else if (left_over) {
 		ss->ss_end = start;
 	} else if (right_over) {
@@ -175,6 +227,13 @@ space_map_remove(space_map_t *sm, uint64_t start, uint64_t size)
 	} else {
 		avl_remove(&sm->sm_root, ss);
 		kmem_free(ss, sizeof (*ss));
+		ss = NULL;
+	}
+
+	if (ss != NULL) {
+		if (sm->sm_pp_root)
+			avl_add(sm->sm_pp_root, ss);
+		space_map_hist_add(sm, ss);
 	}
 
 	sm->sm_space -= size;
@@ -207,11 +266,18 @@ space_map_vacate(space_map_t *sm, space_map_func_t *func, space_map_t *mdest)
 
 	ASSERT(MUTEX_HELD(sm->sm_lock));
 
+	if (sm->sm_pp_root) {
+		while (avl_destroy_nodes(sm->sm_pp_root, &cookie) != NULL)
+			continue;
+		cookie = NULL;
+	}
+
 	while ((ss = avl_destroy_nodes(&sm->sm_root, &cookie)) != NULL) {
 		if (func != NULL)
 			func(mdest, ss->ss_start, ss->ss_end - ss->ss_start);
 		kmem_free(ss, sizeof (*ss));
 	}
+	bzero(sm->sm_hist, sizeof (sm->sm_hist));
 	sm->sm_space = 0;
 }
 
@@ -275,6 +341,63 @@ space_map_union(space_map_t *smd, space_map_t *sms)
 	}
 }
 
+/*
+ * How badly a free segment of a given size is fragmented, in percent,
+ * indexed by power of two starting at SPA_MINBLOCKSIZE.  Segments of
+ * 16M and larger count as unfragmented.
+ */
+static const uint64_t space_map_frag_table[] = {
+	100,	/* 512B	*/
+	100,	/* 1K	*/
+	98,	/* 2K	*/
+	95,	/* 4K	*/
+	90,	/* 8K	*/
+	80,	/* 16K	*/
+	70,	/* 32K	*/
+	60,	/* 64K	*/
+	50,	/* 128K	*/
+	40,	/* 256K	*/
+	30,	/* 512K	*/
+	20,	/* 1M	*/
+	15,	/* 2M	*/
+	10,	/* 4M	*/
+	5,	/* 8M	*/
+	0	/* 16M	*/
+};
+
+#define	SPACE_MAP_FRAG_TABLE_SIZE	\
+	(sizeof (space_map_frag_table) / sizeof (space_map_frag_table[0]))
+
+/*
+ * Return the fragmentation of the free space in sm, as a percentage:
+ * the average of space_map_frag_table over the segment size histogram,
+ * weighted by the space in each bucket.
+ */
+uint64_t
+space_map_fragmentation(space_map_t *sm)
+{
+	uint64_t frag = 0, total = 0;
+	int i, idx;
+
+	for (i = 0; i < SPACE_MAP_HISTOGRAM_SIZE; i++) {
+		uint64_t space;
+
+		if (sm->sm_hist[i] == 0)
+			continue;
+
+		space = sm->sm_hist[i] << i;
+		idx = MAX(i - SPA_MINBLOCKSHIFT, 0);
+		idx = MIN(idx, SPACE_MAP_FRAG_TABLE_SIZE - 1);
+		frag += space * space_map_frag_table[idx] / 100;
+		total += space;
+	}
+
+	if (total == 0)
+		return (0);
+
+	return (frag * 100 / total);
+}
+
 /*
  * Wait for any in-progress space_map_load() to complete.
  */
@@ -450,6 +573,7 @@ space_map_sync(space_map_t *sm, uint8_t maptype,
 		size = ss->ss_end - ss->ss_start;
 		start = (ss->ss_start - sm->sm_start) >> sm->sm_shift;
 
+		space_map_hist_remove(sm, ss);
 		sm->sm_space -= size;
 		size >>= sm->sm_shift;
 
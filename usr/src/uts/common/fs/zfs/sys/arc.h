@@ -102,6 +102,7 @@ int arc_buf_evict(arc_buf_t *buf);
 void arc_flush(void);
 void arc_tempreserve_clear(uint64_t tempreserve);
 int arc_tempreserve_space(uint64_t tempreserve);
+uint64_t arc_target_size(void);
 
 void arc_init(void);
 void arc_fini(void);
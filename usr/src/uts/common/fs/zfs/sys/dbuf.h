@@ -64,13 +64,20 @@ extern "C" {
  *		|		^
  *		|		|
  *		+----> FILL ----+
+ *		|		|
+ *		+--> PARTIAL ---+
+ *
+ * PARTIAL is a level-0 dbuf dirtied by a write covering only part of
+ * it, whose old contents are still being read in (see
+ * dbuf_will_dirty_range()).
  */
 typedef enum dbuf_states {
 	DB_UNCACHED,
 	DB_FILL,
 	DB_READ,
 	DB_CACHED,
-	DB_EVICTING
+	DB_EVICTING,
+	DB_PARTIAL
 } dbuf_states_t;
 
 struct objset_impl;
@@ -213,6 +220,12 @@ typedef struct dmu_buf_impl {
 	 */
 	list_node_t db_link;
 
+	/*
+	 * Our link on the cache of unreferenced dbufs (see dbuf_rele()).
+	 * Protected by dbuf_cache_lock, and only changed with db_mtx held.
+	 */
+	list_node_t db_cache_link;
+
 	/* Data which is unique to data (leaf) blocks: */
 
 	/* stuff we store for the user (see dmu_buf_set_user) */
@@ -224,15 +237,35 @@ typedef struct dmu_buf_impl {
 	uint8_t db_freed_in_flight;
 
 	uint8_t db_dirtycnt;
+
+	/*
+	 * While DB_PARTIAL, the byte range of db_data written so far; the
+	 * rest is filled in from the old block when its read completes.
+	 * Protected by db_mtx.
+	 */
+	uint32_t db_partial_start;
+	uint32_t db_partial_end;
 } dmu_buf_impl_t;
 
-/* Note: the dbuf hash table is exposed only for the mdb module */
-#define	DBUF_MUTEXES 256
-#define	DBUF_HASH_MUTEX(h, idx) (&(h)->hash_mutexes[(idx) & (DBUF_MUTEXES-1)])
+/*
+ * Note: the dbuf hash table is exposed only for the mdb module.
+ *
+ * The table grows online: hash_grow_table (twice the size) is filled
+ * one bucket at a time, and buckets below hash_grow_split have moved.
+ * There are never more mutexes than buckets, so a bucket's mutex also
+ * covers the two buckets it splits into, and every field here may be
+ * read under the mutex of the bucket being looked at.
+ */
+#define	DBUF_MUTEXES 256	/* minimum; scaled with the number of CPUs */
+#define	DBUF_HASH_MUTEX(h, hv) (&(h)->hash_mutexes[(hv) & (h)->hash_mutex_mask])
 typedef struct dbuf_hash_table {
 	uint64_t hash_table_mask;
 	dmu_buf_impl_t **hash_table;
-	kmutex_t hash_mutexes[DBUF_MUTEXES];
+	dmu_buf_impl_t **hash_grow_table;
+	ulong_t hash_grow_split;
+	uint32_t hash_growing;
+	uint64_t hash_mutex_mask;
+	kmutex_t *hash_mutexes;
 } dbuf_hash_table_t;
 
 
@@ -248,6 +281,7 @@ int dbuf_hold_impl(struct dnode *dn, uint8_t level, uint64_t blkid, int create,
     void *tag, dmu_buf_impl_t **dbp);
 
 void dbuf_prefetch(struct dnode *dn, uint64_t blkid);
+void dbuf_prefetch_level(struct dnode *dn, int level, uint64_t blkid);
 
 void dbuf_add_ref(dmu_buf_impl_t *db, void *tag);
 uint64_t dbuf_refcount(dmu_buf_impl_t *db);
@@ -258,6 +292,8 @@ dmu_buf_impl_t *dbuf_find(struct dnode *dn, uint8_t level, uint64_t blkid);
 
 int dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags);
 void dbuf_will_dirty(dmu_buf_impl_t *db, dmu_tx_t *tx);
+void dbuf_will_dirty_range(dmu_buf_impl_t *db, uint64_t off, uint64_t len,
+    dmu_tx_t *tx);
 void dmu_buf_will_fill(dmu_buf_t *db, dmu_tx_t *tx);
 void dbuf_fill_done(dmu_buf_impl_t *db, dmu_tx_t *tx);
 void dmu_buf_will_fill(dmu_buf_t *db, dmu_tx_t *tx);
@@ -85,7 +85,7 @@ extern "C" {
  *   	dmu_object_info_from_dnode: dn_dirty_mtx (dn_datablksz)
  *   	dmu_tx_count_free:
  *   	dbuf_read_impl: db_mtx, dmu_zfetch()
- *   	dmu_zfetch: zf_rwlock/r, zst_lock, dbuf_prefetch()
+ *   	dmu_zfetch: zf_rwlock/r, zst_lock; then dbuf_prefetch[_level]()
  *   	dbuf_new_size: db_mtx
  *   	dbuf_dirty: db_mtx
  *	dbuf_findbp: (callers, phys? - the real need)
@@ -120,10 +120,11 @@ extern "C" {
  *   	dbuf_find: db_mtx
  *   	dbuf_hash_insert: db_mtx
  *   	dbuf_hash_remove: db_mtx
+ *   	dbuf_hash_grow (all of them, to switch tables)
  *
  * db_mtx (meta-leaf)
  *   must be held before:
- *   	dn_mtx, dn_dirty_mtx, dd_lock (leaf mutexes)
+ *   	dn_mtx, dn_dirty_mtx, dd_lock, dbuf_cache_lock (leaf mutexes)
  *   protects:
  *   	db_state
  * 	db_holds
@@ -147,6 +148,7 @@ extern "C" {
  * 	dmu_evict_user: none (db_d) (maybe can eliminate)
  *   	dbuf_find: none (db_holds)
  *   	dbuf_hash_insert: none (db_holds)
+ *   	dbuf_cache_evict: dbuf_cache_lock (tryenter only)
  *   	dmu_buf_read_array_impl: none (db_state, db_changed)
  *   	dmu_sync: none (db_dirty_node, db_d)
  *   	dnode_reallocate: none (db)
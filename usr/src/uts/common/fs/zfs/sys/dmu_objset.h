@@ -69,6 +69,8 @@ typedef struct objset_impl {
 	uint8_t os_checksum;	/* can change, under dsl_dir's locks */
 	uint8_t os_compress;	/* can change, under dsl_dir's locks */
 	uint8_t os_copies;	/* can change, under dsl_dir's locks */
+	uint8_t os_logbias;	/* can change, under dsl_dir's locks */
+	uint8_t os_sync;	/* can change, under dsl_dir's locks */
 	uint8_t os_md_checksum;
 	uint8_t os_md_compress;
 
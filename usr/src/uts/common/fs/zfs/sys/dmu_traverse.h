@@ -46,6 +46,7 @@ extern "C" {
 #define	ADVANCE_HOLES	0x08		/* visit holes */
 #define	ADVANCE_ZIL	0x10		/* visit intent log blocks */
 #define	ADVANCE_NOLOCK	0x20		/* Don't grab SPA sync lock */
+#define	ADVANCE_DESTROYED 0x40		/* visit destroyed datasets */
 
 #define	ZB_NO_LEVEL	-2
 #define	ZB_MAXLEVEL	32		/* Next power of 2 >= DN_MAX_LEVELS */
@@ -110,6 +111,8 @@ void traverse_add_dnode(traverse_handle_t *th,
 void traverse_add_objset(traverse_handle_t *th,
     uint64_t mintxg, uint64_t maxtxg, uint64_t objset);
 void traverse_add_pool(traverse_handle_t *th, uint64_t mintxg, uint64_t maxtxg);
+void traverse_resume_objset(traverse_handle_t *th,
+    uint64_t mintxg, uint64_t maxtxg, const zbookmark_t *zb);
 
 int traverse_more(traverse_handle_t *th);
 
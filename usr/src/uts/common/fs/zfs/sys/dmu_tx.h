@@ -60,6 +60,8 @@ struct dmu_tx {
 	void *tx_tempreserve_cookie;
 	struct dmu_tx_hold *tx_needassign_txh;
 	uint8_t tx_anyobj;
+	uint8_t tx_wait_dirty;		/* throttled; dmu_tx_wait() delays */
+	uint8_t tx_dirty_delayed;	/* already delayed once */
 	int tx_err;
 #ifdef ZFS_DEBUG
 	uint64_t tx_space_towrite;
@@ -54,6 +54,11 @@ typedef void dsl_dataset_evict_func_t(struct dsl_dataset *, void *);
  * clone should not be promoted).
  */
 #define	DS_FLAG_NOPROMOTE	(1ULL<<1)
+/*
+ * The dataset has been destroyed and its blocks are on the pool's free
+ * queue; only the queue's traversal may look below its ds_bp.
+ */
+#define	DS_FLAG_DESTROYING	(1ULL<<2)
 
 typedef struct dsl_dataset_phys {
 	uint64_t ds_dir_obj;
@@ -81,6 +86,21 @@ typedef struct dsl_dataset_phys {
 	uint64_t ds_pad[8]; /* pad out to 320 bytes for good measure */
 } dsl_dataset_phys_t;
 
+/*
+ * An entry in the pool's free queue (DMU_POOL_FREE_QUEUE), keyed by the
+ * destroyed dataset's object number in hex.
+ */
+typedef struct dsl_free_entry {
+	uint64_t	fe_mintxg;	/* free blocks born after this txg */
+	uint64_t	fe_used;	/* space still charged to the root */
+	uint64_t	fe_compressed;
+	uint64_t	fe_uncompressed;
+	zbookmark_t	fe_bookmark;	/* where the traversal resumes */
+} dsl_free_entry_t;
+
+#define	DSL_FREE_ENTRY_INTS	\
+	(sizeof (dsl_free_entry_t) / sizeof (uint64_t))
+
 typedef struct dsl_dataset {
 	/* Immutable: */
 	struct dsl_dir *ds_dir;
@@ -169,6 +189,9 @@ void dsl_dataset_create_root(struct dsl_pool *dp, uint64_t *ddobjp,
 
 int dsl_dsobj_to_dsname(char *pname, uint64_t obj, char *buf);
 
+int dsl_dataset_free_queue_load(struct dsl_pool *dp);
+void dsl_dataset_free_queue_sync(struct dsl_pool *dp, dmu_tx_t *tx);
+
 #ifdef ZFS_DEBUG
 #define	dprintf_ds(ds, fmt, ...) do { \
 	if (zfs_flags & ZFS_DEBUG_DPRINTF) { \
@@ -39,6 +39,7 @@ extern "C" {
 
 struct objset;
 struct dsl_dir;
+struct dmu_tx;
 
 typedef struct dsl_pool {
 	/* Immutable */
@@ -52,6 +53,20 @@ typedef struct dsl_pool {
 	blkptr_t dp_meta_rootbp;
 	list_t dp_synced_objsets;
 
+	/* Dirty data accounting for the write throttle; uses dp_lock */
+	kmutex_t dp_lock;
+	kcondvar_t dp_spaceavail_cv;
+	uint64_t dp_dirty_pertxg[TXG_SIZE];
+	uint64_t dp_dirty_total;
+	hrtime_t dp_last_wakeup;
+
+	/* Syncs objsets and their dirty dnodes in parallel */
+	taskq_t *dp_sync_taskq;
+
+	/* Destroyed datasets whose blocks are still being freed */
+	uint64_t dp_free_queue_obj;	/* sync context only */
+	uint64_t dp_freeing;		/* uses dp_lock */
+
 	/* Has its own locking */
 	tx_state_t dp_tx;
 	txg_list_t dp_dirty_datasets;
@@ -74,6 +89,13 @@ void dsl_pool_sync(dsl_pool_t *dp, uint64_t txg);
 void dsl_pool_zil_clean(dsl_pool_t *dp);
 int dsl_pool_sync_context(dsl_pool_t *dp);
 uint64_t dsl_pool_adjustedsize(dsl_pool_t *dp, boolean_t netfree);
+void dsl_pool_dirty_space(dsl_pool_t *dp, int64_t space, struct dmu_tx *tx);
+boolean_t dsl_pool_need_dirty_delay(dsl_pool_t *dp);
+boolean_t dsl_pool_need_dirty_sync(dsl_pool_t *dp, uint64_t txg);
+void dsl_pool_dirty_delay(dsl_pool_t *dp);
+uint64_t dsl_pool_freeing(dsl_pool_t *dp);
+void dsl_pool_init(void);
+void dsl_pool_fini(void);
 
 #ifdef	__cplusplus
 }
@@ -46,6 +46,18 @@ extern metaslab_t *metaslab_init(metaslab_group_t *mg, space_map_obj_t *smo,
 extern void metaslab_fini(metaslab_t *msp);
 extern void metaslab_sync(metaslab_t *msp, uint64_t txg);
 extern void metaslab_sync_done(metaslab_t *msp, uint64_t txg);
+extern void metaslab_trim(metaslab_t *msp, uint64_t txg, zio_t *pio);
+
+extern space_map_ops_t metaslab_ff_ops;
+extern space_map_ops_t metaslab_df_ops;
+extern space_map_ops_t *zfs_metaslab_ops;
+
+extern void metaslab_group_preload(metaslab_group_t *mg, uint64_t txg);
+extern void metaslab_group_queued(metaslab_group_t *mg, int64_t delta);
+extern uint64_t metaslab_group_fragmentation(metaslab_group_t *mg);
+
+extern void metaslab_stat_init(void);
+extern void metaslab_stat_fini(void);
 
 extern int metaslab_alloc(spa_t *spa, metaslab_class_t *mc, uint64_t psize,
     blkptr_t *bp, int ncopies, uint64_t txg, blkptr_t *hintbp,
@@ -41,6 +41,8 @@ extern "C" {
 struct metaslab_class {
 	metaslab_group_t	*mc_rotor;
 	uint64_t		mc_allocated;
+	uint64_t		mc_alloc_queued; /* async write bytes queued */
+	int			mc_groups;	/* number of groups */
 };
 
 struct metaslab_group {
@@ -52,6 +54,7 @@ struct metaslab_group {
 	vdev_t			*mg_vd;
 	metaslab_group_t	*mg_prev;
 	metaslab_group_t	*mg_next;
+	uint64_t		mg_alloc_queued; /* async write bytes queued */
 };
 
 /*
@@ -69,6 +72,10 @@ struct metaslab {
 	space_map_t	ms_freemap[TXG_SIZE];	/* freed this txg	*/
 	space_map_t	ms_map;		/* in-core free space map	*/
 	uint64_t	ms_weight;	/* weight vs. others in group	*/
+	uint64_t	ms_condense_checked; /* smo_objsize at last check */
+	uint64_t	ms_access_txg;	/* last txg allocated or preloaded */
+	uint64_t	ms_fragmentation; /* free space fragmentation (%) */
+	boolean_t	ms_preload_pending; /* queued on preload taskq	*/
 	metaslab_group_t *ms_group;	/* metaslab group		*/
 	avl_node_t	ms_group_node;	/* node in metaslab group tree	*/
 	txg_node_t	ms_txg_node;	/* per-txg dirty metaslab links	*/
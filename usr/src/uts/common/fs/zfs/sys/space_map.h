@@ -37,6 +37,12 @@ extern "C" {
 
 typedef struct space_map_ops space_map_ops_t;
 
+/*
+ * Number of power-of-two buckets in a space map's segment size histogram.
+ * Bucket i counts the segments whose size is in [2^i, 2^(i+1)).
+ */
+#define	SPACE_MAP_HISTOGRAM_SIZE	64
+
 typedef struct space_map {
 	avl_tree_t	sm_root;	/* AVL tree of map segments */
 	uint64_t	sm_space;	/* sum of all segments in the map */
@@ -49,11 +55,14 @@ typedef struct space_map {
 	kcondvar_t	sm_load_cv;	/* map load completion */
 	space_map_ops_t	*sm_ops;	/* space map block picker ops vector */
 	void		*sm_ppd;	/* picker-private data */
+	avl_tree_t	*sm_pp_root;	/* picker-private AVL tree */
 	kmutex_t	*sm_lock;	/* pointer to lock that protects map */
+	uint64_t	sm_hist[SPACE_MAP_HISTOGRAM_SIZE]; /* segment sizes */
 } space_map_t;
 
 typedef struct space_seg {
 	avl_node_t	ss_node;	/* AVL node */
+	avl_node_t	ss_pp_node;	/* AVL picker-private node */
 	uint64_t	ss_start;	/* starting offset of this segment */
 	uint64_t	ss_end;		/* ending offset (non-inclusive) */
 } space_seg_t;
@@ -140,6 +149,7 @@ extern void space_map_walk(space_map_t *sm,
     space_map_func_t *func, space_map_t *mdest);
 extern void space_map_excise(space_map_t *sm, uint64_t start, uint64_t size);
 extern void space_map_union(space_map_t *smd, space_map_t *sms);
+extern uint64_t space_map_fragmentation(space_map_t *sm);
 
 extern void space_map_load_wait(space_map_t *sm);
 extern int space_map_load(space_map_t *sm, space_map_ops_t *ops,
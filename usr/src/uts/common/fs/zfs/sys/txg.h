@@ -36,14 +36,22 @@
 extern "C" {
 #endif
 
-#define	TXG_CONCURRENT_STATES	3	/* open, quiescing, syncing	*/
-#define	TXG_SIZE		4		/* next power of 2	*/
+/*
+ * Up to TXG_QUIESCE_MAX txgs may be quiescing or quiesced and waiting to
+ * sync at once (see zfs_txg_pipeline_depth), so as many as
+ * TXG_CONCURRENT_STATES txgs are in flight.  TXG_SIZE must also cover the
+ * TXG_CLEAN() slot of the syncing txg.
+ */
+#define	TXG_CONCURRENT_STATES	4	/* open, quiesce (x2), syncing	*/
+#define	TXG_QUIESCE_MAX		(TXG_CONCURRENT_STATES - 2)
+#define	TXG_SIZE		8		/* next power of 2	*/
 #define	TXG_MASK		(TXG_SIZE - 1)	/* mask for size	*/
-#define	TXG_INITIAL		TXG_SIZE	/* initial txg 		*/
+#define	TXG_INITIAL		4		/* initial txg 		*/
 #define	TXG_IDX			(txg & TXG_MASK)
 
 #define	TXG_WAIT		1ULL
 #define	TXG_NOWAIT		2ULL
+#define	TXG_WAITED		3ULL	/* NOWAIT, already throttled */
 
 typedef struct tx_cpu tx_cpu_t;
 
@@ -75,6 +83,15 @@ extern void txg_rele_to_sync(txg_handle_t *txghp);
 extern void txg_suspend(struct dsl_pool *dp);
 extern void txg_resume(struct dsl_pool *dp);
 
+/*
+ * Per-txg statistics, kept for the last zfs_txg_history txgs.
+ */
+extern void txg_history_sync_stats(struct dsl_pool *dp, uint64_t txg,
+    uint64_t ndirty, uint64_t nwritten, uint64_t npasses,
+    uint64_t ndeferred);
+extern void txg_history_zil_commit(struct dsl_pool *dp);
+extern int txg_history_get(struct dsl_pool *dp, nvlist_t **nvp);
+
 /*
  * Wait until the given transaction group has finished syncing.
  * Try to make this happen as soon as possible (eg. kick off any
@@ -97,6 +114,12 @@ extern void txg_wait_open(struct dsl_pool *dp, uint64_t txg);
  */
 extern int txg_stalled(struct dsl_pool *dp);
 
+/*
+ * Start quiescing the given open txg without waiting for it, unless the
+ * quiesce pipeline is already full.  Returns TRUE if the txg was pushed.
+ */
+extern int txg_kick(struct dsl_pool *dp, uint64_t txg);
+
 /*
  * Per-txg object lists.
  */
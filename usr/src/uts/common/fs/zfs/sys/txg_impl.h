@@ -43,12 +43,31 @@ struct tx_cpu {
 	char		tc_pad[16];
 };
 
+/*
+ * One txg's entry in the tx_history ring.  Times are gethrtime() values;
+ * a phase that has not started yet is 0.
+ */
+typedef struct txg_history {
+	uint64_t	th_txg;
+	hrtime_t	th_birth;	/* opened */
+	hrtime_t	th_quiesce;	/* closed, quiesce started */
+	hrtime_t	th_quiesced;	/* quiesce done, waiting to sync */
+	hrtime_t	th_sync;	/* spa_sync() started */
+	hrtime_t	th_synced;	/* spa_sync() done */
+	uint64_t	th_ndirty;	/* dirty bytes when sync started */
+	uint64_t	th_nwritten;	/* bytes written by spa_sync() */
+	uint64_t	th_npasses;	/* sync passes */
+	uint64_t	th_ndeferred;	/* frees deferred to the next txg */
+	uint64_t	th_nzil_commits; /* ZIL commits while open */
+} txg_history_t;
+
 typedef struct tx_state {
 	tx_cpu_t	*tx_cpu;	/* protects right to enter txg	*/
 	kmutex_t	tx_sync_lock;	/* protects tx_state_t */
 	krwlock_t	tx_suspend;
 	uint64_t	tx_open_txg;	/* currently open txg id */
-	uint64_t	tx_quiesced_txg; /* quiesced txg waiting for sync */
+	uint64_t	tx_quiesced_txg; /* oldest quiesced, waiting for sync */
+	uint64_t	tx_quiesced_last; /* newest quiesced txg */
 	uint64_t	tx_syncing_txg;	/* currently syncing txg id */
 	uint64_t	tx_synced_txg;	/* last synced txg id */
 
@@ -68,6 +87,12 @@ typedef struct tx_state {
 	kthread_t	*tx_sync_thread;
 	kthread_t	*tx_quiesce_thread;
 	kthread_t	*tx_timelimit_thread;
+
+	kmutex_t	tx_history_lock; /* protects tx_history */
+	txg_history_t	*tx_history;	/* the last tx_history_size txgs */
+	int		tx_history_size;
+	uint64_t	tx_zil_commits;	/* ZIL commits, for tx_history */
+	kstat_t		*tx_history_ksp;
 } tx_state_t;
 
 #ifdef	__cplusplus
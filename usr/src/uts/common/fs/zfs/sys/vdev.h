@@ -104,6 +104,11 @@ extern void vdev_queue_init(vdev_t *vd);
 extern void vdev_queue_fini(vdev_t *vd);
 extern zio_t *vdev_queue_io(zio_t *zio);
 extern void vdev_queue_io_done(zio_t *zio);
+extern void vdev_queue_demand(vdev_t *vd, uint64_t *queued, uint64_t *wait,
+    uint64_t *last);
+
+extern void vdev_raidz_child_range(vdev_t *vd, int c, uint64_t *offset,
+    uint64_t *size);
 
 extern void vdev_config_dirty(vdev_t *vd);
 extern void vdev_config_clean(vdev_t *vd);
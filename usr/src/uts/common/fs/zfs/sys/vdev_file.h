@@ -39,6 +39,7 @@ extern "C" {
 
 typedef struct vdev_file {
 	vnode_t		*vf_vnode;
+	taskq_t		*vf_taskq;	/* async I/O issue threads */
 } vdev_file_t;
 
 #ifdef	__cplusplus
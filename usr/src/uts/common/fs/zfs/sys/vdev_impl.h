@@ -101,6 +101,9 @@ struct vdev_queue {
 	avl_tree_t	vq_read_tree;
 	avl_tree_t	vq_write_tree;
 	avl_tree_t	vq_pending_tree;
+	uint64_t	vq_demand_queued;	/* queued non-scrub reads */
+	uint64_t	vq_demand_wait;		/* avg queue wait, ticks << 8 */
+	uint64_t	vq_demand_last;		/* lbolt of last non-scrub read */
 	kmutex_t	vq_lock;
 };
 
@@ -144,6 +147,7 @@ struct vdev {
 	list_node_t	vdev_dirty_node; /* config dirty list		*/
 	uint64_t	vdev_deflate_ratio; /* deflation ratio (x512)	*/
 	uint64_t	vdev_islog;	/* is an intent log device	*/
+	uint64_t	vdev_isspecial;	/* is a metadata device		*/
 
 	/*
 	 * Leaf vdev state.
@@ -171,6 +175,7 @@ struct vdev {
 	uint64_t	vdev_not_present; /* not present during import	*/
 	hrtime_t	vdev_last_try;	/* last reopen time		*/
 	boolean_t	vdev_nowritecache; /* true if flushwritecache failed */
+	boolean_t	vdev_notrim;	/* true if DKIOCFREE failed	*/
 	uint64_t	vdev_unspare;	/* unspare when resilvering done */
 	boolean_t	vdev_checkremove; /* temporary online test	*/
 	boolean_t	vdev_forcefault; /* force online fault		*/
@@ -269,6 +274,7 @@ extern void vdev_remove_parent(vdev_t *cvd);
 extern void vdev_load(vdev_t *vd);
 extern void vdev_sync(vdev_t *vd, uint64_t txg);
 extern void vdev_sync_done(vdev_t *vd, uint64_t txg);
+extern void vdev_trim(vdev_t *vd, uint64_t txg, zio_t *pio);
 extern void vdev_dirty(vdev_t *vd, int flags, void *arg, uint64_t txg);
 
 /*
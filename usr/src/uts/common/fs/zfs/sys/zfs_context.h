@@ -90,6 +90,11 @@ extern "C" {
 
 #include <sys/disk.h>
 #define DKIOCFLUSHWRITECACHE DKIOCSYNCHRONIZECACHE
+#ifdef DKIOCUNMAP
+#define DKIOCFREE DKIOCUNMAP
+#else
+#define DKIOCFREE (('d' << 8) | 0xff)	/* not supported by this kernel */
+#endif
 
 #define ZFS_SNAPDIR_VISIBLE 0
 
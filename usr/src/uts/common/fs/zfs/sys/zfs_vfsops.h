@@ -75,6 +75,15 @@ struct zfsvfs {
 	kmutex_t	z_hold_mtx[ZFS_OBJ_MTX_SZ];	/* znode hold locks */
 };
 
+/*
+ * The txg_how to pass to dmu_tx_assign().  Once an op has waited in
+ * dmu_tx_wait() it retries with TXG_WAITED, so that the write throttle
+ * does not delay it again.
+ */
+#define	ZFS_TXG_HOW(zfsvfs, waited)	\
+	((waited) && (zfsvfs)->z_assign == TXG_NOWAIT ?	\
+	TXG_WAITED : (zfsvfs)->z_assign)
+
 /*
  * Normal filesystems (those not under .zfs/snapshot) have a total
  * file ID size limited to 12 bytes (including the length field) due to
@@ -89,7 +89,7 @@ extern "C" {
 #define	ZPL_VERSION_STR		"VERSION"
 
 
-#define	ZFS_MAX_BLOCKSIZE	(SPA_MAXBLOCKSIZE)
+#define	ZFS_MAX_BLOCKSIZE	(SPA_OLD_MAXBLOCKSIZE)
 
 /* Path component length */
 /*
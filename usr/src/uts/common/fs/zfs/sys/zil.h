@@ -77,7 +77,7 @@ typedef struct zil_trailer {
 } zil_trailer_t;
 
 #define	ZIL_MIN_BLKSZ	4096ULL
-#define	ZIL_MAX_BLKSZ	SPA_MAXBLOCKSIZE
+#define	ZIL_MAX_BLKSZ	SPA_OLD_MAXBLOCKSIZE
 #define	ZIL_BLK_DATA_SZ(lwb)	((lwb)->lwb_sz - sizeof (zil_trailer_t))
 
 /*
@@ -210,6 +210,7 @@ typedef enum {
 
 typedef struct itx {
 	list_node_t	itx_node;	/* linkage on zl_itx_list */
+	list_node_t	itx_obj_node;	/* linkage on per-object or common */
 	void		*itx_private;	/* type-specific opaque data */
 	itx_wr_state_t	itx_wr_state;	/* write state */
 	uint8_t		itx_sync;	/* synchronous transaction */
@@ -250,6 +251,8 @@ extern void	zil_close(zilog_t *zilog);
 
 extern void	zil_replay(objset_t *os, void *arg, uint64_t *txgp,
     zil_replay_func_t *replay_func[TX_MAX_TYPE]);
+extern void	zil_replay_parallel(objset_t *os, int nargs, void **args,
+    uint64_t **txgps, zil_replay_func_t *replay_func[TX_MAX_TYPE]);
 extern void	zil_destroy(zilog_t *zilog, boolean_t keep_first);
 extern void	zil_rollback_destroy(zilog_t *zilog, dmu_tx_t *tx);
 
@@ -257,6 +260,7 @@ extern itx_t	*zil_itx_create(int txtype, size_t lrsize);
 extern uint64_t zil_itx_assign(zilog_t *zilog, itx_t *itx, dmu_tx_t *tx);
 
 extern void	zil_commit(zilog_t *zilog, uint64_t seq, uint64_t oid);
+extern void	zil_commit_forced(zilog_t *zilog, uint64_t seq, uint64_t oid);
 
 extern int	zil_claim(char *osname, void *txarg);
 extern void	zil_sync(zilog_t *zilog, dmu_tx_t *tx);
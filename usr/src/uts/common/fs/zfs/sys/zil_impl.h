@@ -46,6 +46,7 @@ typedef struct lwb {
 	char		*lwb_buf;	/* log write buffer */
 	zio_t		*lwb_zio;	/* zio for this buffer */
 	uint64_t	lwb_max_txg;	/* highest txg in this lwb */
+	uint64_t	lwb_seq;	/* issue order; 0 until issued */
 	txg_handle_t	lwb_txgh;	/* txg handle for txg_exit() */
 	list_node_t	lwb_node;	/* zilog->zl_lwb_list linkage */
 } lwb_t;
@@ -56,11 +57,29 @@ typedef struct lwb {
  */
 
 #define	ZIL_VDEV_BMSZ 16 /* 16 * 8 = 128 vdevs */
+
+/*
+ * Number of recent commit sizes kept for sizing log blocks.  Must be a
+ * power of 2.
+ */
+#define	ZIL_PREV_BLKS 16
 typedef struct zil_vdev {
 	uint64_t	vdev;		/* device written */
 	list_node_t	vdev_seq_node;	/* zilog->zl_vdev_list linkage */
 } zil_vdev_t;
 
+/*
+ * The TX_WRITE, TX_TRUNCATE, TX_SETATTR and TX_ACL itxs of one object,
+ * so that a commit for that object needn't walk everyone else's.  All
+ * other itxs (namespace operations) are on zl_itx_common.  Every itx is
+ * also on zl_itx_list, which keeps the overall order.
+ */
+typedef struct zil_obj_itxs {
+	uint64_t	zoi_foid;	/* object these itxs are for */
+	list_t		zoi_list;	/* itxs, in lrc_seq order */
+	avl_node_t	zoi_node;	/* zilog->zl_itx_objs linkage */
+} zil_obj_itxs_t;
+
 /*
  * Stable storage intent log management structure.  One per dataset.
  */
@@ -71,7 +90,6 @@ struct zilog {
 	const zil_header_t *zl_header;	/* log header buffer */
 	objset_t	*zl_os;		/* object set we're logging */
 	zil_get_data_t	*zl_get_data;	/* callback to get object content */
-	zio_t		*zl_root_zio;	/* log writer root zio */
 	uint64_t	zl_itx_seq;	/* next itx sequence number */
 	uint64_t	zl_commit_seq;	/* committed upto this number */
 	uint64_t	zl_lr_seq;	/* log record sequence number */
@@ -86,10 +104,19 @@ struct zilog {
 	uint8_t		zl_stop_sync;	/* for debugging */
 	uint8_t		zl_writer;	/* boolean: write setup in progress */
 	uint8_t		zl_log_error;	/* boolean: log write error */
+	uint8_t		zl_flushing;	/* boolean: vdev flush in progress */
+	uint64_t	zl_lwb_seq;	/* number of lwbs issued */
+	uint64_t	zl_lwb_written;	/* issued lwbs written, in order */
+	uint64_t	zl_lwb_stable;	/* written lwbs flushed */
+	kcondvar_t	zl_cv_lwb;	/* lwb write and flush completion */
 	list_t		zl_itx_list;	/* in-memory itx list */
+	list_t		zl_itx_common;	/* itxs not tied to one object */
+	avl_tree_t	zl_itx_objs;	/* per-object itx lists */
 	uint64_t	zl_itx_list_sz;	/* total size of records on list */
 	uint64_t	zl_cur_used;	/* current commit log size used */
-	uint64_t	zl_prev_used;	/* previous commit log size used */
+	uint64_t	zl_cur_lwbs;	/* lwbs issued by current commit */
+	uint64_t	zl_prev_blks[ZIL_PREV_BLKS]; /* recent commit sizes */
+	uint_t		zl_prev_rotor;	/* next zl_prev_blks slot */
 	list_t		zl_lwb_list;	/* in-flight log write list */
 	list_t		zl_vdev_list;	/* list of [vdev, seq] pairs */
 	uint8_t		zl_vdev_bmap[ZIL_VDEV_BMSZ]; /* bitmap of vdevs */
@@ -144,6 +144,9 @@ enum zio_compress {
 #define	ZIO_FLAG_USER			0x20000
 
 #define	ZIO_FLAG_METADATA		0x40000
+#define	ZIO_FLAG_ALLOC_QUEUED		0x80000
+
+#define	ZIO_FLAG_SPECIAL		0x100000
 
 #define	ZIO_FLAG_GANG_INHERIT		\
 	(ZIO_FLAG_CANFAIL |		\
@@ -292,6 +295,10 @@ extern zio_t *zio_claim(zio_t *pio, spa_t *spa, uint64_t txg, blkptr_t *bp,
 extern zio_t *zio_ioctl(zio_t *pio, spa_t *spa, vdev_t *vd, int cmd,
     zio_done_func_t *done, void *private, int priority, int flags);
 
+extern zio_t *zio_trim(zio_t *pio, spa_t *spa, vdev_t *vd, uint64_t offset,
+    uint64_t size, zio_done_func_t *done, void *private, int priority,
+    int flags);
+
 extern zio_t *zio_read_phys(zio_t *pio, vdev_t *vd, uint64_t offset,
     uint64_t size, void *data, int checksum,
     zio_done_func_t *done, void *private, int priority, int flags);
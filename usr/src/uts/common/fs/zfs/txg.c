@@ -41,6 +41,78 @@ static void txg_timelimit_thread(dsl_pool_t *dp);
 
 int txg_time = 5;	/* max 5 seconds worth of delta per txg */
 
+/*
+ * Number of txgs whose open, quiesce and sync statistics are kept per
+ * pool (see txg_history_get()); 0 disables the history.
+ */
+int zfs_txg_history = 64;
+
+/*
+ * Number of txgs that may be quiescing or quiesced and waiting to sync
+ * at the same time, at most TXG_QUIESCE_MAX.  With 1, the open txg can
+ * only be closed once the previous one has started syncing, so writers
+ * stall in txg_wait_open() whenever a sync runs long; with 2, the next
+ * txg can quiesce and wait behind it.  The dirty data held by the extra
+ * txg is still bounded by zfs_dirty_data_max.
+ */
+int zfs_txg_pipeline_depth = 2;
+
+static int
+txg_pipeline_depth(void)
+{
+	return (MIN(MAX(zfs_txg_pipeline_depth, 1), TXG_QUIESCE_MAX));
+}
+
+/*
+ * Number of quiesced txgs waiting for the sync thread.  The quiesce
+ * thread hands them off in order, so they are the range
+ * [tx_quiesced_txg, tx_quiesced_last].
+ */
+static int
+txg_quiesced_count(tx_state_t *tx)
+{
+	ASSERT(MUTEX_HELD(&tx->tx_sync_lock));
+
+	if (tx->tx_quiesced_txg == 0)
+		return (0);
+	return (tx->tx_quiesced_last - tx->tx_quiesced_txg + 1);
+}
+
+/*
+ * Find txg's entry in the history ring; caller holds tx_history_lock.
+ */
+static txg_history_t *
+txg_history_find(tx_state_t *tx, uint64_t txg)
+{
+	txg_history_t *th;
+
+	if (tx->tx_history == NULL)
+		return (NULL);
+	th = &tx->tx_history[txg % tx->tx_history_size];
+	return (th->th_txg == txg ? th : NULL);
+}
+
+/*
+ * Start txg's entry, replacing the oldest one.
+ */
+static void
+txg_history_open(tx_state_t *tx, uint64_t txg, hrtime_t now)
+{
+	txg_history_t *th;
+
+	if (tx->tx_history == NULL)
+		return;
+
+	mutex_enter(&tx->tx_history_lock);
+	th = &tx->tx_history[txg % tx->tx_history_size];
+	bzero(th, sizeof (txg_history_t));
+	th->th_txg = txg;
+	th->th_birth = now;
+	/* a count so far, until the txg closes */
+	th->th_nzil_commits = tx->tx_zil_commits;
+	mutex_exit(&tx->tx_history_lock);
+}
+
 /*
  * Prepare the txg subsystem.
  */
@@ -58,8 +130,30 @@ txg_init(dsl_pool_t *dp, uint64_t txg)
 
 	rw_init(&tx->tx_suspend, NULL, RW_DEFAULT, NULL);
 	mutex_init(&tx->tx_sync_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&tx->tx_history_lock, NULL, MUTEX_DEFAULT, NULL);
 
 	tx->tx_open_txg = txg;
+
+	if (zfs_txg_history > 0) {
+		char name[KSTAT_STRLEN];
+
+		tx->tx_history_size = MAX(zfs_txg_history, TXG_SIZE);
+		tx->tx_history = kmem_zalloc(tx->tx_history_size *
+		    sizeof (txg_history_t), KM_SLEEP);
+		txg_history_open(tx, txg, gethrtime());
+
+		(void) snprintf(name, sizeof (name), "txgs-%s",
+		    spa_name(dp->dp_spa));
+		tx->tx_history_ksp = kstat_create("zfs", 0, name, "misc",
+		    KSTAT_TYPE_RAW, tx->tx_history_size, KSTAT_FLAG_VIRTUAL);
+		if (tx->tx_history_ksp != NULL) {
+			tx->tx_history_ksp->ks_data = tx->tx_history;
+			tx->tx_history_ksp->ks_data_size =
+			    tx->tx_history_size * sizeof (txg_history_t);
+			tx->tx_history_ksp->ks_lock = &tx->tx_history_lock;
+			kstat_install(tx->tx_history_ksp);
+		}
+	}
 }
 
 /*
@@ -73,8 +167,16 @@ txg_fini(dsl_pool_t *dp)
 
 	ASSERT(tx->tx_threads == 0);
 
+	if (tx->tx_history_ksp != NULL)
+		kstat_delete(tx->tx_history_ksp);
+	if (tx->tx_history != NULL) {
+		kmem_free(tx->tx_history,
+		    tx->tx_history_size * sizeof (txg_history_t));
+	}
+
 	rw_destroy(&tx->tx_suspend);
 	mutex_destroy(&tx->tx_sync_lock);
+	mutex_destroy(&tx->tx_history_lock);
 
 	for (c = 0; c < max_ncpus; c++)
 		mutex_destroy(&tx->tx_cpu[c].tc_lock);
@@ -226,6 +328,8 @@ txg_quiesce(dsl_pool_t *dp, uint64_t txg)
 {
 	tx_state_t *tx = &dp->dp_tx;
 	int g = txg & TXG_MASK;
+	txg_history_t *th;
+	hrtime_t now;
 	int c;
 
 	/*
@@ -244,6 +348,15 @@ txg_quiesce(dsl_pool_t *dp, uint64_t txg)
 	for (c = 0; c < max_ncpus; c++)
 		mutex_exit(&tx->tx_cpu[c].tc_lock);
 
+	now = gethrtime();
+	txg_history_open(tx, txg + 1, now);
+	mutex_enter(&tx->tx_history_lock);
+	if ((th = txg_history_find(tx, txg)) != NULL) {
+		th->th_quiesce = now;
+		th->th_nzil_commits = tx->tx_zil_commits - th->th_nzil_commits;
+	}
+	mutex_exit(&tx->tx_history_lock);
+
 	/*
 	 * Quiesce the transaction group by waiting for everyone to txg_exit().
 	 */
@@ -254,6 +367,11 @@ txg_quiesce(dsl_pool_t *dp, uint64_t txg)
 			cv_wait(&tc->tc_cv[g], &tc->tc_lock);
 		mutex_exit(&tc->tc_lock);
 	}
+
+	mutex_enter(&tx->tx_history_lock);
+	if ((th = txg_history_find(tx, txg)) != NULL)
+		th->th_quiesced = gethrtime();
+	mutex_exit(&tx->tx_history_lock);
 }
 
 static void
@@ -266,6 +384,7 @@ txg_sync_thread(dsl_pool_t *dp)
 
 	for (;;) {
 		uint64_t txg;
+		txg_history_t *th;
 
 		/*
 		 * We sync when there's someone waiting on us, or the
@@ -296,12 +415,12 @@ txg_sync_thread(dsl_pool_t *dp)
 		rw_enter(&tx->tx_suspend, RW_WRITER);
 
 		/*
-		 * Consume the quiesced txg which has been handed off to
-		 * us.  This may cause the quiescing thread to now be
-		 * able to quiesce another txg, so we must signal it.
+		 * Consume the oldest quiesced txg which has been handed
+		 * off to us.  This may cause the quiescing thread to now
+		 * be able to quiesce another txg, so we must signal it.
 		 */
 		txg = tx->tx_quiesced_txg;
-		tx->tx_quiesced_txg = 0;
+		tx->tx_quiesced_txg = txg < tx->tx_quiesced_last ? txg + 1 : 0;
 		tx->tx_syncing_txg = txg;
 		cv_broadcast(&tx->tx_quiesce_more_cv);
 		rw_exit(&tx->tx_suspend);
@@ -310,13 +429,39 @@ txg_sync_thread(dsl_pool_t *dp)
 			txg, tx->tx_quiesce_txg_waiting,
 			tx->tx_sync_txg_waiting);
 		mutex_exit(&tx->tx_sync_lock);
+
+		mutex_enter(&tx->tx_history_lock);
+		if ((th = txg_history_find(tx, txg)) != NULL)
+			th->th_sync = gethrtime();
+		mutex_exit(&tx->tx_history_lock);
+
 		spa_sync(dp->dp_spa, txg);
+
+		mutex_enter(&tx->tx_history_lock);
+		if ((th = txg_history_find(tx, txg)) != NULL)
+			th->th_synced = gethrtime();
+		mutex_exit(&tx->tx_history_lock);
+
 		mutex_enter(&tx->tx_sync_lock);
 		rw_enter(&tx->tx_suspend, RW_WRITER);
 		tx->tx_synced_txg = txg;
 		tx->tx_syncing_txg = 0;
 		rw_exit(&tx->tx_suspend);
 		cv_broadcast(&tx->tx_sync_done_cv);
+
+		/*
+		 * If the open txg filled up while the pipeline was full,
+		 * its txg_kick() found no room and did nothing.  There is
+		 * room now, so push it out rather than leave the writers
+		 * throttled until the timelimit thread gets to it.
+		 */
+		txg = tx->tx_open_txg;
+		if (tx->tx_quiesce_txg_waiting <= txg &&
+		    dsl_pool_need_dirty_sync(dp, txg)) {
+			dprintf("pushing full txg %llu\n", txg);
+			tx->tx_quiesce_txg_waiting = txg + 1;
+			cv_broadcast(&tx->tx_quiesce_more_cv);
+		}
 	}
 }
 
@@ -333,14 +478,14 @@ txg_quiesce_thread(dsl_pool_t *dp)
 
 		/*
 		 * We quiesce when there's someone waiting on us.
-		 * However, we can only have one txg in "quiescing" or
-		 * "quiesced, waiting to sync" state.  So we wait until
-		 * the "quiesced, waiting to sync" txg has been consumed
-		 * by the sync thread.
+		 * However, we can only have txg_pipeline_depth() txgs in
+		 * "quiescing" or "quiesced, waiting to sync" state.  So
+		 * we wait until the sync thread has consumed enough of
+		 * the "quiesced, waiting to sync" txgs.
 		 */
 		while (!tx->tx_exiting &&
 		    (tx->tx_open_txg >= tx->tx_quiesce_txg_waiting ||
-		    tx->tx_quiesced_txg != 0))
+		    txg_quiesced_count(tx) >= txg_pipeline_depth()))
 			txg_thread_wait(tx, &cpr, &tx->tx_quiesce_more_cv, 0);
 
 		if (tx->tx_exiting)
@@ -358,7 +503,9 @@ txg_quiesce_thread(dsl_pool_t *dp)
 		 * Hand this txg off to the sync thread.
 		 */
 		dprintf("quiesce done, handing off txg %llu\n", txg);
-		tx->tx_quiesced_txg = txg;
+		if (tx->tx_quiesced_txg == 0)
+			tx->tx_quiesced_txg = txg;
+		tx->tx_quiesced_last = txg;
 		cv_broadcast(&tx->tx_sync_more_cv);
 		cv_broadcast(&tx->tx_quiesce_done_cv);
 	}
@@ -432,6 +579,145 @@ txg_timelimit_thread(dsl_pool_t *dp)
 	txg_thread_exit(tx, &cpr, &tx->tx_timelimit_thread);
 }
 
+int
+txg_kick(dsl_pool_t *dp, uint64_t txg)
+{
+	tx_state_t *tx = &dp->dp_tx;
+	int kicked = B_FALSE;
+
+	if (tx->tx_quiesce_txg_waiting > txg)
+		return (B_FALSE);
+
+	mutex_enter(&tx->tx_sync_lock);
+	if (txg == tx->tx_open_txg && tx->tx_quiesce_txg_waiting <= txg &&
+	    txg_quiesced_count(tx) < txg_pipeline_depth()) {
+		dprintf("kicking txg %llu\n", txg);
+		tx->tx_quiesce_txg_waiting = txg + 1;
+		cv_broadcast(&tx->tx_quiesce_more_cv);
+		kicked = B_TRUE;
+	}
+	mutex_exit(&tx->tx_sync_lock);
+
+	return (kicked);
+}
+
+/*
+ * Called by spa_sync() with what it knows about the txg it synced.
+ */
+void
+txg_history_sync_stats(dsl_pool_t *dp, uint64_t txg, uint64_t ndirty,
+    uint64_t nwritten, uint64_t npasses, uint64_t ndeferred)
+{
+	tx_state_t *tx = &dp->dp_tx;
+	txg_history_t *th;
+
+	mutex_enter(&tx->tx_history_lock);
+	if ((th = txg_history_find(tx, txg)) != NULL) {
+		th->th_ndirty = ndirty;
+		th->th_nwritten = nwritten;
+		th->th_npasses = npasses;
+		th->th_ndeferred = ndeferred;
+	}
+	mutex_exit(&tx->tx_history_lock);
+}
+
+void
+txg_history_zil_commit(dsl_pool_t *dp)
+{
+	atomic_add_64(&dp->dp_tx.tx_zil_commits, 1);
+}
+
+/*
+ * Return the txg history, oldest first, as an array of ZPOOL_TXG_RECORD
+ * nvlists.  The durations of phases that have not finished are 0.
+ */
+int
+txg_history_get(dsl_pool_t *dp, nvlist_t **nvp)
+{
+	tx_state_t *tx = &dp->dp_tx;
+	txg_history_t *hist, *th;
+	nvlist_t **records;
+	uint64_t state, first, txg;
+	int i, n;
+
+	VERIFY(nvlist_alloc(nvp, NV_UNIQUE_NAME, KM_SLEEP) == 0);
+	if (tx->tx_history == NULL)
+		return (0);
+
+	/*
+	 * Copy the ring so that no allocation happens under the lock.
+	 */
+	n = tx->tx_history_size;
+	hist = kmem_alloc(n * sizeof (txg_history_t), KM_SLEEP);
+	records = kmem_zalloc(n * sizeof (nvlist_t *), KM_SLEEP);
+
+	mutex_enter(&tx->tx_history_lock);
+	bcopy(tx->tx_history, hist, n * sizeof (txg_history_t));
+	txg = tx->tx_open_txg;
+	for (i = 0; i < n; i++) {
+		/* the open txg's count is still running */
+		if (hist[i].th_txg == txg && hist[i].th_quiesce == 0)
+			hist[i].th_nzil_commits =
+			    tx->tx_zil_commits - hist[i].th_nzil_commits;
+	}
+	mutex_exit(&tx->tx_history_lock);
+
+	first = txg >= n ? txg - n + 1 : 0;
+	for (i = 0, txg = first; txg < first + n; txg++) {
+		th = &hist[txg % n];
+		if (th->th_txg != txg || th->th_birth == 0)
+			continue;
+
+		if (th->th_synced != 0)
+			state = ZPOOL_TXG_STATE_SYNCED;
+		else if (th->th_sync != 0)
+			state = ZPOOL_TXG_STATE_SYNCING;
+		else if (th->th_quiesced != 0)
+			state = ZPOOL_TXG_STATE_QUIESCED;
+		else if (th->th_quiesce != 0)
+			state = ZPOOL_TXG_STATE_QUIESCING;
+		else
+			state = ZPOOL_TXG_STATE_OPEN;
+
+		VERIFY(nvlist_alloc(&records[i], NV_UNIQUE_NAME,
+		    KM_SLEEP) == 0);
+		VERIFY(nvlist_add_uint64(records[i], ZPOOL_TXG_TXG,
+		    txg) == 0);
+		VERIFY(nvlist_add_uint64(records[i], ZPOOL_TXG_STATE,
+		    state) == 0);
+		VERIFY(nvlist_add_uint64(records[i], ZPOOL_TXG_OPEN_TIME,
+		    th->th_quiesce ? th->th_quiesce - th->th_birth : 0) == 0);
+		VERIFY(nvlist_add_uint64(records[i], ZPOOL_TXG_QUIESCE_TIME,
+		    th->th_quiesced ? th->th_quiesced - th->th_quiesce :
+		    0) == 0);
+		VERIFY(nvlist_add_uint64(records[i], ZPOOL_TXG_WAIT_TIME,
+		    th->th_sync ? th->th_sync - th->th_quiesced : 0) == 0);
+		VERIFY(nvlist_add_uint64(records[i], ZPOOL_TXG_SYNC_TIME,
+		    th->th_synced ? th->th_synced - th->th_sync : 0) == 0);
+		VERIFY(nvlist_add_uint64(records[i], ZPOOL_TXG_DIRTY,
+		    th->th_ndirty) == 0);
+		VERIFY(nvlist_add_uint64(records[i], ZPOOL_TXG_WRITTEN,
+		    th->th_nwritten) == 0);
+		VERIFY(nvlist_add_uint64(records[i], ZPOOL_TXG_PASSES,
+		    th->th_npasses) == 0);
+		VERIFY(nvlist_add_uint64(records[i], ZPOOL_TXG_DEFERRED,
+		    th->th_ndeferred) == 0);
+		VERIFY(nvlist_add_uint64(records[i], ZPOOL_TXG_ZIL_COMMITS,
+		    th->th_nzil_commits) == 0);
+		i++;
+	}
+
+	VERIFY(nvlist_add_nvlist_array(*nvp, ZPOOL_TXG_RECORD, records,
+	    i) == 0);
+
+	while (--i >= 0)
+		nvlist_free(records[i]);
+	kmem_free(records, n * sizeof (nvlist_t *));
+	kmem_free(hist, n * sizeof (txg_history_t));
+
+	return (0);
+}
+
 int
 txg_stalled(dsl_pool_t *dp)
 {
@@ -336,7 +336,7 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 {
 	vdev_ops_t *ops;
 	char *type;
-	uint64_t guid = 0, islog, nparity;
+	uint64_t guid = 0, islog, isspecial, nparity;
 	vdev_t *vd;
 
 	ASSERT(spa_config_held(spa, RW_WRITER));
@@ -379,6 +379,16 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 	if (islog && spa_version(spa) < ZFS_VERSION_SLOGS)
 		return (ENOTSUP);
 
+	/*
+	 * Determine whether we're a special (metadata) vdev.  A top-level
+	 * vdev can't be both.
+	 */
+	isspecial = 0;
+	(void) nvlist_lookup_uint64(nv, ZPOOL_CONFIG_IS_SPECIAL, &isspecial);
+	if (isspecial &&
+	    (islog || spa_version(spa) < SPA_VERSION_SPECIAL_CLASS))
+		return (ENOTSUP);
+
 	/*
 	 * Set the nparity property for RAID-Z vdevs.
 	 */
@@ -417,6 +427,7 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 	vd = vdev_alloc_common(spa, id, guid, ops);
 
 	vd->vdev_islog = islog;
+	vd->vdev_isspecial = isspecial;
 	vd->vdev_nparity = nparity;
 
 	if (nvlist_lookup_string(nv, ZPOOL_CONFIG_PATH, &vd->vdev_path) == 0)
@@ -625,6 +636,9 @@ vdev_top_transfer(vdev_t *svd, vdev_t *tvd)
 
 	tvd->vdev_islog = svd->vdev_islog;
 	svd->vdev_islog = 0;
+
+	tvd->vdev_isspecial = svd->vdev_isspecial;
+	svd->vdev_isspecial = 0;
 }
 
 static void
@@ -736,6 +750,8 @@ vdev_metaslab_init(vdev_t *vd, uint64_t txg)
 
 	if (vd->vdev_islog)
 		mc = spa->spa_log_class;
+	else if (vd->vdev_isspecial)
+		mc = spa->spa_special_class;
 	else
 		mc = spa->spa_normal_class;
 
@@ -783,8 +799,11 @@ vdev_metaslab_fini(vdev_t *vd)
 {
 	uint64_t m;
 	uint64_t count = vd->vdev_ms_count;
+	taskq_t *tq = vd->vdev_spa->spa_metaslab_taskq;
 
 	if (vd->vdev_ms != NULL) {
+		if (tq != NULL)
+			taskq_wait(tq);
 		for (m = 0; m < count; m++)
 			if (vd->vdev_ms[m] != NULL)
 				metaslab_fini(vd->vdev_ms[m]);
@@ -1392,6 +1411,17 @@ vdev_sync_done(vdev_t *vd, uint64_t txg)
 		metaslab_sync_done(msp, txg);
 }
 
+void
+vdev_trim(vdev_t *vd, uint64_t txg, zio_t *pio)
+{
+	metaslab_t *msp;
+
+	for (msp = txg_list_head(&vd->vdev_ms_list, TXG_CLEAN(txg));
+	    msp != NULL;
+	    msp = txg_list_next(&vd->vdev_ms_list, msp, TXG_CLEAN(txg)))
+		metaslab_trim(msp, txg, pio);
+}
+
 void
 vdev_sync(vdev_t *vd, uint64_t txg)
 {
@@ -1743,11 +1773,22 @@ vdev_get_stats(vdev_t *vd, vdev_stat_t *vs)
 	vs->vs_rsize = vdev_get_rsize(vd);
 	mutex_exit(&vd->vdev_stat_lock);
 
+	vs->vs_fragmentation = (vd->vdev_mg != NULL) ?
+	    metaslab_group_fragmentation(vd->vdev_mg) : ZFS_FRAG_INVALID;
+
 	/*
 	 * If we're getting stats on the root vdev, aggregate the I/O counts
 	 * over all top-level vdevs (i.e. the direct children of the root).
 	 */
 	if (vd == rvd) {
+		spa_t *spa = vd->vdev_spa;
+		uint64_t frag = 0, fragspace = 0;
+
+		mutex_enter(&spa->spa_scrub_lock);
+		vs->vs_scrub_limit = spa->spa_scrub_limit;
+		vs->vs_scrub_delay = spa->spa_scrub_delay * 1000 / hz;
+		mutex_exit(&spa->spa_scrub_lock);
+
 		for (c = 0; c < rvd->vdev_children; c++) {
 			vdev_t *cvd = rvd->vdev_child[c];
 			vdev_stat_t *cvs = &cvd->vdev_stat;
@@ -1763,7 +1804,25 @@ vdev_get_stats(vdev_t *vd, vdev_stat_t *vs)
 			vs->vs_scrub_examined += cvs->vs_scrub_examined;
 			vs->vs_scrub_errors += cvs->vs_scrub_errors;
 			mutex_exit(&vd->vdev_stat_lock);
+
+			/*
+			 * The pool's fragmentation is that of its normal
+			 * class vdevs, weighted by their size.
+			 */
+			if (cvd->vdev_mg != NULL &&
+			    cvd->vdev_mg->mg_class == spa->spa_normal_class) {
+				uint64_t cfrag =
+				    metaslab_group_fragmentation(cvd->vdev_mg);
+
+				if (cfrag != ZFS_FRAG_INVALID) {
+					frag += cfrag * cvs->vs_space;
+					fragspace += cvs->vs_space;
+				}
+			}
 		}
+
+		vs->vs_fragmentation = (fragspace == 0) ? ZFS_FRAG_INVALID :
+		    frag / fragspace;
 	}
 }
 
@@ -159,6 +159,7 @@ vdev_disk_open(vdev_t *vd, uint64_t *psize, uint64_t *ashift)
 	 * try again.
 	 */
 	vd->vdev_nowritecache = B_FALSE;
+	vd->vdev_notrim = B_FALSE;
 	vd->vdev_tsd = dvd;
 	dvd->vd_devvp = devvp;
 out:
@@ -326,6 +327,7 @@ out:
 	 * try again.
 	 */
 	vd->vdev_nowritecache = B_FALSE;
+	vd->vdev_notrim = B_FALSE;
 
 	return (0);
 #endif
@@ -475,6 +477,37 @@ vdev_disk_io_start(zio_t *zio)
 
 			break;
 
+		case DKIOCFREE:
+#if defined(__APPLE__) && defined(DKIOCUNMAP)
+		{
+			dk_extent_t ext;
+			dk_unmap_t unmap;
+
+			ext.offset = zio->io_offset;
+			ext.length = zio->io_size;
+			bzero(&unmap, sizeof (unmap));
+			unmap.extents = &ext;
+			unmap.extentsCount = 1;
+
+			context = vfs_context_create((vfs_context_t)0);
+			error = VNOP_IOCTL(dvd->vd_devvp, DKIOCUNMAP,
+			    (caddr_t)&unmap, FWRITE, context);
+			(void) vfs_context_rele(context);
+		}
+#else
+			error = ENOTSUP;
+#endif /* __APPLE__ && DKIOCUNMAP */
+			if (error == ENOTSUP || error == ENOTTY) {
+				/*
+				 * As with the write cache, don't keep asking
+				 * a device that can't discard.
+				 */
+				vd->vdev_notrim = B_TRUE;
+			}
+			zio->io_error = error;
+
+			break;
+
 		default:
 			zio->io_error = ENOTSUP;
 		}
@@ -38,6 +38,16 @@
  * Virtual device vector for files.
  */
 
+/*
+ * File vdev reads and writes are handed to a per-vdev taskq rather than
+ * being performed by the thread that issues them, which is frequently the
+ * thread completing some other I/O.  vdev_file_queue_depth is the number
+ * of taskq threads, and hence the number of I/Os that can be outstanding
+ * against the backing file at once.  Completion goes back through
+ * zio_next_stage_async(), just as a disk interrupt would.
+ */
+int vdev_file_queue_depth = 16;
+
 static int
 vdev_file_open(vdev_t *vd, uint64_t *psize, uint64_t *ashift)
 {
@@ -123,6 +133,15 @@ vdev_file_open(vdev_t *vd, uint64_t *psize, uint64_t *ashift)
 #endif /* __APPLE__ */
 	*ashift = SPA_MINBLOCKSHIFT;
 
+	/*
+	 * Clear the notrim bit, so that on a vdev_reopen() we will try again.
+	 */
+	vd->vdev_notrim = B_FALSE;
+
+	vf->vf_taskq = taskq_create("vdev_file_taskq",
+	    MAX(vdev_file_queue_depth, 1), maxclsyspri,
+	    MAX(vdev_file_queue_depth, 1), INT_MAX, TASKQ_PREPOPULATE);
+
 	return (0);
 }
 
@@ -134,6 +153,12 @@ vdev_file_close(vdev_t *vd)
 	if (vf == NULL)
 		return;
 
+	/*
+	 * Wait for any outstanding I/O before we let go of the vnode.
+	 */
+	if (vf->vf_taskq != NULL)
+		taskq_destroy(vf->vf_taskq);
+
 	if (vf->vf_vnode != NULL) {
 #ifdef __APPLE__
 		vfs_context_t context;
@@ -154,12 +179,29 @@ vdev_file_close(vdev_t *vd)
 	vd->vdev_tsd = NULL;
 }
 
+static void
+vdev_file_io_strategy(void *arg)
+{
+	zio_t *zio = arg;
+	vdev_file_t *vf = zio->io_vd->vdev_tsd;
+	ssize_t resid;
+
+	zio->io_error = vn_rdwr(zio->io_type == ZIO_TYPE_READ ?
+	    UIO_READ : UIO_WRITE, vf->vf_vnode, zio->io_data,
+	    zio->io_size, zio->io_offset, UIO_SYSSPACE,
+	    0, RLIM64_INFINITY, kcred, &resid);
+
+	if (resid != 0 && zio->io_error == 0)
+		zio->io_error = ENOSPC;
+
+	zio_next_stage_async(zio);
+}
+
 static void
 vdev_file_io_start(zio_t *zio)
 {
 	vdev_t *vd = zio->io_vd;
 	vdev_file_t *vf = vd->vdev_tsd;
-	ssize_t resid;
 	int error;
 
 	if (zio->io_type == ZIO_TYPE_IOCTL) {
@@ -179,6 +221,20 @@ vdev_file_io_start(zio_t *zio)
 			dprintf("fsync(%s) = %d\n", vdev_description(vd),
 			    zio->io_error);
 			break;
+		case DKIOCFREE:
+#ifdef _KERNEL
+			/*
+			 * No kernel interface to release a file's blocks;
+			 * only libzpool's file vdevs can be trimmed.
+			 */
+			zio->io_error = ENOTSUP;
+#else
+			zio->io_error = vn_space(vf->vf_vnode,
+			    zio->io_offset, zio->io_size);
+#endif
+			if (zio->io_error == ENOTSUP)
+				vd->vdev_notrim = B_TRUE;
+			break;
 		default:
 			zio->io_error = ENOTSUP;
 		}
@@ -207,15 +263,8 @@ vdev_file_io_start(zio_t *zio)
 		return;
 	}
 
-	zio->io_error = vn_rdwr(zio->io_type == ZIO_TYPE_READ ?
-	    UIO_READ : UIO_WRITE, vf->vf_vnode, zio->io_data,
-	    zio->io_size, zio->io_offset, UIO_SYSSPACE,
-	    0, RLIM64_INFINITY, kcred, &resid);
-
-	if (resid != 0 && zio->io_error == 0)
-		zio->io_error = ENOSPC;
-
-	zio_next_stage_async(zio);
+	(void) taskq_dispatch(vf->vf_taskq, vdev_file_io_strategy, zio,
+	    TQ_SLEEP);
 }
 
 static void
@@ -53,7 +53,17 @@ int zfs_vdev_ramp_rate = 2;
  * i/os will be aggregated into a single large i/o up to
  * zfs_vdev_aggregation_limit bytes long.
  */
-int zfs_vdev_aggregation_limit = SPA_MAXBLOCKSIZE;
+int zfs_vdev_aggregation_limit = SPA_OLD_MAXBLOCKSIZE;
+
+/*
+ * Reads that were not issued by the scrub thread are considered demand
+ * reads.  We keep a count of those waiting in the queue and a moving
+ * average of how long they waited, so that the scrub throttle can tell
+ * whether foreground I/O is suffering.
+ */
+#define	VDQ_DEMAND(zio)	((zio)->io_type == ZIO_TYPE_READ && \
+	!((zio)->io_flags & ZIO_FLAG_SCRUB_THREAD))
+#define	VDQ_WAIT_SHIFT	8
 
 /*
  * Virtual device vector for disk I/O scheduling.
@@ -139,6 +149,11 @@ vdev_queue_io_add(vdev_queue_t *vq, zio_t *zio)
 {
 	avl_add(&vq->vq_deadline_tree, zio);
 	avl_add(zio->io_vdev_tree, zio);
+
+	if (VDQ_DEMAND(zio)) {
+		vq->vq_demand_queued++;
+		vq->vq_demand_last = lbolt64;
+	}
 }
 
 static void
@@ -146,6 +161,15 @@ vdev_queue_io_remove(vdev_queue_t *vq, zio_t *zio)
 {
 	avl_remove(&vq->vq_deadline_tree, zio);
 	avl_remove(zio->io_vdev_tree, zio);
+
+	if (VDQ_DEMAND(zio)) {
+		uint64_t wait = lbolt64 - zio->io_timestamp;
+
+		ASSERT(vq->vq_demand_queued != 0);
+		vq->vq_demand_queued--;
+		vq->vq_demand_wait = (7 * vq->vq_demand_wait +
+		    (wait << VDQ_WAIT_SHIFT)) >> 3;
+	}
 }
 
 static void
@@ -321,3 +345,28 @@ vdev_queue_io_done(zio_t *zio)
 
 	mutex_exit(&vq->vq_lock);
 }
+
+/*
+ * Sample the demand read load on vd and all of its children.  The number
+ * of queued demand reads is summed; the average queue wait (in ticks) and
+ * the time of the most recent demand read are the maximum over all leaves.
+ */
+void
+vdev_queue_demand(vdev_t *vd, uint64_t *queued, uint64_t *wait,
+    uint64_t *last)
+{
+	vdev_queue_t *vq = &vd->vdev_queue;
+	int c;
+
+	for (c = 0; c < vd->vdev_children; c++)
+		vdev_queue_demand(vd->vdev_child[c], queued, wait, last);
+
+	if (!vd->vdev_ops->vdev_op_leaf)
+		return;
+
+	mutex_enter(&vq->vq_lock);
+	*queued += vq->vq_demand_queued;
+	*wait = MAX(*wait, vq->vq_demand_wait >> VDQ_WAIT_SHIFT);
+	*last = MAX(*last, vq->vq_demand_last);
+	mutex_exit(&vq->vq_lock);
+}
@@ -279,6 +279,28 @@ vdev_raidz_map_alloc(zio_t *zio, uint64_t unit_shift, uint64_t dcols,
 	return (rm);
 }
 
+/*
+ * Translate a range of the raidz vdev's address space into the range of
+ * child c that it covers.  Sector k of the raidz vdev lives on child
+ * (k % dcols) at row (k / dcols), so any contiguous range maps to one
+ * contiguous (possibly empty) range on each child.
+ */
+void
+vdev_raidz_child_range(vdev_t *vd, int c, uint64_t *offset, uint64_t *size)
+{
+	uint64_t unit_shift = vd->vdev_top->vdev_ashift;
+	uint64_t dcols = vd->vdev_children;
+	uint64_t b = *offset >> unit_shift;
+	uint64_t e = (*offset + *size) >> unit_shift;
+	uint64_t rb, re;
+
+	rb = (b > c) ? (b - c + dcols - 1) / dcols : 0;
+	re = (e > c) ? (e - c + dcols - 1) / dcols : 0;
+
+	*offset = rb << unit_shift;
+	*size = (re - rb) << unit_shift;
+}
+
 static void
 vdev_raidz_map_free(zio_t *zio)
 {
@@ -1443,6 +1443,7 @@ zfs_setacl(znode_t *zp, vsecattr_t *vsecp, cred_t *cr)
 	int		aclcnt = vsecp->vsa_aclcnt;
 	ulong_t		mask = vsecp->vsa_mask & (VSA_ACE | VSA_ACECNT);
 	dmu_tx_t	*tx;
+	boolean_t	waited = B_FALSE;
 	int		error;
 	int		inherit;
 	zfs_acl_t	*aclp;
@@ -1476,12 +1477,13 @@ top:
 		dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0, ZFS_ACL_SIZE(aclcnt));
 	}
 
-	error = dmu_tx_assign(tx, zfsvfs->z_assign);
+	error = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, waited));
 	if (error) {
 		mutex_exit(&zp->z_acl_lock);
 		mutex_exit(&zp->z_lock);
 
 		if (error == ERESTART && zfsvfs->z_assign == TXG_NOWAIT) {
+			waited = B_TRUE;
 			dmu_tx_wait(tx);
 			dmu_tx_abort(tx);
 			goto top;
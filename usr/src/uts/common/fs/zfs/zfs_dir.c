@@ -891,7 +891,11 @@ zfs_make_xattrdir(znode_t *zp, vattr_t *vap, vnode_t **xvpp, cred_t *cr)
 	tx = dmu_tx_create(zfsvfs->z_os);
 	dmu_tx_hold_bonus(tx, zp->z_id);
 	dmu_tx_hold_zap(tx, DMU_NEW_OBJECT, FALSE, NULL);
-	error = dmu_tx_assign(tx, zfsvfs->z_assign);
+	/*
+	 * Not throttled: our caller retries from the top on ERESTART,
+	 * so a delay here would be repeated on every attempt.
+	 */
+	error = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, B_TRUE));
 	if (error) {
 		if (error == ERESTART && zfsvfs->z_assign == TXG_NOWAIT)
 			dmu_tx_wait(tx);
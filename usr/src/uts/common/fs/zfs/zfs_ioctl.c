@@ -1332,6 +1332,27 @@ zfs_set_prop_nvlist(const char *name, nvlist_t *nvl)
 			}
 			break;
 		}
+
+		case ZFS_PROP_RECORDSIZE:
+			/*
+			 * Records larger than the old 128K maximum need a
+			 * pool that can store them.
+			 */
+			if (nvpair_type(elem) == DATA_TYPE_UINT64 &&
+			    nvpair_value_uint64(elem, &intval) == 0 &&
+			    intval > SPA_OLD_MAXBLOCKSIZE) {
+				spa_t *spa;
+
+				if (spa_open(name, &spa, FTAG) == 0) {
+					if (intval > spa_maxblocksize(spa)) {
+						spa_close(spa, FTAG);
+						return (ENOTSUP);
+					}
+
+					spa_close(spa, FTAG);
+				}
+			}
+			break;
 		}
 	}
 
@@ -1501,6 +1522,7 @@ zfs_ioc_pool_set_props(zfs_cmd_t *zc)
 
 		switch (prop) {
 		case ZPOOL_PROP_DELEGATION:
+		case ZPOOL_PROP_AUTOTRIM:
 			VERIFY(nvpair_value_uint64(elem, &intval) == 0);
 			if (intval > 1)
 				error = EINVAL;
@@ -1535,6 +1557,10 @@ zfs_ioc_pool_set_props(zfs_cmd_t *zc)
 			objnum = dmu_objset_id(os);
 			dmu_objset_close(os);
 			break;
+
+		case ZPOOL_PROP_FREEING:
+			error = EINVAL;
+			break;
 		}
 
 		if (error)
@@ -1582,6 +1608,28 @@ zfs_ioc_pool_get_props(zfs_cmd_t *zc)
 	return (error);
 }
 
+static int
+zfs_ioc_pool_txg_history(zfs_cmd_t *zc)
+{
+	spa_t *spa;
+	int error;
+	nvlist_t *nvp = NULL;
+
+	if ((error = spa_open(zc->zc_name, &spa, FTAG)) != 0)
+		return (error);
+
+	error = txg_history_get(spa_get_dsl(spa), &nvp);
+
+	if (error == 0)
+		error = put_nvlist(zc, nvp);
+
+	spa_close(spa, FTAG);
+
+	if (nvp)
+		nvlist_free(nvp);
+	return (error);
+}
+
 static int
 zfs_ioc_iscsi_perm_check(zfs_cmd_t *zc)
 {
@@ -2324,6 +2372,7 @@ static zfs_ioc_vec_t zfs_ioc_vec[] = {
 	    DATASET_NAME, B_FALSE },
 	{ zfs_ioc_share, zfs_secpolicy_share, DATASET_NAME, B_FALSE },
 	{ zfs_ioc_inherit_prop, zfs_secpolicy_inherit, DATASET_NAME, B_TRUE },
+	{ zfs_ioc_pool_txg_history, zfs_secpolicy_read, POOL_NAME, B_FALSE },
 };
 
 static int
@@ -215,7 +215,7 @@ zfs_log_rename(zilog_t *zilog, dmu_tx_t *tx, int txtype,
  */
 ssize_t zfs_immediate_write_sz = 32768;
 
-#define	ZIL_MAX_LOG_DATA (SPA_MAXBLOCKSIZE - sizeof (zil_trailer_t) - \
+#define	ZIL_MAX_LOG_DATA (ZIL_MAX_BLKSZ - sizeof (zil_trailer_t) - \
     sizeof (lr_write_t))
 
 void
@@ -224,6 +224,7 @@ zfs_log_write(zilog_t *zilog, dmu_tx_t *tx, int txtype,
 {
 	itx_wr_state_t write_state;
 	boolean_t slogging;
+	boolean_t throughput;
 	uintptr_t fsync_cnt = 0;
 
 	if (zilog == NULL || zp->z_unlinked)
@@ -234,12 +235,14 @@ zfs_log_write(zilog_t *zilog, dmu_tx_t *tx, int txtype,
 	 *
 	 * WR_INDIRECT:
 	 *    If the write is greater than zfs_immediate_write_sz and there are
-	 *    no separate logs in this pool then later *if* we need to log the
-	 *    write then dmu_sync() is used to immediately write the block and
-	 *    its block pointer is put in the log record.
+	 *    no separate logs in this pool (or the dataset has logbias set to
+	 *    throughput) then later *if* we need to log the write then
+	 *    dmu_sync() is used to immediately write the block to the main
+	 *    pool and its block pointer is put in the log record.
 	 * WR_COPIED:
 	 *    If we know we'll immediately be committing the
-	 *    transaction (FDSYNC (O_DSYNC)), the we allocate a larger
+	 *    transaction (FDSYNC (O_DSYNC), or the dataset has sync set
+	 *    to always), the we allocate a larger
 	 *    log record here for the data and copy the data in.
 	 * WR_NEED_COPY:
 	 *    Otherwise we don't allocate a buffer, and *if* we need to
@@ -247,9 +250,12 @@ zfs_log_write(zilog_t *zilog, dmu_tx_t *tx, int txtype,
 	 *    we retrieve the data using the dmu.
 	 */
 	slogging = spa_has_slogs(zilog->zl_spa);
-	if (resid > zfs_immediate_write_sz && !slogging)
+	throughput = (dmu_objset_logbias(zilog->zl_os) ==
+	    ZFS_LOGBIAS_THROUGHPUT);
+	if (resid > zfs_immediate_write_sz && (!slogging || throughput))
 		write_state = WR_INDIRECT;
-	else if (ioflag & FDSYNC)
+	else if ((ioflag & FDSYNC) ||
+	    dmu_objset_syncprop(zilog->zl_os) == ZFS_SYNC_ALWAYS)
 		write_state = WR_COPIED;
 	else
 		write_state = WR_NEED_COPY;
@@ -268,8 +274,9 @@ zfs_log_write(zilog_t *zilog, dmu_tx_t *tx, int txtype,
 		 * block, then because we don't want to use the main pool
 		 * to dmu_sync, we have to split the write.
 		 */
-		if (slogging && resid > ZIL_MAX_LOG_DATA)
-			len = SPA_MAXBLOCKSIZE >> 1;
+		if (slogging && write_state != WR_INDIRECT &&
+		    resid > ZIL_MAX_LOG_DATA)
+			len = ZIL_MAX_BLKSZ >> 1;
 		else
 			len = resid;
 
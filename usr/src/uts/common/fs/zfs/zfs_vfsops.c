@@ -197,6 +197,7 @@ zfs_vfs_sync(struct mount *mp, __unused int waitfor, __unused vfs_context_t cont
 	if (zfsvfs->z_mtime_vp != NULL) {
 		timestruc_t  mtime;
 		znode_t  *zp;
+		boolean_t  waited = B_FALSE;
 top:
 		zp = VTOZ(zfsvfs->z_mtime_vp);
 		ZFS_TIME_DECODE(&mtime, zp->z_phys->zp_mtime);
@@ -206,9 +207,10 @@ top:
 
 			tx = dmu_tx_create(zfsvfs->z_os);
 			dmu_tx_hold_bonus(tx, zp->z_id);
-			error = dmu_tx_assign(tx, zfsvfs->z_assign);
+			error = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, waited));
 			if (error) {
 				if (error == ERESTART && zfsvfs->z_assign == TXG_NOWAIT) {
+					waited = B_TRUE;
 					dmu_tx_wait(tx);
 					dmu_tx_abort(tx);
 					goto top;
@@ -428,8 +430,9 @@ blksz_changed_cb(void *arg, uint64_t newval)
 	zfsvfs_t *zfsvfs = arg;
 
 	if (newval < SPA_MINBLOCKSIZE ||
-	    newval > SPA_MAXBLOCKSIZE || !ISP2(newval))
-		newval = SPA_MAXBLOCKSIZE;
+	    newval > spa_maxblocksize(dmu_objset_spa(zfsvfs->z_os)) ||
+	    !ISP2(newval))
+		newval = SPA_OLD_MAXBLOCKSIZE;
 
 	zfsvfs->z_max_blksz = newval;
 	zfsvfs->z_vfs->vfs_bsize = newval;
@@ -703,7 +706,7 @@ zfs_domount(vfs_t *vfsp, char *osname, cred_t *cr)
 	zfsvfs->z_vfs = vfsp;
 	zfsvfs->z_parent = zfsvfs;
 	zfsvfs->z_assign = TXG_NOWAIT;
-	zfsvfs->z_max_blksz = SPA_MAXBLOCKSIZE;
+	zfsvfs->z_max_blksz = SPA_OLD_MAXBLOCKSIZE;
 	zfsvfs->z_show_ctldir = ZFS_SNAPDIR_VISIBLE;
 
 	mutex_init(&zfsvfs->z_znodes_lock, NULL, MUTEX_DEFAULT, NULL);
@@ -121,9 +121,11 @@
  *  (3)	All range locks must be grabbed before calling dmu_tx_assign(),
  *	as they can span dmu_tx_assign() calls.
  *
- *  (4)	Always pass zfsvfs->z_assign as the second argument to dmu_tx_assign().
- *	In normal operation, this will be TXG_NOWAIT.  During ZIL replay,
- *	it will be a specific txg.  Either way, dmu_tx_assign() never blocks.
+ *  (4)	Always pass ZFS_TXG_HOW(zfsvfs, waited) as the second argument to
+ *	dmu_tx_assign().  In normal operation, this will be TXG_NOWAIT, or
+ *	TXG_WAITED once the op has been through dmu_tx_wait().  During ZIL
+ *	replay, it will be a specific txg.  Either way, dmu_tx_assign()
+ *	never blocks.
  *	This is critical because we don't want to block while holding locks.
  *	Note, in particular, that if a lock is sometimes acquired before
  *	the tx assigns, and sometimes after (e.g. z_lock), then failing to
@@ -135,7 +137,9 @@
  *	forever, because the previous txg can't quiesce until B's tx commits.
  *
  *	If dmu_tx_assign() returns ERESTART and zfsvfs->z_assign is TXG_NOWAIT,
- *	then drop all locks, call dmu_tx_wait(), and try again.
+ *	then drop all locks, call dmu_tx_wait(), and try again.  That is
+ *	also where the write throttle delays the op, so set 'waited' first
+ *	to keep the retry from being delayed a second time.
  *
  *  (5)	If the operation succeeded, generate the intent log entry for it
  *	before dropping locks.  This ensures that the ordering of events
@@ -155,12 +159,14 @@
  *	rw_enter(...);			// grab any other locks you need
  *	tx = dmu_tx_create(...);	// get DMU tx
  *	dmu_tx_hold_*();		// hold each object you might modify
- *	error = dmu_tx_assign(tx, zfsvfs->z_assign);	// try to assign
+ *	error = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, waited));
+ *					// try to assign
  *	if (error) {
  *		rw_exit(...);		// drop locks
  *		zfs_dirent_unlock(dl);	// unlock directory entry
  *		VN_RELE(...);		// release held vnodes
  *		if (error == ERESTART && zfsvfs->z_assign == TXG_NOWAIT) {
+ *			waited = B_TRUE;	// don't throttle us again
  *			dmu_tx_wait(tx);
  *			dmu_tx_abort(tx);
  *			goto top;
@@ -879,6 +885,7 @@ zfs_write(vnode_t *vp, uio_t *uio, int ioflag, cred_t *cr, caller_context_t *ct)
 	ssize_t		tx_bytes = 0;
 	uint64_t	end_size;
 	dmu_tx_t	*tx;
+	boolean_t	waited = B_FALSE;
 	zfsvfs_t	*zfsvfs = zp->z_zfsvfs;
 	zilog_t		*zilog = zfsvfs->z_log;
 	offset_t	woff;
@@ -1006,10 +1013,11 @@ zfs_write(vnode_t *vp, uio_t *uio, int ioflag, cred_t *cr, caller_context_t *ct)
 		tx = dmu_tx_create(zfsvfs->z_os);
 		dmu_tx_hold_bonus(tx, zp->z_id);
 		dmu_tx_hold_write(tx, zp->z_id, woff, MIN(n, max_blksz));
-		error = dmu_tx_assign(tx, zfsvfs->z_assign);
+		error = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, waited));
 		if (error) {
 			if (error == ERESTART &&
 			    zfsvfs->z_assign == TXG_NOWAIT) {
+				waited = B_TRUE;
 				dmu_tx_wait(tx);
 				dmu_tx_abort(tx);
 				continue;
@@ -1017,6 +1025,7 @@ zfs_write(vnode_t *vp, uio_t *uio, int ioflag, cred_t *cr, caller_context_t *ct)
 			dmu_tx_abort(tx);
 			break;
 		}
+		waited = B_FALSE;	/* throttle the next chunk's tx */
 
 		/*
 		 * If zfs_range_lock() over-locked we grow the blocksize
@@ -1028,8 +1037,14 @@ zfs_write(vnode_t *vp, uio_t *uio, int ioflag, cred_t *cr, caller_context_t *ct)
 			uint64_t new_blksz;
 
 			if (zp->z_blksz > max_blksz) {
+				/*
+				 * The file's single block already outgrew
+				 * the recordsize; only let it round up to
+				 * the next power of 2.
+				 */
 				ASSERT(!ISP2(zp->z_blksz));
-				new_blksz = MIN(end_size, SPA_MAXBLOCKSIZE);
+				new_blksz = MIN(end_size,
+				    1ULL << highbit(zp->z_blksz));
 			} else {
 				new_blksz = MIN(end_size, max_blksz);
 			}
@@ -1137,6 +1152,8 @@ zfs_write(vnode_t *vp, uio_t *uio, int ioflag, cred_t *cr, caller_context_t *ct)
 
 	if (ioflag & (FSYNC | FDSYNC))
 		zil_commit(zilog, zp->z_last_itx, zp->z_id);
+	else
+		zil_commit_forced(zilog, zp->z_last_itx, zp->z_id);
 
 #ifdef __APPLE__
 	/* Mac OS X: pageout requires that the UBC file size be current. */
@@ -1518,6 +1535,7 @@ zfs_create(vnode_t *dvp, char *name, vattr_t *vap, vcexcl_t excl,
 	objset_t	*os = zfsvfs->z_os;
 	zfs_dirlock_t	*dl;
 	dmu_tx_t	*tx;
+	boolean_t	waited = B_FALSE;
 	int		error;
 	uint64_t	zoid;
 
@@ -1597,12 +1615,13 @@ top:
 #endif /* __APPLE__ */
 		if (dzp->z_phys->zp_flags & ZFS_INHERIT_ACE)
 			dmu_tx_hold_write(tx, DMU_NEW_OBJECT,
-			    0, SPA_MAXBLOCKSIZE);
-		error = dmu_tx_assign(tx, zfsvfs->z_assign);
+			    0, SPA_OLD_MAXBLOCKSIZE);
+		error = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, waited));
 		if (error) {
 			zfs_dirent_unlock(dl);
 			if (error == ERESTART &&
 			    zfsvfs->z_assign == TXG_NOWAIT) {
+				waited = B_TRUE;
 				dmu_tx_wait(tx);
 				dmu_tx_abort(tx);
 				goto top;
@@ -1725,6 +1744,8 @@ out:
 #endif /* __APPLE__ */
 	}
 
+	zil_commit_forced(zilog, UINT64_MAX, 0);
+
 	ZFS_EXIT(zfsvfs);
 	return (error);
 }
@@ -1764,6 +1785,7 @@ zfs_remove(vnode_t *dvp, char *name, cred_t *cr)
 	uint64_t	acl_obj, xattr_obj;
 	zfs_dirlock_t	*dl;
 	dmu_tx_t	*tx;
+	boolean_t	waited = B_FALSE;
 	boolean_t	may_delete_now = FALSE, delete_now = FALSE;
 	boolean_t	unlinked;
 	int		error;
@@ -1857,11 +1879,12 @@ top:
 	/* charge as an update -- would be nice not to charge at all */
 	dmu_tx_hold_zap(tx, zfsvfs->z_unlinkedobj, FALSE, NULL);
 
-	error = dmu_tx_assign(tx, zfsvfs->z_assign);
+	error = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, waited));
 	if (error) {
 		zfs_dirent_unlock(dl);
 		VN_RELE(vp);
 		if (error == ERESTART && zfsvfs->z_assign == TXG_NOWAIT) {
+			waited = B_TRUE;
 			dmu_tx_wait(tx);
 			dmu_tx_abort(tx);
 			goto top;
@@ -1953,6 +1976,8 @@ out:
 		VN_RELE(ZTOV(xzp));
 	}
 
+	zil_commit_forced(zilog, UINT64_MAX, 0);
+
 	ZFS_EXIT(zfsvfs);
 	return (error);
 }
@@ -1997,6 +2022,7 @@ zfs_mkdir(vnode_t *dvp, char *dirname, vattr_t *vap, vnode_t **vpp, cred_t *cr)
 	zfs_dirlock_t	*dl;
 	uint64_t	zoid = 0;
 	dmu_tx_t	*tx;
+	boolean_t	waited = B_FALSE;
 	int		error;
 
 	ASSERT(vap->va_type == VDIR);
@@ -2047,11 +2073,12 @@ top:
 	dmu_tx_hold_zap(tx, DMU_NEW_OBJECT, FALSE, NULL);
 	if (dzp->z_phys->zp_flags & ZFS_INHERIT_ACE)
 		dmu_tx_hold_write(tx, DMU_NEW_OBJECT,
-		    0, SPA_MAXBLOCKSIZE);
-	error = dmu_tx_assign(tx, zfsvfs->z_assign);
+		    0, SPA_OLD_MAXBLOCKSIZE);
+	error = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, waited));
 	if (error) {
 		zfs_dirent_unlock(dl);
 		if (error == ERESTART && zfsvfs->z_assign == TXG_NOWAIT) {
+			waited = B_TRUE;
 			dmu_tx_wait(tx);
 			dmu_tx_abort(tx);
 			goto top;
@@ -2088,6 +2115,8 @@ top:
 
 	zfs_dirent_unlock(dl);
 
+	zil_commit_forced(zilog, UINT64_MAX, 0);
+
 	ZFS_EXIT(zfsvfs);
 	return (0);
 }
@@ -2128,6 +2157,7 @@ zfs_rmdir(vnode_t *dvp, char *name, vnode_t *cwd, cred_t *cr)
 	zilog_t		*zilog = zfsvfs->z_log;
 	zfs_dirlock_t	*dl;
 	dmu_tx_t	*tx;
+	boolean_t	waited = B_FALSE;
 	int		error;
 
 	ZFS_ENTER(zfsvfs);
@@ -2196,13 +2226,14 @@ top:
 	dmu_tx_hold_zap(tx, dzp->z_id, FALSE, name);
 	dmu_tx_hold_bonus(tx, zp->z_id);
 	dmu_tx_hold_zap(tx, zfsvfs->z_unlinkedobj, FALSE, NULL);
-	error = dmu_tx_assign(tx, zfsvfs->z_assign);
+	error = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, waited));
 	if (error) {
 		rw_exit(&zp->z_parent_lock);
 		rw_exit(&zp->z_name_lock);
 		zfs_dirent_unlock(dl);
 		VN_RELE(vp);
 		if (error == ERESTART && zfsvfs->z_assign == TXG_NOWAIT) {
+			waited = B_TRUE;
 			dmu_tx_wait(tx);
 			dmu_tx_abort(tx);
 			goto top;
@@ -2230,6 +2261,8 @@ out:
 	VN_RELE(vp);
 #endif /* __APPLE__ */
 
+	zil_commit_forced(zilog, UINT64_MAX, 0);
+
 	ZFS_EXIT(zfsvfs);
 	return (error);
 }
@@ -2873,6 +2906,7 @@ zfs_setattr(vnode_t *vp, vattr_t *vap, int flags, cred_t *cr,
 	zfsvfs_t	*zfsvfs = zp->z_zfsvfs;
 	zilog_t		*zilog = zfsvfs->z_log;
 	dmu_tx_t	*tx;
+	boolean_t	waited = B_FALSE;
 	int		trim_mask = 0;
 	uint64_t	new_mode = 0;
 	znode_t		*attrzp;
@@ -3070,7 +3104,8 @@ top:
 
 		if (zp->z_phys->zp_acl.z_acl_extern_obj)
 			dmu_tx_hold_write(tx,
-			    pzp->zp_acl.z_acl_extern_obj, 0, SPA_MAXBLOCKSIZE);
+			    pzp->zp_acl.z_acl_extern_obj, 0,
+			    SPA_OLD_MAXBLOCKSIZE);
 		else
 			dmu_tx_hold_write(tx, DMU_NEW_OBJECT,
 			    0, ZFS_ACL_SIZE(MAX_ACL_SIZE));
@@ -3092,7 +3127,7 @@ top:
 		dmu_tx_hold_bonus(tx, attrzp->z_id);
 	}
 
-	err = dmu_tx_assign(tx, zfsvfs->z_assign);
+	err = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, waited));
 	if (err) {
 		if (attrzp)
 // Issue 34
@@ -3102,6 +3137,7 @@ top:
 			VN_RELE(ZTOV(attrzp));
 #endif
 		if (err == ERESTART && zfsvfs->z_assign == TXG_NOWAIT) {
+			waited = B_TRUE;
 			dmu_tx_wait(tx);
 			dmu_tx_abort(tx);
 			goto top;
@@ -3250,6 +3286,8 @@ out:
 	}
 	dmu_tx_commit(tx);
 
+	zil_commit_forced(zilog, UINT64_MAX, 0);
+
 	ZFS_EXIT(zfsvfs);
 	return (err);
 }
@@ -3389,6 +3427,7 @@ zfs_rename(vnode_t *sdvp, char *snm, vnode_t *tdvp, char *tnm, cred_t *cr)
 	zilog_t		*zilog = zfsvfs->z_log;
 	zfs_dirlock_t	*sdl, *tdl;
 	dmu_tx_t	*tx;
+	boolean_t	waited = B_FALSE;
 	zfs_zlock_t	*zl;
 	int		cmp, serr, terr, error;
 
@@ -3567,7 +3606,7 @@ top:
 	if (tzp)
 		dmu_tx_hold_bonus(tx, tzp->z_id);	/* parent changes */
 	dmu_tx_hold_zap(tx, zfsvfs->z_unlinkedobj, FALSE, NULL);
-	error = dmu_tx_assign(tx, zfsvfs->z_assign);
+	error = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, waited));
 	if (error) {
 		if (zl != NULL)
 			zfs_rename_unlock(&zl);
@@ -3577,6 +3616,7 @@ top:
 		if (tzp)
 			VN_RELE(ZTOV(tzp));
 		if (error == ERESTART && zfsvfs->z_assign == TXG_NOWAIT) {
+			waited = B_TRUE;
 			dmu_tx_wait(tx);
 			dmu_tx_abort(tx);
 			goto top;
@@ -3623,6 +3663,8 @@ out:
 		VN_RELE(ZTOV(tzp));
 #endif
 
+	zil_commit_forced(zilog, UINT64_MAX, 0);
+
 	ZFS_EXIT(zfsvfs);
 	return (error);
 }
@@ -3660,6 +3702,7 @@ zfs_symlink(vnode_t *dvp, char *name, vattr_t *vap, char *link, cred_t *cr)
 	znode_t		*zp, *dzp = VTOZ(dvp);
 	zfs_dirlock_t	*dl;
 	dmu_tx_t	*tx;
+	boolean_t	waited = B_FALSE;
 	zfsvfs_t	*zfsvfs = dzp->z_zfsvfs;
 	zilog_t		*zilog = zfsvfs->z_log;
 	uint64_t	zoid;
@@ -3707,11 +3750,13 @@ top:
 	dmu_tx_hold_bonus(tx, dzp->z_id);
 	dmu_tx_hold_zap(tx, dzp->z_id, TRUE, name);
 	if (dzp->z_phys->zp_flags & ZFS_INHERIT_ACE)
-		dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0, SPA_MAXBLOCKSIZE);
-	error = dmu_tx_assign(tx, zfsvfs->z_assign);
+		dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0,
+		    SPA_OLD_MAXBLOCKSIZE);
+	error = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, waited));
 	if (error) {
 		zfs_dirent_unlock(dl);
 		if (error == ERESTART && zfsvfs->z_assign == TXG_NOWAIT) {
+			waited = B_TRUE;
 			dmu_tx_wait(tx);
 			dmu_tx_abort(tx);
 			goto top;
@@ -3780,6 +3825,8 @@ out:
 	VN_RELE(ZTOV(zp));
 #endif
 
+	zil_commit_forced(zilog, UINT64_MAX, 0);
+
 	ZFS_EXIT(zfsvfs);
 	return (error);
 }
@@ -3885,6 +3932,7 @@ zfs_link(vnode_t *tdvp, vnode_t *svp, char *name, cred_t *cr)
 	zilog_t		*zilog = zfsvfs->z_log;
 	zfs_dirlock_t	*dl;
 	dmu_tx_t	*tx;
+	boolean_t	waited = B_FALSE;
 	vnode_t		*realvp;
 	int		error;
 
@@ -3973,10 +4021,11 @@ top:
 	tx = dmu_tx_create(zfsvfs->z_os);
 	dmu_tx_hold_bonus(tx, szp->z_id);
 	dmu_tx_hold_zap(tx, dzp->z_id, TRUE, name);
-	error = dmu_tx_assign(tx, zfsvfs->z_assign);
+	error = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, waited));
 	if (error) {
 		zfs_dirent_unlock(dl);
 		if (error == ERESTART && zfsvfs->z_assign == TXG_NOWAIT) {
+			waited = B_TRUE;
 			dmu_tx_wait(tx);
 			dmu_tx_abort(tx);
 			goto top;
@@ -4001,6 +4050,8 @@ top:
         }
 #endif /* !__APPLE__ */
 
+	zil_commit_forced(zilog, UINT64_MAX, 0);
+
 	ZFS_EXIT(zfsvfs);
 	return (error);
 }
@@ -4164,6 +4215,7 @@ zfs_putapage(vnode_t *vp, page_t *pp, u_offset_t *offp,
 	zfsvfs_t	*zfsvfs = zp->z_zfsvfs;
 	zilog_t		*zilog = zfsvfs->z_log;
 	dmu_tx_t	*tx;
+	boolean_t	waited = B_FALSE;
 	rl_t		*rl;
 	uint64_t	filesz;
 	int		err;
@@ -4261,10 +4313,11 @@ top:
 	tx = dmu_tx_create(zfsvfs->z_os);
 	dmu_tx_hold_write(tx, zp->z_id, off, len);
 	dmu_tx_hold_bonus(tx, zp->z_id);
-	err = dmu_tx_assign(tx, zfsvfs->z_assign);
+	err = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, waited));
 	if (err != 0) {
 		if (err == ERESTART && zfsvfs->z_assign == TXG_NOWAIT) {
 			zfs_range_unlock(rl);
+			waited = B_TRUE;
 			dmu_tx_wait(tx);
 			dmu_tx_abort(tx);
 			goto top;
@@ -4315,6 +4368,8 @@ out:
 #ifdef __APPLE__
 	if (flags & UPL_IOSYNC)
 		zil_commit(zfsvfs->z_log, UINT64_MAX, zp->z_id);
+	else
+		zil_commit_forced(zfsvfs->z_log, UINT64_MAX, zp->z_id);
 
 	if (!(flags & UPL_NOCOMMIT)) {
 		if (err)
@@ -4694,6 +4749,7 @@ zfs_obtain_xattr(znode_t *dzp, const char *name, mode_t mode, cred_t *cr,
 	zilog_t  *zilog = zfsvfs->z_log;
 	zfs_dirlock_t  *dl;
 	dmu_tx_t  *tx;
+	boolean_t waited = B_FALSE;
 	struct vnode_attr  vattr;
 	uint64_t  zoid;
 	int error;
@@ -4720,12 +4776,14 @@ top:
 	dmu_tx_hold_bonus(tx, dzp->z_id);
 	dmu_tx_hold_zap(tx, dzp->z_id, TRUE, (char *)name);
 	if (dzp->z_phys->zp_flags & ZFS_INHERIT_ACE) {
-		dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0, SPA_MAXBLOCKSIZE);
+		dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0,
+		    SPA_OLD_MAXBLOCKSIZE);
 	}
-	error = dmu_tx_assign(tx, zfsvfs->z_assign);
+	error = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, waited));
 	if (error) {
 		zfs_dirent_unlock(dl);
 		if ((error == ERESTART) && (zfsvfs->z_assign == TXG_NOWAIT)) {
+			waited = B_TRUE;
 			dmu_tx_wait(tx);
 			dmu_tx_abort(tx);
 			goto top;
@@ -4833,6 +4891,8 @@ zfs_putpage(vnode_t *vp, offset_t off, size_t len, int flags, cred_t *cr)
 out:
 	if ((flags & B_ASYNC) == 0)
 		zil_commit(zfsvfs->z_log, UINT64_MAX, zp->z_id);
+	else
+		zil_commit_forced(zfsvfs->z_log, UINT64_MAX, zp->z_id);
 	ZFS_EXIT(zfsvfs);
 	return (error);
 }
@@ -1350,7 +1350,7 @@ zfs_freesp(znode_t *zp, uint64_t off, uint64_t len, int flag, boolean_t log)
 		 */
 		if (zp->z_blksz > zp->z_zfsvfs->z_max_blksz) {
 			ASSERT(!ISP2(zp->z_blksz));
-			new_blksz = MIN(end, SPA_MAXBLOCKSIZE);
+			new_blksz = MIN(end, 1ULL << highbit(zp->z_blksz));
 		} else {
 			new_blksz = MIN(end, zp->z_zfsvfs->z_max_blksz);
 		}
@@ -1362,7 +1362,11 @@ zfs_freesp(znode_t *zp, uint64_t off, uint64_t len, int flag, boolean_t log)
 		dmu_tx_hold_free(tx, zp->z_id, off, len ? len : DMU_OBJECT_END);
 	}
 
-	error = dmu_tx_assign(tx, zfsvfs->z_assign);
+	/*
+	 * Not throttled: our caller retries from the top on ERESTART,
+	 * so a delay here would be repeated on every attempt.
+	 */
+	error = dmu_tx_assign(tx, ZFS_TXG_HOW(zfsvfs, B_TRUE));
 	if (error) {
 		if (error == ERESTART && zfsvfs->z_assign == TXG_NOWAIT)
 			dmu_tx_wait(tx);
@@ -78,6 +78,62 @@ int zil_disable = 0;	/* disable intent logging */
  */
 boolean_t zfs_nocacheflush = B_FALSE;
 
+/*
+ * Set to find a commit's records by walking the whole zl_itx_list, as
+ * was done before the per-object lists, instead of merging the common
+ * and per-object lists.  That walk also pushes every other file's
+ * itx_sync records.  Only useful for comparing the two.
+ */
+int zil_itx_lists_disable = 0;
+
+/*
+ * Log block statistics.  Waste is the unused data space of issued
+ * blocks; commits are bucketed by the number of blocks they issued
+ * (bucket N counts commits of 2^N to 2^(N+1) - 1 blocks).  Forced
+ * commits were made for sync=always datasets on behalf of writers that
+ * did not ask for them; elided commits were skipped for sync=disabled.
+ * Replay counts the records applied and the indirect write blocks read.
+ */
+typedef struct zil_stats {
+	kstat_named_t zilstat_commits;
+	kstat_named_t zilstat_commits_forced;
+	kstat_named_t zilstat_commits_elided;
+	kstat_named_t zilstat_lwbs;
+	kstat_named_t zilstat_lwb_bytes;
+	kstat_named_t zilstat_lwb_waste_bytes;
+	kstat_named_t zilstat_commit_lwbs[6];
+	kstat_named_t zilstat_replay_records;
+	kstat_named_t zilstat_replay_reads;
+	kstat_named_t zilstat_replay_errors;
+} zil_stats_t;
+
+static zil_stats_t zil_stats = {
+	{ "commits",			KSTAT_DATA_UINT64 },
+	{ "commits_forced",		KSTAT_DATA_UINT64 },
+	{ "commits_elided",		KSTAT_DATA_UINT64 },
+	{ "lwbs",			KSTAT_DATA_UINT64 },
+	{ "lwb_bytes",			KSTAT_DATA_UINT64 },
+	{ "lwb_waste_bytes",		KSTAT_DATA_UINT64 },
+	{
+		{ "commit_lwbs_1",	KSTAT_DATA_UINT64 },
+		{ "commit_lwbs_2",	KSTAT_DATA_UINT64 },
+		{ "commit_lwbs_4",	KSTAT_DATA_UINT64 },
+		{ "commit_lwbs_8",	KSTAT_DATA_UINT64 },
+		{ "commit_lwbs_16",	KSTAT_DATA_UINT64 },
+		{ "commit_lwbs_32",	KSTAT_DATA_UINT64 }
+	},
+	{ "replay_records",		KSTAT_DATA_UINT64 },
+	{ "replay_reads",		KSTAT_DATA_UINT64 },
+	{ "replay_errors",		KSTAT_DATA_UINT64 }
+};
+
+#define	ZILSTAT_INCR(stat, val) \
+	atomic_add_64(&zil_stats.stat.value.ui64, (val));
+
+#define	ZILSTAT_BUMP(stat)	ZILSTAT_INCR(stat, 1)
+
+static kstat_t *zil_ksp;
+
 static kmem_cache_t *zil_lwb_cache;
 
 static int
@@ -373,6 +429,7 @@ zil_create(zilog_t *zilog)
 		lwb->lwb_sz = BP_GET_LSIZE(&lwb->lwb_blk);
 		lwb->lwb_buf = zio_buf_alloc(lwb->lwb_sz);
 		lwb->lwb_max_txg = txg;
+		lwb->lwb_seq = 0;
 		lwb->lwb_zio = NULL;
 
 		mutex_enter(&zilog->zl_lock);
@@ -532,8 +589,14 @@ zil_add_vdev(zilog_t *zilog, uint64_t vdev)
 		return;
 
 	if (vdev < bmap_sz) {
+		/*
+		 * zil_flush_vdevs() takes and clears the bitmap under
+		 * zl_lock, so we can't just set the bit atomically.
+		 */
 		cp = zilog->zl_vdev_bmap + (vdev / 8);
-		atomic_or_8(cp, 1 << (vdev % 8));
+		mutex_enter(&zilog->zl_lock);
+		*cp |= 1 << (vdev % 8);
+		mutex_exit(&zilog->zl_lock);
 	} else  {
 		/*
 		 * insert into ordered list
@@ -566,20 +629,35 @@ zil_add_vdev(zilog_t *zilog, uint64_t vdev)
 	}
 }
 
+/*
+ * Flush the write caches of all vdevs written since the last flush.
+ * Called with zl_lock held by the thread that set zl_flushing; the lock
+ * is dropped while the flushes are outstanding.
+ */
 static void
 zil_flush_vdevs(zilog_t *zilog)
 {
 	zil_vdev_t *zv;
 	zio_t *zio = NULL;
 	spa_t *spa = zilog->zl_spa;
+	uint8_t bmap[ZIL_VDEV_BMSZ];
+	list_t vdev_list;
 	uint64_t vdev;
 	uint8_t b;
 	int i, j;
 
-	ASSERT(zilog->zl_writer);
+	ASSERT(MUTEX_HELD(&zilog->zl_lock));
+	ASSERT(zilog->zl_flushing);
 
-	for (i = 0; i < sizeof (zilog->zl_vdev_bmap); i++) {
-		b = zilog->zl_vdev_bmap[i];
+	bcopy(zilog->zl_vdev_bmap, bmap, sizeof (bmap));
+	bzero(zilog->zl_vdev_bmap, sizeof (bmap));
+	list_create(&vdev_list, sizeof (zil_vdev_t),
+	    offsetof(zil_vdev_t, vdev_seq_node));
+	list_move_tail(&vdev_list, &zilog->zl_vdev_list);
+	mutex_exit(&zilog->zl_lock);
+
+	for (i = 0; i < sizeof (bmap); i++) {
+		b = bmap[i];
 		if (b == 0)
 			continue;
 		for (j = 0; j < 8; j++) {
@@ -588,20 +666,23 @@ zil_flush_vdevs(zilog_t *zilog)
 				zio_flush_vdev(spa, vdev, &zio);
 			}
 		}
-		zilog->zl_vdev_bmap[i] = 0;
 	}
 
-	while ((zv = list_head(&zilog->zl_vdev_list)) != NULL) {
+	while ((zv = list_head(&vdev_list)) != NULL) {
 		zio_flush_vdev(spa, zv->vdev, &zio);
-		list_remove(&zilog->zl_vdev_list, zv);
+		list_remove(&vdev_list, zv);
 		kmem_free(zv, sizeof (zil_vdev_t));
 	}
+	list_destroy(&vdev_list);
+
 	/*
 	 * Wait for all the flushes to complete.  Not all devices actually
 	 * support the DKIOCFLUSHWRITECACHE ioctl, so it's OK if it fails.
 	 */
 	if (zio)
 		(void) zio_wait(zio);
+
+	mutex_enter(&zilog->zl_lock);
 }
 
 /*
@@ -620,11 +701,30 @@ zil_lwb_write_done(zio_t *zio)
 	 */
 	txg_rele_to_sync(&lwb->lwb_txgh);
 
+	/* Record the vdev for the flush that makes this block stable */
+	zil_add_vdev(zilog, DVA_GET_VDEV(BP_IDENTITY(&lwb->lwb_blk)));
+
 	zio_buf_free(lwb->lwb_buf, lwb->lwb_sz);
 	mutex_enter(&zilog->zl_lock);
 	lwb->lwb_buf = NULL;
 	if (zio->io_error)
 		zilog->zl_log_error = B_TRUE;
+
+	/*
+	 * Log blocks can complete out of order, but a committer needs its
+	 * block and every block before it, so advance zl_lwb_written only
+	 * across the run of blocks that are now all written.
+	 */
+	for (lwb = list_head(&zilog->zl_lwb_list); lwb != NULL;
+	    lwb = list_next(&zilog->zl_lwb_list, lwb)) {
+		if (lwb->lwb_seq <= zilog->zl_lwb_written)
+			continue;
+		if (lwb->lwb_seq != zilog->zl_lwb_written + 1 ||
+		    lwb->lwb_buf != NULL)
+			break;
+		zilog->zl_lwb_written = lwb->lwb_seq;
+	}
+	cv_broadcast(&zilog->zl_cv_lwb);
 	mutex_exit(&zilog->zl_lock);
 }
 
@@ -644,18 +744,27 @@ zil_lwb_write_init(zilog_t *zilog, lwb_t *lwb)
 	zb.zb_level = -1;
 	zb.zb_blkid = lwb->lwb_blk.blk_cksum.zc_word[ZIL_ZC_SEQ];
 
-	if (zilog->zl_root_zio == NULL) {
-		zilog->zl_root_zio = zio_root(zilog->zl_spa, NULL, NULL,
-		    ZIO_FLAG_CANFAIL);
-	}
 	if (lwb->lwb_zio == NULL) {
-		lwb->lwb_zio = zio_rewrite(zilog->zl_root_zio, zilog->zl_spa,
+		lwb->lwb_zio = zio_rewrite(NULL, zilog->zl_spa,
 		    ZIO_CHECKSUM_ZILOG, 0, &lwb->lwb_blk, lwb->lwb_buf,
 		    lwb->lwb_sz, zil_lwb_write_done, lwb,
 		    ZIO_PRIORITY_LOG_WRITE, ZIO_FLAG_CANFAIL, &zb);
 	}
 }
 
+/*
+ * Round a log block size up to a power of 2 between ZIL_MIN_BLKSZ and
+ * ZIL_MAX_BLKSZ, so that blocks fit device and allocator alignment.
+ */
+static uint64_t
+zil_lwb_bucket(uint64_t size)
+{
+	size = MAX(size, ZIL_MIN_BLKSZ);
+	if (!ISP2(size))
+		size = 1ULL << highbit(size);
+	return (MIN(size, ZIL_MAX_BLKSZ));
+}
+
 /*
  * Start a log block write and advance to the next log block.
  * Calls are serialized.
@@ -669,10 +778,16 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 	blkptr_t *bp = &ztp->zit_next_blk;
 	uint64_t txg;
 	uint64_t zil_blksz;
-	int error;
+	int error, i;
 
 	ASSERT(lwb->lwb_nused <= ZIL_BLK_DATA_SZ(lwb));
 
+	zilog->zl_cur_lwbs++;
+	ZILSTAT_BUMP(zilstat_lwbs);
+	ZILSTAT_INCR(zilstat_lwb_bytes, lwb->lwb_sz);
+	ZILSTAT_INCR(zilstat_lwb_waste_bytes,
+	    ZIL_BLK_DATA_SZ(lwb) - lwb->lwb_nused);
+
 	/*
 	 * Allocate the next block and save its address in this block
 	 * before writing it in order to establish the log chain.
@@ -684,16 +799,12 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 	txg_rele_to_quiesce(&lwb->lwb_txgh);
 
 	/*
-	 * Pick a ZIL blocksize. We request a size that is the
-	 * maximum of the previous used size, the current used size and
-	 * the amount waiting in the queue.
+	 * Pick a ZIL blocksize: the largest of the recent commits, or of
+	 * what this commit has used so far if that's more.
 	 */
-	zil_blksz = MAX(zilog->zl_prev_used,
-	    zilog->zl_cur_used + sizeof (*ztp));
-	zil_blksz = MAX(zil_blksz, zilog->zl_itx_list_sz + sizeof (*ztp));
-	zil_blksz = P2ROUNDUP_TYPED(zil_blksz, ZIL_MIN_BLKSZ, uint64_t);
-	if (zil_blksz > ZIL_MAX_BLKSZ)
-		zil_blksz = ZIL_MAX_BLKSZ;
+	zil_blksz = zil_lwb_bucket(zilog->zl_cur_used + sizeof (*ztp));
+	for (i = 0; i < ZIL_PREV_BLKS; i++)
+		zil_blksz = MAX(zil_blksz, zilog->zl_prev_blks[i]);
 
 	BP_ZERO(bp);
 	/* pass the old blkptr in order to spread log blocks across devs */
@@ -717,6 +828,9 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 		ztp->zit_pad = 0;
 		ztp->zit_nused = lwb->lwb_nused;
 		ztp->zit_bt.zbt_cksum = lwb->lwb_blk.blk_cksum;
+		mutex_enter(&zilog->zl_lock);
+		lwb->lwb_seq = ++zilog->zl_lwb_seq;
+		mutex_exit(&zilog->zl_lock);
 		zio_nowait(lwb->lwb_zio);
 
 		/*
@@ -743,18 +857,18 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 	nlwb->lwb_sz = BP_GET_LSIZE(&nlwb->lwb_blk);
 	nlwb->lwb_buf = zio_buf_alloc(nlwb->lwb_sz);
 	nlwb->lwb_max_txg = txg;
+	nlwb->lwb_seq = 0;
 	nlwb->lwb_zio = NULL;
 
 	/*
-	 * Put new lwb at the end of the log chain
+	 * Put new lwb at the end of the log chain, and number the old one
+	 * so committers can wait for it.
 	 */
 	mutex_enter(&zilog->zl_lock);
 	list_insert_tail(&zilog->zl_lwb_list, nlwb);
+	lwb->lwb_seq = ++zilog->zl_lwb_seq;
 	mutex_exit(&zilog->zl_lock);
 
-	/* Record the vdev for later flushing */
-	zil_add_vdev(zilog, DVA_GET_VDEV(BP_IDENTITY(&(lwb->lwb_blk))));
-
 	/*
 	 * kick off the write for the old log block
 	 */
@@ -848,6 +962,156 @@ zil_lwb_commit(zilog_t *zilog, itx_t *itx, lwb_t *lwb)
 	return (lwb);
 }
 
+/*
+ * Return the object a log record modifies, or 0 if it is a namespace
+ * operation that has to stay ordered against all other records.
+ */
+static uint64_t
+zil_lr_foid(lr_t *lr)
+{
+	switch (lr->lrc_txtype) {
+	case TX_SETATTR:
+	case TX_WRITE:
+	case TX_TRUNCATE:
+	case TX_ACL:
+		/* lr_foid is same offset for these records */
+		return (((lr_write_t *)lr)->lr_foid);
+	}
+	return (0);
+}
+
+static int
+zil_obj_itxs_compare(const void *x1, const void *x2)
+{
+	const zil_obj_itxs_t *zoi1 = x1;
+	const zil_obj_itxs_t *zoi2 = x2;
+
+	if (zoi1->zoi_foid < zoi2->zoi_foid)
+		return (-1);
+	if (zoi1->zoi_foid > zoi2->zoi_foid)
+		return (1);
+	return (0);
+}
+
+static zil_obj_itxs_t *
+zil_obj_itxs_find(zilog_t *zilog, uint64_t foid)
+{
+	zil_obj_itxs_t search;
+
+	search.zoi_foid = foid;
+	return (avl_find(&zilog->zl_itx_objs, &search, NULL));
+}
+
+/*
+ * Add an itx to the end of zl_itx_list and of its per-object or common
+ * list.  Called with zl_lock held.
+ */
+static void
+zil_itx_insert(zilog_t *zilog, itx_t *itx)
+{
+	uint64_t foid = zil_lr_foid(&itx->itx_lr);
+	zil_obj_itxs_t *zoi;
+	avl_index_t where;
+
+	ASSERT(MUTEX_HELD(&zilog->zl_lock));
+
+	list_insert_tail(&zilog->zl_itx_list, itx);
+
+	if (foid == 0) {
+		list_insert_tail(&zilog->zl_itx_common, itx);
+		return;
+	}
+
+	zoi = zil_obj_itxs_find(zilog, foid);
+	if (zoi == NULL) {
+		zoi = kmem_alloc(sizeof (zil_obj_itxs_t), KM_SLEEP);
+		zoi->zoi_foid = foid;
+		list_create(&zoi->zoi_list, sizeof (itx_t),
+		    offsetof(itx_t, itx_obj_node));
+		VERIFY(avl_find(&zilog->zl_itx_objs, zoi, &where) == NULL);
+		avl_insert(&zilog->zl_itx_objs, zoi, where);
+	}
+	list_insert_tail(&zoi->zoi_list, itx);
+}
+
+/*
+ * Take an itx off all its lists.  Called with zl_lock held.
+ */
+static void
+zil_itx_remove(zilog_t *zilog, itx_t *itx)
+{
+	uint64_t foid = zil_lr_foid(&itx->itx_lr);
+	zil_obj_itxs_t *zoi;
+
+	ASSERT(MUTEX_HELD(&zilog->zl_lock));
+
+	list_remove(&zilog->zl_itx_list, itx);
+
+	if (foid == 0) {
+		list_remove(&zilog->zl_itx_common, itx);
+		return;
+	}
+
+	zoi = zil_obj_itxs_find(zilog, foid);
+	ASSERT(zoi != NULL);
+	list_remove(&zoi->zoi_list, itx);
+	if (list_is_empty(&zoi->zoi_list)) {
+		avl_remove(&zilog->zl_itx_objs, zoi);
+		list_destroy(&zoi->zoi_list);
+		kmem_free(zoi, sizeof (zil_obj_itxs_t));
+	}
+}
+
+/*
+ * Return the next itx to push for a commit of foid: the older of the heads
+ * of the common list and foid's list, so that the object's records stay
+ * in order with the namespace operations around them.  If foid is 0,
+ * everything is pushed, so it's simply the oldest itx.
+ */
+static itx_t *
+zil_itx_next(zilog_t *zilog, uint64_t foid)
+{
+	zil_obj_itxs_t *zoi;
+	itx_t *citx, *oitx;
+
+	ASSERT(MUTEX_HELD(&zilog->zl_lock));
+
+	if (foid == 0)
+		return (list_head(&zilog->zl_itx_list));
+
+	citx = list_head(&zilog->zl_itx_common);
+	zoi = zil_obj_itxs_find(zilog, foid);
+	oitx = (zoi != NULL) ? list_head(&zoi->zoi_list) : NULL;
+
+	if (citx == NULL)
+		return (oitx);
+	if (oitx == NULL)
+		return (citx);
+	return (citx->itx_lr.lrc_seq < oitx->itx_lr.lrc_seq ? citx : oitx);
+}
+
+/*
+ * The zil_itx_lists_disable version of zil_itx_next(): walk zl_itx_list
+ * from itx, skipping other files' TX_WRITE, TX_TRUNCATE, TX_SETATTR and
+ * TX_ACL records unless they're synchronous.
+ */
+static itx_t *
+zil_itx_scan(zilog_t *zilog, itx_t *itx, uint64_t foid)
+{
+	ASSERT(MUTEX_HELD(&zilog->zl_lock));
+
+	for (; itx != NULL; itx = list_next(&zilog->zl_itx_list, itx)) {
+		if (foid == 0) /* push all foids? */
+			break;
+		if (itx->itx_sync) /* push all O_[D]SYNC */
+			break;
+		if (zil_lr_foid(&itx->itx_lr) == 0 ||
+		    zil_lr_foid(&itx->itx_lr) == foid)
+			break;
+	}
+	return (itx);
+}
+
 itx_t *
 zil_itx_create(int txtype, size_t lrsize)
 {
@@ -871,7 +1135,7 @@ zil_itx_assign(zilog_t *zilog, itx_t *itx, dmu_tx_t *tx)
 	ASSERT(itx->itx_lr.lrc_seq == 0);
 
 	mutex_enter(&zilog->zl_lock);
-	list_insert_tail(&zilog->zl_itx_list, itx);
+	zil_itx_insert(zilog, itx);
 	zilog->zl_itx_list_sz += itx->itx_lr.lrc_reclen;
 	itx->itx_lr.lrc_txg = dmu_tx_get_txg(tx);
 	itx->itx_lr.lrc_seq = seq = ++zilog->zl_itx_seq;
@@ -907,7 +1171,7 @@ zil_itx_clean(zilog_t *zilog)
 	 */
 	while ((itx = list_head(&zilog->zl_itx_list)) != NULL &&
 	    itx->itx_lr.lrc_txg <= MIN(synced_txg, freeze_txg)) {
-		list_remove(&zilog->zl_itx_list, itx);
+		zil_itx_remove(zilog, itx);
 		zilog->zl_itx_list_sz -= itx->itx_lr.lrc_reclen;
 		list_insert_tail(&clean_list, itx);
 	}
@@ -949,11 +1213,11 @@ zil_commit_writer(zilog_t *zilog, uint64_t seq, uint64_t foid)
 	uint64_t reclen;
 	uint64_t commit_seq = 0;
 	itx_t *itx, *itx_next = (itx_t *)-1;
+	boolean_t scan = zil_itx_lists_disable;
 	lwb_t *lwb;
 	spa_t *spa;
 
 	zilog->zl_writer = B_TRUE;
-	zilog->zl_root_zio = NULL;
 	spa = zilog->zl_spa;
 
 	if (zilog->zl_suspend) {
@@ -980,33 +1244,19 @@ zil_commit_writer(zilog_t *zilog, uint64_t seq, uint64_t foid)
 	DTRACE_PROBE1(zil__cw1, zilog_t *, zilog);
 	for (;;) {
 		/*
-		 * Find the next itx to push:
-		 * Push all transactions related to specified foid and all
-		 * other transactions except TX_WRITE, TX_TRUNCATE,
-		 * TX_SETATTR and TX_ACL for all other files.
+		 * Find the next itx to push: all transactions related to
+		 * the specified foid, and all transactions that aren't
+		 * tied to a single file.  Other files' TX_WRITE,
+		 * TX_TRUNCATE, TX_SETATTR and TX_ACL records are on their
+		 * own lists, so we never have to walk past them.
 		 */
-		if (itx_next != (itx_t *)-1)
-			itx = itx_next;
+		if (!scan)
+			itx = zil_itx_next(zilog, foid);
+		else if (itx_next != (itx_t *)-1)
+			itx = zil_itx_scan(zilog, itx_next, foid);
 		else
-			itx = list_head(&zilog->zl_itx_list);
-		for (; itx != NULL; itx = list_next(&zilog->zl_itx_list, itx)) {
-			if (foid == 0) /* push all foids? */
-				break;
-			if (itx->itx_sync) /* push all O_[D]SYNC */
-				break;
-			switch (itx->itx_lr.lrc_txtype) {
-			case TX_SETATTR:
-			case TX_WRITE:
-			case TX_TRUNCATE:
-			case TX_ACL:
-				/* lr_foid is same offset for these records */
-				if (((lr_write_t *)&itx->itx_lr)->lr_foid
-				    != foid) {
-					continue; /* skip this record */
-				}
-			}
-			break;
-		}
+			itx = zil_itx_scan(zilog,
+			    list_head(&zilog->zl_itx_list), foid);
 		if (itx == NULL)
 			break;
 
@@ -1018,13 +1268,15 @@ zil_commit_writer(zilog_t *zilog, uint64_t seq, uint64_t foid)
 		}
 
 		/*
-		 * Save the next pointer.  Even though we soon drop
-		 * zl_lock all threads that may change the list
-		 * (another writer or zil_itx_clean) can't do so until
-		 * they have zl_writer.
+		 * Take the itx off its lists before dropping zl_lock.
+		 * zil_itx_assign() only appends, and the other threads
+		 * that remove itxs (another writer or zil_itx_clean)
+		 * can't do so until they have zl_writer.  The same goes
+		 * for the next pointer a scan resumes from.
 		 */
-		itx_next = list_next(&zilog->zl_itx_list, itx);
-		list_remove(&zilog->zl_itx_list, itx);
+		if (scan)
+			itx_next = list_next(&zilog->zl_itx_list, itx);
+		zil_itx_remove(zilog, itx);
 		mutex_exit(&zilog->zl_lock);
 		txg = itx->itx_lr.lrc_txg;
 		ASSERT(txg);
@@ -1050,24 +1302,32 @@ zil_commit_writer(zilog_t *zilog, uint64_t seq, uint64_t foid)
 	if (lwb != NULL && lwb->lwb_zio != NULL)
 		lwb = zil_lwb_write_start(zilog, lwb);
 
-	zilog->zl_prev_used = zilog->zl_cur_used;
-	zilog->zl_cur_used = 0;
-
 	/*
-	 * Wait if necessary for the log blocks to be on stable storage.
+	 * Remember the size of this commit for sizing future log blocks.
 	 */
-	if (zilog->zl_root_zio) {
-		DTRACE_PROBE1(zil__cw3, zilog_t *, zilog);
-		(void) zio_wait(zilog->zl_root_zio);
-		DTRACE_PROBE1(zil__cw4, zilog_t *, zilog);
-		if (!zfs_nocacheflush)
-			zil_flush_vdevs(zilog);
+	if (zilog->zl_cur_used != 0) {
+		zilog->zl_prev_blks[zilog->zl_prev_rotor] =
+		    zil_lwb_bucket(zilog->zl_cur_used + sizeof (zil_trailer_t));
+		zilog->zl_prev_rotor =
+		    (zilog->zl_prev_rotor + 1) & (ZIL_PREV_BLKS - 1);
 	}
+	zilog->zl_cur_used = 0;
 
-	if (zilog->zl_log_error || lwb == NULL) {
-		zilog->zl_log_error = 0;
-		txg_wait_synced(zilog->zl_dmu_pool, 0);
+	ZILSTAT_BUMP(zilstat_commits);
+	txg_history_zil_commit(zilog->zl_dmu_pool);
+	if (zilog->zl_cur_lwbs != 0) {
+		ZILSTAT_BUMP(zilstat_commit_lwbs[MIN(highbit(
+		    zilog->zl_cur_lwbs) - 1, 5)]);
 	}
+	zilog->zl_cur_lwbs = 0;
+
+	/*
+	 * The log blocks are all issued; zil_commit() waits for them once
+	 * we've let the next writer in.  If we couldn't log at all, fall
+	 * back to waiting for the txg to sync.
+	 */
+	if (lwb == NULL)
+		txg_wait_synced(zilog->zl_dmu_pool, 0);
 
 	mutex_enter(&zilog->zl_lock);
 	zilog->zl_writer = B_FALSE;
@@ -1076,10 +1336,80 @@ zil_commit_writer(zilog_t *zilog, uint64_t seq, uint64_t foid)
 	zilog->zl_commit_seq = commit_seq;
 }
 
+/*
+ * Wait until the first 'target' log blocks issued are on stable storage.
+ * The first waiter to find blocks written but not yet stable flushes the
+ * vdev write caches on behalf of everyone; the others wait for it.
+ * Called with zl_lock held.
+ */
+static void
+zil_commit_wait(zilog_t *zilog, uint64_t target)
+{
+	uint64_t written;
+
+	ASSERT(MUTEX_HELD(&zilog->zl_lock));
+
+	while (zilog->zl_lwb_stable < target) {
+		written = zilog->zl_lwb_written;
+		if (written <= zilog->zl_lwb_stable || zilog->zl_flushing) {
+			cv_wait(&zilog->zl_cv_lwb, &zilog->zl_lock);
+			continue;
+		}
+
+		DTRACE_PROBE1(zil__cw3, zilog_t *, zilog);
+		zilog->zl_flushing = B_TRUE;
+		if (!zfs_nocacheflush)
+			zil_flush_vdevs(zilog); /* drops zl_lock */
+		if (zilog->zl_log_error) {
+			zilog->zl_log_error = B_FALSE;
+			mutex_exit(&zilog->zl_lock);
+			txg_wait_synced(zilog->zl_dmu_pool, 0);
+			mutex_enter(&zilog->zl_lock);
+		}
+		zilog->zl_lwb_stable = MAX(zilog->zl_lwb_stable, written);
+		zilog->zl_flushing = B_FALSE;
+		cv_broadcast(&zilog->zl_cv_lwb);
+		DTRACE_PROBE1(zil__cw4, zilog_t *, zilog);
+	}
+}
+
+/*
+ * The body of zil_commit(), without the sync=disabled check.
+ */
+static void
+zil_commit_impl(zilog_t *zilog, uint64_t seq, uint64_t foid)
+{
+	mutex_enter(&zilog->zl_lock);
+
+	seq = MIN(seq, zilog->zl_itx_seq);	/* cap seq at largest itx seq */
+
+	/* another writer may push our records for us */
+	while (zilog->zl_writer && seq >= zilog->zl_commit_seq)
+		cv_wait(&zilog->zl_cv_writer, &zilog->zl_lock);
+
+	if (seq >= zilog->zl_commit_seq) {
+		zil_commit_writer(zilog, seq, foid); /* drops zl_lock */
+		/* wake up others waiting on the commit */
+		cv_broadcast(&zilog->zl_cv_writer);
+	}
+
+	zil_commit_wait(zilog, zilog->zl_lwb_seq);
+	mutex_exit(&zilog->zl_lock);
+}
+
 /*
  * Push zfs transactions to stable storage up to the supplied sequence number.
  * If foid is 0 push out all transactions, otherwise push only those
  * for that file or might have been used to create that file.
+ *
+ * The writer only holds zl_writer while it fills and issues log blocks,
+ * so the next batch can be built while earlier blocks are in flight.
+ * Each committer then waits only for the blocks issued so far, which
+ * include its own records.
+ *
+ * Datasets with sync=disabled don't commit here; their records are
+ * discarded once the txg that holds the changes has synced, or pushed
+ * by zil_suspend() if that comes first.
  */
 void
 zil_commit(zilog_t *zilog, uint64_t seq, uint64_t foid)
@@ -1087,21 +1417,27 @@ zil_commit(zilog_t *zilog, uint64_t seq, uint64_t foid)
 	if (zilog == NULL || seq == 0)
 		return;
 
-	mutex_enter(&zilog->zl_lock);
+	if (dmu_objset_syncprop(zilog->zl_os) == ZFS_SYNC_DISABLED) {
+		ZILSTAT_BUMP(zilstat_commits_elided);
+		return;
+	}
 
-	seq = MIN(seq, zilog->zl_itx_seq);	/* cap seq at largest itx seq */
+	zil_commit_impl(zilog, seq, foid);
+}
 
-	while (zilog->zl_writer) {
-		cv_wait(&zilog->zl_cv_writer, &zilog->zl_lock);
-		if (seq < zilog->zl_commit_seq) {
-			mutex_exit(&zilog->zl_lock);
-			return;
-		}
-	}
-	zil_commit_writer(zilog, seq, foid); /* drops zl_lock */
-	/* wake up others waiting on the commit */
-	cv_broadcast(&zilog->zl_cv_writer);
-	mutex_exit(&zilog->zl_lock);
+/*
+ * Called after a write that did not ask for synchronous semantics.
+ * Datasets with sync=always commit the log anyway.
+ */
+void
+zil_commit_forced(zilog_t *zilog, uint64_t seq, uint64_t foid)
+{
+	if (zilog == NULL ||
+	    dmu_objset_syncprop(zilog->zl_os) != ZFS_SYNC_ALWAYS)
+		return;
+
+	ZILSTAT_BUMP(zilstat_commits_forced);
+	zil_commit(zilog, seq, foid);
 }
 
 /*
@@ -1174,11 +1510,24 @@ zil_init(void)
 {
 	zil_lwb_cache = kmem_cache_create("zil_lwb_cache",
 	    sizeof (struct lwb), 0, NULL, NULL, NULL, NULL, NULL, 0);
+
+	zil_ksp = kstat_create("zfs", 0, "zil", "misc", KSTAT_TYPE_NAMED,
+	    sizeof (zil_stats) / sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+
+	if (zil_ksp != NULL) {
+		zil_ksp->ks_data = &zil_stats;
+		kstat_install(zil_ksp);
+	}
 }
 
 void
 zil_fini(void)
 {
+	if (zil_ksp != NULL) {
+		kstat_delete(zil_ksp);
+		zil_ksp = NULL;
+	}
+
 	kmem_cache_destroy(zil_lwb_cache);
 }
 
@@ -1199,10 +1548,17 @@ zil_alloc(objset_t *os, zil_header_t *zh_phys)
 #ifdef __APPLE__
 	cv_init(&zilog->zl_cv_writer, NULL, CV_DEFAULT, NULL);
 	cv_init(&zilog->zl_cv_suspend, NULL, CV_DEFAULT, NULL);
+	cv_init(&zilog->zl_cv_lwb, NULL, CV_DEFAULT, NULL);
 #endif
 	list_create(&zilog->zl_itx_list, sizeof (itx_t),
 	    offsetof(itx_t, itx_node));
 
+	list_create(&zilog->zl_itx_common, sizeof (itx_t),
+	    offsetof(itx_t, itx_obj_node));
+
+	avl_create(&zilog->zl_itx_objs, zil_obj_itxs_compare,
+	    sizeof (zil_obj_itxs_t), offsetof(zil_obj_itxs_t, zoi_node));
+
 	list_create(&zilog->zl_lwb_list, sizeof (lwb_t),
 	    offsetof(lwb_t, lwb_node));
 
@@ -1236,10 +1592,15 @@ zil_free(zilog_t *zilog)
 
 	ASSERT(list_head(&zilog->zl_itx_list) == NULL);
 	list_destroy(&zilog->zl_itx_list);
+	ASSERT(list_head(&zilog->zl_itx_common) == NULL);
+	list_destroy(&zilog->zl_itx_common);
+	ASSERT(avl_numnodes(&zilog->zl_itx_objs) == 0);
+	avl_destroy(&zilog->zl_itx_objs);
 	mutex_destroy(&zilog->zl_lock);
 #ifdef __APPLE__
 	cv_destroy(&zilog->zl_cv_writer);
 	cv_destroy(&zilog->zl_cv_suspend);
+	cv_destroy(&zilog->zl_cv_lwb);
 #endif
 	kmem_free(zilog, sizeof (zilog_t));
 }
@@ -1336,7 +1697,11 @@ zil_suspend(zilog_t *zilog)
 	zilog->zl_suspending = B_TRUE;
 	mutex_exit(&zilog->zl_lock);
 
-	zil_commit(zilog, UINT64_MAX, 0);
+	/*
+	 * Push everything even if sync=disabled, since zil_destroy()
+	 * below throws away whatever hasn't been committed.
+	 */
+	zil_commit_impl(zilog, UINT64_MAX, 0);
 
 	/*
 	 * Wait for any in-flight log writes to complete.
@@ -1344,6 +1709,7 @@ zil_suspend(zilog_t *zilog)
 	mutex_enter(&zilog->zl_lock);
 	while (zilog->zl_writer)
 		cv_wait(&zilog->zl_cv_writer, &zilog->zl_lock);
+	zil_commit_wait(zilog, zilog->zl_lwb_seq);
 	mutex_exit(&zilog->zl_lock);
 
 	zil_destroy(zilog, B_FALSE);
@@ -1366,38 +1732,101 @@ zil_resume(zilog_t *zilog)
 	mutex_exit(&zilog->zl_lock);
 }
 
+/*
+ * Replay reads ahead of the record being applied.  Up to this many
+ * records are queued, and the blocks of the indirect writes among them
+ * are read concurrently.  Records that modify a single object are then
+ * handed out in batches of the same size to the replay workers.
+ */
+int zil_replay_window = 32;
+
+typedef struct zil_replay_rec {
+	list_node_t	zrr_node;
+	zio_t		*zrr_zio;	/* read of an indirect write's block */
+	uint64_t	zrr_size;	/* size of zrr_buf */
+	char		*zrr_buf;	/* the record, then its write data */
+} zil_replay_rec_t;
+
+struct zil_replay_arg;
+
+/*
+ * Each worker calls the replay vectors with its own argument and txg
+ * assignment slot, so workers can apply records concurrently.
+ */
+typedef struct zil_replay_worker {
+	struct zil_replay_arg *zrw_zr;
+	void		*zrw_arg;
+	uint64_t	*zrw_txgp;
+	char		*zrw_lrbuf;
+	list_t		zrw_recs;	/* this worker's part of the batch */
+} zil_replay_worker_t;
+
 typedef struct zil_replay_arg {
 	objset_t	*zr_os;
 	zil_replay_func_t **zr_replay;
-	void		*zr_arg;
-	uint64_t	*zr_txgp;
 	boolean_t	zr_byteswap;
-	char		*zr_lrbuf;
+	list_t		zr_recs;	/* records read ahead, in log order */
+	int		zr_nrecs;
+	int		zr_nworkers;
+	zil_replay_worker_t *zr_workers;
+	taskq_t		*zr_taskq;
+	int		zr_batch;	/* records handed to the workers */
+	uint64_t	zr_batch_seq;	/* seq of the last of them */
+	uint64_t	zr_applied_seq;	/* every record up to here applied */
 } zil_replay_arg_t;
 
 static void
-zil_replay_log_record(zilog_t *zilog, lr_t *lr, void *zra, uint64_t claim_txg)
+zil_replay_rec_free(zil_replay_rec_t *rec)
 {
-	zil_replay_arg_t *zr = zra;
-	const zil_header_t *zh = zilog->zl_header;
+	if (rec->zrr_zio != NULL)
+		(void) zio_wait(rec->zrr_zio);
+	kmem_free(rec->zrr_buf, rec->zrr_size);
+	kmem_free(rec, sizeof (zil_replay_rec_t));
+}
+
+/*
+ * Record in the log header, as of tx, that every record up to 'seq' has
+ * been replayed.  Workers apply the records of a batch out of log order,
+ * so this only ever moves forward, and only past a batch once all of it
+ * has been applied.
+ */
+static void
+zil_replay_set_seq(zilog_t *zilog, dmu_tx_t *tx, uint64_t seq)
+{
+	uint64_t *replay_seq;
+
+	dsl_dataset_dirty(dmu_objset_ds(zilog->zl_os), tx);
+
+	mutex_enter(&zilog->zl_lock);
+	replay_seq = &zilog->zl_replay_seq[dmu_tx_get_txg(tx) & TXG_MASK];
+	*replay_seq = MAX(*replay_seq, seq);
+	mutex_exit(&zilog->zl_lock);
+}
+
+static void
+zil_replay_apply(zilog_t *zilog, zil_replay_worker_t *zrw,
+    zil_replay_rec_t *rec, uint64_t seq)
+{
+	zil_replay_arg_t *zr = zrw->zrw_zr;
+	lr_t *lr = (lr_t *)rec->zrr_buf;
 	uint64_t reclen = lr->lrc_reclen;
 	uint64_t txtype = lr->lrc_txtype;
 	char *name;
 	int pass, error, sunk;
 
-	if (zilog->zl_stop_replay)
-		return;
-
-	if (lr->lrc_txg < claim_txg)		/* already committed */
-		return;
-
-	if (lr->lrc_seq <= zh->zh_replay_seq)	/* already replayed */
-		return;
+	/*
+	 * Wait for the data of an indirect write, if any.  A failed read
+	 * is ignored; see zil_replay_log_record().
+	 */
+	if (rec->zrr_zio != NULL) {
+		(void) zio_wait(rec->zrr_zio);
+		rec->zrr_zio = NULL;
+	}
 
 	/*
 	 * Make a copy of the data so we can revise and extend it.
 	 */
-	bcopy(lr, zr->zr_lrbuf, reclen);
+	bcopy(rec->zrr_buf, zrw->zrw_lrbuf, rec->zrr_size);
 
 	/*
 	 * The log block containing this lr may have been byteswapped
@@ -1407,40 +1836,21 @@ zil_replay_log_record(zilog_t *zilog, lr_t *lr, void *zra, uint64_t claim_txg)
 	 * the lr was byteswapped, undo it before invoking the replay vector.
 	 */
 	if (zr->zr_byteswap)
-		byteswap_uint64_array(zr->zr_lrbuf, reclen);
+		byteswap_uint64_array(zrw->zrw_lrbuf, reclen);
 
 	/*
-	 * If this is a TX_WRITE with a blkptr, suck in the data.
+	 * If this is a TX_WRITE with a blkptr, move the data we read
+	 * into place behind the record.
 	 */
 	if (txtype == TX_WRITE && reclen == sizeof (lr_write_t)) {
 		lr_write_t *lrw = (lr_write_t *)lr;
-		blkptr_t *wbp = &lrw->lr_blkptr;
-		uint64_t wlen = lrw->lr_length;
-		char *wbuf = zr->zr_lrbuf + reclen;
+		char *wbuf = zrw->zrw_lrbuf + reclen;
 
-		if (BP_IS_HOLE(wbp)) {	/* compressed to a hole */
-			bzero(wbuf, wlen);
-		} else {
-			/*
-			 * A subsequent write may have overwritten this block,
-			 * in which case wbp may have been been freed and
-			 * reallocated, and our read of wbp may fail with a
-			 * checksum error.  We can safely ignore this because
-			 * the later write will provide the correct data.
-			 */
-			zbookmark_t zb;
-
-			zb.zb_objset = dmu_objset_id(zilog->zl_os);
-			zb.zb_object = lrw->lr_foid;
-			zb.zb_level = -1;
-			zb.zb_blkid = lrw->lr_offset / BP_GET_LSIZE(wbp);
-
-			(void) zio_wait(zio_read(NULL, zilog->zl_spa,
-			    wbp, wbuf, BP_GET_LSIZE(wbp), NULL, NULL,
-			    ZIO_PRIORITY_SYNC_READ,
-			    ZIO_FLAG_CANFAIL | ZIO_FLAG_SPECULATIVE, &zb));
-			(void) memmove(wbuf, wbuf + lrw->lr_blkoff, wlen);
-		}
+		if (BP_IS_HOLE(&lrw->lr_blkptr))	/* compressed */
+			bzero(wbuf, lrw->lr_length);
+		else if (lrw->lr_blkoff != 0)
+			(void) memmove(wbuf, wbuf + lrw->lr_blkoff,
+			    lrw->lr_length);
 	}
 
 	/*
@@ -1469,22 +1879,21 @@ zil_replay_log_record(zilog_t *zilog, lr_t *lr, void *zra, uint64_t claim_txg)
 			 * to fail its dmu_tx_assign().  That's the only way
 			 * to ensure that those code paths remain well tested.
 			 */
-			*zr->zr_txgp = replay_txg - (pass == 1);
-			error = zr->zr_replay[txtype](zr->zr_arg, zr->zr_lrbuf,
-			    zr->zr_byteswap);
-			*zr->zr_txgp = TXG_NOWAIT;
+			*zrw->zrw_txgp = replay_txg - (pass == 1);
+			error = zr->zr_replay[txtype](zrw->zrw_arg,
+			    zrw->zrw_lrbuf, zr->zr_byteswap);
+			*zrw->zrw_txgp = TXG_NOWAIT;
 		}
 
-		if (error == 0) {
-			dsl_dataset_dirty(dmu_objset_ds(zr->zr_os), replay_tx);
-			zilog->zl_replay_seq[replay_txg & TXG_MASK] =
-			    lr->lrc_seq;
-		}
+		if (error == 0)
+			zil_replay_set_seq(zilog, replay_tx, seq);
 
 		dmu_tx_commit(replay_tx);
 
-		if (!error)
+		if (!error) {
+			ZILSTAT_BUMP(zilstat_replay_records);
 			return;
+		}
 
 		/*
 		 * The DMU's dnode layer doesn't see removes until the txg
@@ -1510,6 +1919,7 @@ zil_replay_log_record(zilog_t *zilog, lr_t *lr, void *zra, uint64_t claim_txg)
 	}
 
 	ASSERT(error && error != ERESTART);
+	ZILSTAT_BUMP(zilstat_replay_errors);
 	name = kmem_alloc(MAXNAMELEN, KM_SLEEP);
 	dmu_objset_name(zr->zr_os, name);
 	cmn_err(CE_WARN, "ZFS replay transaction error %d, "
@@ -1519,6 +1929,196 @@ zil_replay_log_record(zilog_t *zilog, lr_t *lr, void *zra, uint64_t claim_txg)
 	kmem_free(name, MAXNAMELEN);
 }
 
+/*
+ * Taskq function: apply one worker's part of a batch, in log order.
+ * Until the whole batch is done the log header may only claim what was
+ * applied before it, so that is the seq each of these records records.
+ */
+static void
+zil_replay_worker(void *arg)
+{
+	zil_replay_worker_t *zrw = arg;
+	zil_replay_arg_t *zr = zrw->zrw_zr;
+	zilog_t *zilog = dmu_objset_zil(zr->zr_os);
+	zil_replay_rec_t *rec;
+
+	while ((rec = list_head(&zrw->zrw_recs)) != NULL) {
+		list_remove(&zrw->zrw_recs, rec);
+		if (!zilog->zl_stop_replay)
+			zil_replay_apply(zilog, zrw, rec, zr->zr_applied_seq);
+		zil_replay_rec_free(rec);
+	}
+}
+
+/*
+ * Apply the current batch on the workers and wait for it.  If every
+ * record was applied, advance the log header past the batch.
+ */
+static void
+zil_replay_flush(zilog_t *zilog, zil_replay_arg_t *zr)
+{
+	dmu_tx_t *tx;
+	int w;
+
+	if (zr->zr_batch == 0)
+		return;
+
+	for (w = 0; w < zr->zr_nworkers; w++) {
+		zil_replay_worker_t *zrw = &zr->zr_workers[w];
+
+		if (!list_is_empty(&zrw->zrw_recs))
+			(void) taskq_dispatch(zr->zr_taskq, zil_replay_worker,
+			    zrw, TQ_SLEEP);
+	}
+	taskq_wait(zr->zr_taskq);
+	zr->zr_batch = 0;
+
+	if (zilog->zl_stop_replay)
+		return;
+
+	tx = dmu_tx_create(zr->zr_os);
+	if (dmu_tx_assign(tx, TXG_WAIT) != 0) {
+		dmu_tx_abort(tx);
+		return;
+	}
+	zil_replay_set_seq(zilog, tx, zr->zr_batch_seq);
+	dmu_tx_commit(tx);
+	zr->zr_applied_seq = zr->zr_batch_seq;
+}
+
+/*
+ * Hand a record that has reached the head of the queue to the worker
+ * for its object.  Records that aren't confined to one object (creates,
+ * removes, links, renames) are barriers: the batch is applied first,
+ * then the record on its own.  With a single worker every record is
+ * applied this way, in log order.
+ */
+static void
+zil_replay_dispatch(zilog_t *zilog, zil_replay_arg_t *zr,
+    zil_replay_rec_t *rec)
+{
+	lr_t *lr = (lr_t *)rec->zrr_buf;
+	uint64_t foid = zil_lr_foid(lr);
+	uint64_t seq = lr->lrc_seq;
+
+	if (zilog->zl_stop_replay) {
+		zil_replay_rec_free(rec);
+		return;
+	}
+
+	if (foid == 0 || zr->zr_nworkers == 1) {
+		zil_replay_flush(zilog, zr);
+		if (!zilog->zl_stop_replay) {
+			zil_replay_apply(zilog, &zr->zr_workers[0], rec, seq);
+			zr->zr_applied_seq = seq;
+		}
+		zil_replay_rec_free(rec);
+		return;
+	}
+
+	list_insert_tail(&zr->zr_workers[foid % zr->zr_nworkers].zrw_recs,
+	    rec);
+	zr->zr_batch_seq = seq;
+	if (++zr->zr_batch >= zil_replay_window)
+		zil_replay_flush(zilog, zr);
+}
+
+/*
+ * Pass queued records on until at most 'window' remain.  Once replay has
+ * stopped the remaining records are discarded.
+ */
+static void
+zil_replay_drain(zilog_t *zilog, zil_replay_arg_t *zr, int window)
+{
+	zil_replay_rec_t *rec;
+
+	while (zr->zr_nrecs > window) {
+		rec = list_head(&zr->zr_recs);
+		list_remove(&zr->zr_recs, rec);
+		zr->zr_nrecs--;
+		zil_replay_dispatch(zilog, zr, rec);
+	}
+
+	if (window == 0)
+		zil_replay_flush(zilog, zr);
+}
+
+/*
+ * Queue a copy of a log record for replay.  If it is a TX_WRITE with a
+ * blkptr, start reading the data now so that it is ready by the time
+ * the record reaches the head of the queue.
+ */
+static void
+zil_replay_log_record(zilog_t *zilog, lr_t *lr, void *zra, uint64_t claim_txg)
+{
+	zil_replay_arg_t *zr = zra;
+	const zil_header_t *zh = zilog->zl_header;
+	uint64_t reclen = lr->lrc_reclen;
+	zil_replay_rec_t *rec;
+	boolean_t indirect = B_FALSE;
+
+	if (zilog->zl_stop_replay)
+		return;
+
+	if (lr->lrc_txg < claim_txg)		/* already committed */
+		return;
+
+	if (lr->lrc_seq <= zh->zh_replay_seq)	/* already replayed */
+		return;
+
+	rec = kmem_zalloc(sizeof (zil_replay_rec_t), KM_SLEEP);
+	rec->zrr_size = reclen;
+
+	if (lr->lrc_txtype == TX_WRITE && reclen == sizeof (lr_write_t)) {
+		lr_write_t *lrw = (lr_write_t *)lr;
+		blkptr_t *wbp = &lrw->lr_blkptr;
+
+		if (BP_IS_HOLE(wbp)) {
+			rec->zrr_size += lrw->lr_length;
+		} else {
+			rec->zrr_size += BP_GET_LSIZE(wbp);
+			indirect = B_TRUE;
+		}
+	}
+
+	rec->zrr_buf = kmem_alloc(rec->zrr_size, KM_SLEEP);
+	bcopy(lr, rec->zrr_buf, reclen);
+
+	if (indirect) {
+		/*
+		 * A subsequent write may have overwritten this block,
+		 * in which case wbp may have been been freed and
+		 * reallocated, and our read of wbp may fail with a
+		 * checksum error.  We can safely ignore this because
+		 * the later write will provide the correct data.
+		 *
+		 * The read uses the blkptr in our copy of the record,
+		 * since the log block is released once we return.
+		 */
+		lr_write_t *lrw = (lr_write_t *)rec->zrr_buf;
+		blkptr_t *wbp = &lrw->lr_blkptr;
+		zbookmark_t zb;
+
+		zb.zb_objset = dmu_objset_id(zilog->zl_os);
+		zb.zb_object = lrw->lr_foid;
+		zb.zb_level = -1;
+		zb.zb_blkid = lrw->lr_offset / BP_GET_LSIZE(wbp);
+
+		rec->zrr_zio = zio_root(zilog->zl_spa, NULL, NULL,
+		    ZIO_FLAG_CANFAIL);
+		zio_nowait(zio_read(rec->zrr_zio, zilog->zl_spa, wbp,
+		    rec->zrr_buf + reclen, BP_GET_LSIZE(wbp), NULL, NULL,
+		    ZIO_PRIORITY_SYNC_READ,
+		    ZIO_FLAG_CANFAIL | ZIO_FLAG_SPECULATIVE, &zb));
+		ZILSTAT_BUMP(zilstat_replay_reads);
+	}
+
+	list_insert_tail(&zr->zr_recs, rec);
+	zr->zr_nrecs++;
+
+	zil_replay_drain(zilog, zr, zil_replay_window);
+}
+
 /* ARGSUSED */
 static void
 zil_incr_blks(zilog_t *zilog, blkptr_t *bp, void *arg, uint64_t claim_txg)
@@ -1528,14 +2128,20 @@ zil_incr_blks(zilog_t *zilog, blkptr_t *bp, void *arg, uint64_t claim_txg)
 
 /*
  * If this dataset has a non-empty intent log, replay it and destroy it.
+ * Records that modify a single object are applied by 'nargs' workers in
+ * parallel, partitioned by object number; worker i passes args[i] to the
+ * replay vectors and assigns their transactions through txgps[i].
  */
 void
-zil_replay(objset_t *os, void *arg, uint64_t *txgp,
+zil_replay_parallel(objset_t *os, int nargs, void **args, uint64_t **txgps,
 	zil_replay_func_t *replay_func[TX_MAX_TYPE])
 {
 	zilog_t *zilog = dmu_objset_zil(os);
 	const zil_header_t *zh = zilog->zl_header;
 	zil_replay_arg_t zr;
+	int w;
+
+	ASSERT(nargs > 0);
 
 	if (zil_empty(zilog)) {
 		zil_destroy(zilog, B_TRUE);
@@ -1544,10 +2150,30 @@ zil_replay(objset_t *os, void *arg, uint64_t *txgp,
 
 	zr.zr_os = os;
 	zr.zr_replay = replay_func;
-	zr.zr_arg = arg;
-	zr.zr_txgp = txgp;
 	zr.zr_byteswap = BP_SHOULD_BYTESWAP(&zh->zh_log);
-	zr.zr_lrbuf = kmem_alloc(2 * SPA_MAXBLOCKSIZE, KM_SLEEP);
+	list_create(&zr.zr_recs, sizeof (zil_replay_rec_t),
+	    offsetof(zil_replay_rec_t, zrr_node));
+	zr.zr_nrecs = 0;
+	zr.zr_nworkers = nargs;
+	zr.zr_workers = kmem_zalloc(nargs * sizeof (zil_replay_worker_t),
+	    KM_SLEEP);
+	for (w = 0; w < nargs; w++) {
+		zil_replay_worker_t *zrw = &zr.zr_workers[w];
+
+		zrw->zrw_zr = &zr;
+		zrw->zrw_arg = args[w];
+		zrw->zrw_txgp = txgps[w];
+		zrw->zrw_lrbuf = kmem_alloc(2 * SPA_MAXBLOCKSIZE, KM_SLEEP);
+		list_create(&zrw->zrw_recs, sizeof (zil_replay_rec_t),
+		    offsetof(zil_replay_rec_t, zrr_node));
+	}
+	zr.zr_taskq = NULL;
+	if (nargs > 1)
+		zr.zr_taskq = taskq_create("zil_replay", nargs, minclsyspri,
+		    nargs, nargs, TASKQ_PREPOPULATE);
+	zr.zr_batch = 0;
+	zr.zr_batch_seq = 0;
+	zr.zr_applied_seq = zh->zh_replay_seq;
 
 	/*
 	 * Wait for in-progress removes to sync before starting replay.
@@ -1559,11 +2185,34 @@ zil_replay(objset_t *os, void *arg, uint64_t *txgp,
 	ASSERT(zilog->zl_replay_blks == 0);
 	(void) zil_parse(zilog, zil_incr_blks, zil_replay_log_record, &zr,
 	    zh->zh_claim_txg);
-	kmem_free(zr.zr_lrbuf, 2 * SPA_MAXBLOCKSIZE);
+	zil_replay_drain(zilog, &zr, 0);
+	list_destroy(&zr.zr_recs);
+
+	if (zr.zr_taskq != NULL)
+		taskq_destroy(zr.zr_taskq);
+	for (w = 0; w < nargs; w++) {
+		zil_replay_worker_t *zrw = &zr.zr_workers[w];
+
+		list_destroy(&zrw->zrw_recs);
+		kmem_free(zrw->zrw_lrbuf, 2 * SPA_MAXBLOCKSIZE);
+	}
+	kmem_free(zr.zr_workers, nargs * sizeof (zil_replay_worker_t));
 
 	zil_destroy(zilog, B_FALSE);
 }
 
+/*
+ * Replay with a single worker, applying every record in log order.  The
+ * ZPL and zvols use this: their replay vectors share one txg assignment
+ * slot (z_assign, zv_txg_assign) for the whole dataset.
+ */
+void
+zil_replay(objset_t *os, void *arg, uint64_t *txgp,
+	zil_replay_func_t *replay_func[TX_MAX_TYPE])
+{
+	zil_replay_parallel(os, 1, &arg, &txgp, replay_func);
+}
+
 /*
  * Report whether all transactions are committed
  */
@@ -66,6 +66,12 @@ char *zio_type_name[ZIO_TYPES] = {
 /* At or above this size, force gang blocking - for testing */
 uint64_t zio_gang_bang = SPA_MAXBLOCKSIZE + 1;
 
+/*
+ * Data blocks up to this size are allocated from the special class along
+ * with metadata, when the pool has special vdevs.  Zero means metadata only.
+ */
+uint64_t zio_special_small_blocks = 0;
+
 /* Force an allocation failure when non-zero */
 uint16_t zio_zil_fail_shift = 0;
 
@@ -111,7 +117,9 @@ zio_init(void)
 	 * For small buffers, we want a cache for each multiple of
 	 * SPA_MINBLOCKSIZE.  For medium-size buffers, we want a cache
 	 * for each quarter-power of 2.  For large buffers, we want
-	 * a cache for each multiple of PAGESIZE.
+	 * a cache for each multiple of PAGESIZE, up to the old 128K
+	 * maximum; beyond that a cache per page would mean hundreds of
+	 * mostly idle caches, so large blocks only get the quarter-powers.
 	 */
 	for (c = 0; c < SPA_MAXBLOCKSIZE >> SPA_MINBLOCKSHIFT; c++) {
 		size_t size = (c + 1) << SPA_MINBLOCKSHIFT;
@@ -123,10 +131,11 @@ zio_init(void)
 
 		if (size <= 4 * SPA_MINBLOCKSIZE) {
 			align = SPA_MINBLOCKSIZE;
-		} else if (P2PHASE(size, PAGESIZE) == 0) {
+		} else if (size <= SPA_OLD_MAXBLOCKSIZE &&
+		    P2PHASE(size, PAGESIZE) == 0) {
 			align = PAGESIZE;
 		} else if (P2PHASE(size, p2 >> 2) == 0) {
-			align = p2 >> 2;
+			align = MIN(p2 >> 2, PAGESIZE);
 		}
 
 		if (align != 0) {
@@ -616,6 +625,54 @@ zio_ioctl(zio_t *pio, spa_t *spa, vdev_t *vd, int cmd,
 	return (zio);
 }
 
+/*
+ * Tell the devices underneath vd that [offset, offset + size) no longer
+ * holds live data.  The range must have been freed in a txg that has
+ * completely synced, and must not be reallocated until this zio is done.
+ * Interior vdevs translate the range into their children's address
+ * space; leaves see it as a DKIOCFREE ioctl.
+ */
+zio_t *
+zio_trim(zio_t *pio, spa_t *spa, vdev_t *vd, uint64_t offset, uint64_t size,
+    zio_done_func_t *done, void *private, int priority, int flags)
+{
+	zio_t *zio;
+	vdev_t *cvd;
+	uint64_t coffset, csize;
+	int c;
+
+	if (vd->vdev_children == 0) {
+		zio = zio_create(pio, spa, 0, NULL, NULL, 0, done, private,
+		    ZIO_TYPE_IOCTL, priority, flags,
+		    ZIO_STAGE_OPEN, ZIO_IOCTL_PIPELINE);
+
+		/*
+		 * The range may be far larger than SPA_MAXBLOCKSIZE, and
+		 * there is no data, so set it after zio_create().
+		 */
+		zio->io_vd = vd;
+		zio->io_cmd = DKIOCFREE;
+		zio->io_offset = offset;
+		zio->io_size = size;
+	} else {
+		zio = zio_null(pio, spa, NULL, NULL, flags);
+
+		for (c = 0; c < vd->vdev_children; c++) {
+			cvd = vd->vdev_child[c];
+			coffset = offset;
+			csize = size;
+			if (vd->vdev_ops == &vdev_raidz_ops)
+				vdev_raidz_child_range(vd, c, &coffset, &csize);
+			if (csize == 0 || cvd->vdev_notrim)
+				continue;
+			zio_nowait(zio_trim(zio, spa, cvd, coffset, csize,
+			    done, private, priority, flags));
+		}
+	}
+
+	return (zio);
+}
+
 static void
 zio_phys_bp_init(vdev_t *vd, blkptr_t *bp, uint64_t offset, uint64_t size,
     int checksum)
@@ -1366,6 +1423,26 @@ zio_dva_allocate(zio_t *zio)
 
 	ASSERT3U(zio->io_size, ==, BP_GET_PSIZE(bp));
 
+	/*
+	 * Metadata, and data blocks no larger than zio_special_small_blocks,
+	 * go to the special class if the pool has one.  If it's full or
+	 * otherwise can't satisfy the allocation, use the normal class.
+	 * Unlike ZIO_FLAG_METADATA, which children inherit from the
+	 * dnode's and indirect blocks' writes, ZIO_FLAG_SPECIAL is set
+	 * only by the writer of the block itself.
+	 */
+	if (spa_has_special(spa) && ((zio->io_flags & ZIO_FLAG_SPECIAL) ||
+	    zio->io_size <= zio_special_small_blocks)) {
+		error = metaslab_alloc(spa, spa->spa_special_class,
+		    zio->io_size, bp, zio->io_ndvas, zio->io_txg, NULL,
+		    B_FALSE);
+		if (error == 0) {
+			bp->blk_birth = zio->io_txg;
+			zio_next_stage(zio);
+			return;
+		}
+	}
+
 	error = metaslab_alloc(spa, mc, zio->io_size, bp, zio->io_ndvas,
 	    zio->io_txg, NULL, B_FALSE);
 
@@ -1446,6 +1523,18 @@ zio_vdev_io_start(zio_t *zio)
 		zio->io_flags |= ZIO_FLAG_SUBBLOCK;
 	}
 
+	/*
+	 * Count async writes against the top-level vdev's allocation
+	 * throttle until zio_vdev_io_assess().
+	 */
+	if (vd == tvd && zio->io_type == ZIO_TYPE_WRITE &&
+	    zio->io_priority == ZIO_PRIORITY_ASYNC_WRITE &&
+	    tvd->vdev_mg != NULL) {
+		ASSERT(!(zio->io_flags & ZIO_FLAG_ALLOC_QUEUED));
+		zio->io_flags |= ZIO_FLAG_ALLOC_QUEUED;
+		metaslab_group_queued(tvd->vdev_mg, zio->io_size);
+	}
+
 	ASSERT(P2PHASE(zio->io_offset, align) == 0);
 	ASSERT(P2PHASE(zio->io_size, align) == 0);
 	ASSERT(bp == NULL ||
@@ -1495,6 +1584,12 @@ zio_vdev_io_assess(zio_t *zio)
 
 	ASSERT(zio->io_vsd == NULL);
 
+	if (zio->io_flags & ZIO_FLAG_ALLOC_QUEUED) {
+		ASSERT(vd == tvd);
+		metaslab_group_queued(tvd->vdev_mg, -(int64_t)zio->io_size);
+		zio->io_flags &= ~ZIO_FLAG_ALLOC_QUEUED;
+	}
+
 	if (zio->io_flags & ZIO_FLAG_SUBBLOCK) {
 		void *abuf;
 		uint64_t asize;
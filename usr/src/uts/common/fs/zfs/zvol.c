@@ -150,7 +150,7 @@ int
 zvol_check_volblocksize(uint64_t volblocksize)
 {
 	if (volblocksize < SPA_MINBLOCKSIZE ||
-	    volblocksize > SPA_MAXBLOCKSIZE ||
+	    volblocksize > SPA_OLD_MAXBLOCKSIZE ||
 	    !ISP2(volblocksize))
 		return (EDOM);
 
@@ -908,8 +908,12 @@ zvol_strategy(buf_t *bp)
 	if ((bp->b_resid = resid) == bp->b_bcount)
 		bioerror(bp, off > volsize ? EINVAL : error);
 
-	if (!(bp->b_flags & B_ASYNC) && !reading && !zil_disable)
-		zil_commit(zv->zv_zilog, UINT64_MAX, ZVOL_OBJ);
+	if (!reading && !zil_disable) {
+		if (!(bp->b_flags & B_ASYNC))
+			zil_commit(zv->zv_zilog, UINT64_MAX, ZVOL_OBJ);
+		else
+			zil_commit_forced(zv->zv_zilog, UINT64_MAX, ZVOL_OBJ);
+	}
 
 	biodone(bp);
 #endif
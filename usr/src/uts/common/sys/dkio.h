@@ -480,6 +480,12 @@ typedef struct dk_updatefw_32 {
 #define	FW_TYPE_TEMP	0x0		/* temporary use */
 #define	FW_TYPE_PERM	0x1		/* permanent use */
 
+/*
+ * Tell the device that a range of blocks no longer holds live data,
+ * so that thin-provisioned and solid state media can reclaim it.
+ */
+#define	DKIOCFREE		(DKIOC|50)
+
 
 #ifdef	__cplusplus
 }
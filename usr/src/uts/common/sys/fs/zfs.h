@@ -106,9 +106,26 @@ typedef enum {
 	ZPOOL_PROP_DELEGATION,
 	ZFS_PROP_VERSION,
 	ZPOOL_PROP_NAME,
+	ZPOOL_PROP_AUTOTRIM,
+	ZFS_PROP_LOGBIAS,
+	ZFS_PROP_SYNC,
+	ZPOOL_PROP_FREEING,
 	ZFS_NUM_PROPS
 } zfs_prop_t;
 
+/*
+ * Values of the logbias property.
+ */
+#define	ZFS_LOGBIAS_LATENCY	0
+#define	ZFS_LOGBIAS_THROUGHPUT	1
+
+/*
+ * Values of the sync property.
+ */
+#define	ZFS_SYNC_STANDARD	0
+#define	ZFS_SYNC_ALWAYS		1
+#define	ZFS_SYNC_DISABLED	2
+
 typedef zfs_prop_t zpool_prop_t;
 
 #define	ZPOOL_PROP_CONT		ZFS_PROP_CONT
@@ -189,13 +206,16 @@ extern zpool_prop_t zpool_prop_iter(zpool_prop_f, void *);
 #define	SPA_VERSION_6			6ULL
 #define	SPA_VERSION_7			7ULL
 #define	SPA_VERSION_8			8ULL
+#define	SPA_VERSION_9			9ULL
+#define	SPA_VERSION_10			10ULL
+#define	SPA_VERSION_11			11ULL
 /*
  * When bumping up SPA_VERSION, make sure GRUB ZFS understand the on-disk
  * format change. Go to usr/src/grub/grub-0.95/stage2/{zfs-include/, fsys_zfs*},
  * and do the appropriate changes.
  */
-#define	SPA_VERSION			SPA_VERSION_8
-#define	SPA_VERSION_STRING		"8"
+#define	SPA_VERSION			SPA_VERSION_11
+#define	SPA_VERSION_STRING		"11"
 
 /*
  * Symbolic names for the changes that caused a SPA_VERSION switch.
@@ -220,6 +240,9 @@ extern zpool_prop_t zpool_prop_iter(zpool_prop_f, void *);
 #define	SPA_VERSION_BOOTFS		SPA_VERSION_6
 #define	ZFS_VERSION_SLOGS		SPA_VERSION_7
 #define	ZFS_VERSION_DELEGATED_PERMS	SPA_VERSION_8
+#define	SPA_VERSION_LARGE_BLOCKS	SPA_VERSION_9
+#define	SPA_VERSION_SPECIAL_CLASS	SPA_VERSION_10
+#define	SPA_VERSION_FREE_QUEUE		SPA_VERSION_11
 
 /*
  * ZPL version - rev'd whenever an incompatible on-disk format change
@@ -273,6 +296,7 @@ extern zpool_prop_t zpool_prop_iter(zpool_prop_f, void *);
 #define	ZPOOL_CONFIG_UNSPARE		"unspare"
 #define	ZPOOL_CONFIG_PHYS_PATH		"phys_path"
 #define	ZPOOL_CONFIG_IS_LOG		"is_log"
+#define	ZPOOL_CONFIG_IS_SPECIAL		"is_special"
 /*
  * The persistent vdev state is stored as separate values rather than a single
  * 'vdev_state' entry.  This is because a device can be in multiple states, such
@@ -292,6 +316,7 @@ extern zpool_prop_t zpool_prop_iter(zpool_prop_f, void *);
 #define	VDEV_TYPE_MISSING		"missing"
 #define	VDEV_TYPE_SPARE			"spare"
 #define	VDEV_TYPE_LOG			"log"
+#define	VDEV_TYPE_SPECIAL		"special"
 
 /*
  * This is needed in userland to report the minimum necessary device size.
@@ -408,8 +433,17 @@ typedef struct vdev_stat {
 	uint64_t	vs_scrub_errors;	/* errors during scrub	*/
 	uint64_t	vs_scrub_start;		/* UTC scrub start time	*/
 	uint64_t	vs_scrub_end;		/* UTC scrub end time	*/
+	uint64_t	vs_scrub_limit;		/* scrub I/O limit; root */
+	uint64_t	vs_scrub_delay;		/* scrub I/O delay (ms)	*/
+	uint64_t	vs_fragmentation;	/* free space frag (%)	*/
 } vdev_stat_t;
 
+/*
+ * vs_fragmentation value for vdevs without metaslabs, or whose metaslabs
+ * haven't been loaded yet.
+ */
+#define	ZFS_FRAG_INVALID	(-1ULL)
+
 #define	ZFS_DRIVER	"zfs"
 #define	ZFS_DEV		"/dev/zfs"
 
@@ -484,6 +518,7 @@ typedef struct vdev_stat {
 #define	ZFS_IOC_ISCSI_PERM_CHECK    ZFS_IOC_CMD(43)
 #define	ZFS_IOC_SHARE		    ZFS_IOC_CMD(44)
 #define	ZFS_IOC_INHERIT_PROP	    ZFS_IOC_CMD(45)
+#define	ZFS_IOC_POOL_TXG_HISTORY    ZFS_IOC_CMD(46)
 
 /*
  * Internal SPA load state.  Used by FMA diagnosis engine.
@@ -518,6 +553,32 @@ typedef enum {
 #define	ZPOOL_HIST_INT_EVENT	"history internal event"
 #define	ZPOOL_HIST_INT_STR	"history internal str"
 
+/*
+ * The txg history nvlist (ZFS_IOC_POOL_TXG_HISTORY) is an array of
+ * ZPOOL_TXG_RECORD nvlists, oldest txg first.  Times are in nanoseconds.
+ */
+#define	ZPOOL_TXG_RECORD	"txg record"
+#define	ZPOOL_TXG_TXG		"txg"
+#define	ZPOOL_TXG_STATE		"txg state"
+#define	ZPOOL_TXG_OPEN_TIME	"txg open time"
+#define	ZPOOL_TXG_QUIESCE_TIME	"txg quiesce time"
+#define	ZPOOL_TXG_WAIT_TIME	"txg wait time"
+#define	ZPOOL_TXG_SYNC_TIME	"txg sync time"
+#define	ZPOOL_TXG_DIRTY		"txg dirty bytes"
+#define	ZPOOL_TXG_WRITTEN	"txg written bytes"
+#define	ZPOOL_TXG_PASSES	"txg sync passes"
+#define	ZPOOL_TXG_DEFERRED	"txg deferred frees"
+#define	ZPOOL_TXG_ZIL_COMMITS	"txg zil commits"
+
+/*
+ * Values of ZPOOL_TXG_STATE.
+ */
+#define	ZPOOL_TXG_STATE_OPEN		0
+#define	ZPOOL_TXG_STATE_QUIESCING	1
+#define	ZPOOL_TXG_STATE_QUIESCED	2
+#define	ZPOOL_TXG_STATE_SYNCING		3
+#define	ZPOOL_TXG_STATE_SYNCED		4
+
 /*
  * Flags for ZFS_IOC_VDEV_SET_STATE
  */